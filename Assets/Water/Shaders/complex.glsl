@@ -0,0 +1,25 @@
+#ifndef COMPLEX_GLSL
+#define COMPLEX_GLSL
+
+struct complex {
+	float re;
+	float im;
+};
+
+complex add(complex z, complex w) {
+	return complex(z.re + w.re, z.im + w.im);
+}
+
+complex mul(complex z, complex w) {
+	return complex((z.re * w.re) - (z.im * w.im), (z.re * w.im) + (w.re * z.im));
+}
+
+complex mul(complex z, float fac) {
+	return complex(z.re * fac, z.im * fac);
+}
+
+complex conj(complex w) {
+	return complex(w.re, -w.im);
+}
+
+#endif
@@ -1,4 +1,5 @@
 #version 460
+#extension GL_GOOGLE_include_directive : require
 
 #define M_TWOPI 6.283185307179586476925286766559
 
@@ -16,22 +17,7 @@ layout(push_constant) uniform PushConstants {
 layout(binding = 0, rgba32f) readonly uniform image2D input_images[5];
 layout(binding = 1, rgba32f) writeonly uniform image2D output_images[5];
 
-struct complex {
-	float re;
-	float im;
-};
-
-complex add(complex z, complex w) {
-	return complex(z.re + w.re, z.im + w.im);
-}
-
-complex mul(complex z, complex w) {
-	return complex((z.re * w.re) - (z.im * w.im), (z.re * w.im) + (w.re * z.im));
-}
-
-complex mul(complex z, float fac) {
-	return complex(z.re * fac, z.im * fac);
-}
+#include "complex.glsl"
 
 // SLM approach outlined in https://software.intel.com/en-us/articles/fast-fourier-transform-for-image-processing-in-directx-11
 shared complex pingpong[2][LENGTH];
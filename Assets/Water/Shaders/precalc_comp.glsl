@@ -1,4 +1,5 @@
 #version 460
+#extension GL_GOOGLE_include_directive : require
 
 #define M_PI 3.1415926535897932384626433832795
 #define M_G 9.81
@@ -17,14 +18,7 @@ layout(binding = 3) buffer UNIF_RAND_STORAGE_BUF {
 	vec4 data[];
 } unif_randoms;
 
-struct complex {
-	float re;
-	float im;
-};
-
-complex conj(complex w) {
-	return complex(w.re, -w.im);
-}
+#include "complex.glsl"
 
 float phillips(vec2 k) {
 	float k_len = sqrt((k.x * k.x) + (k.y * k.y));
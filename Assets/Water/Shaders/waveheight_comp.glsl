@@ -1,4 +1,5 @@
 #version 460
+#extension GL_GOOGLE_include_directive : require
 
 #define M_PI 3.1415926535897932384626433832795
 #define M_G 9.81
@@ -20,18 +21,7 @@ layout(binding = 5, rgba32f) writeonly uniform image2D h0tilde_tz;
 layout(binding = 6, rgba32f) writeonly uniform image2D h0tilde_slopex;
 layout(binding = 7, rgba32f) writeonly uniform image2D h0tilde_slopez;
 
-struct complex {
-	float re;
-	float im;
-};
-
-complex add(complex z, complex w) {
-	return complex(z.re + w.re, z.im + w.im);
-}
-
-complex mul(complex z, complex w) {
-	return complex((z.re * w.re) - (z.im * w.im), (z.re * w.im) + (w.re * z.im));
-}
+#include "complex.glsl"
 
 float dispersion(vec2 k) {
 	float w_0 = 2.0f * M_PI / ubo.RT;
@@ -20,7 +20,8 @@ struct MeshGenerationSystem : Quadbit::ComponentSystem {
 
 		entityManager_->ForEach<VoxelBlockComponent, MeshReadyTag>
 			([&](Quadbit::Entity entity, VoxelBlockComponent& block, auto& tag) {
-			entityManager_->AddComponent<Quadbit::CustomMeshComponent>(entity, graphics->CreateMesh(block.vertices, sizeof(VoxelVertex), block.indices, pipeline));
+			entityManager_->AddComponent<Quadbit::CustomMeshComponent>(entity, graphics->CreateMesh(block.vertices, sizeof(VoxelVertex), block.indices, pipeline,
+				-1, Quadbit::QBVK_DESCRIPTOR_SETS_NULL_HANDLE, true));
 		});
 	}
 
@@ -34,7 +35,8 @@ struct MeshGenerationSystem : Quadbit::ComponentSystem {
 
 		entityManager_->ForEach<VoxelBlockComponent, MeshReadyTag>
 			([&](Quadbit::Entity entity, VoxelBlockComponent& block, auto& tag) {
-			entityManager_->AddComponent<Quadbit::CustomMeshComponent>(entity, graphics->CreateMesh(block.vertices, sizeof(VoxelVertex), block.indices, pipeline));
+			entityManager_->AddComponent<Quadbit::CustomMeshComponent>(entity, graphics->CreateMesh(block.vertices, sizeof(VoxelVertex), block.indices, pipeline,
+				-1, Quadbit::QBVK_DESCRIPTOR_SETS_NULL_HANDLE, true));
 		});
 
 	}
@@ -211,8 +211,10 @@ void Water::InitInverseFFTComputeInstances() {
 		verticalIFFTResources_.dSlopeZ
 	};
 
-	horizontalIFFTPipeline_ = compute_->CreatePipeline("Assets/Water/Shaders/ifft_comp.glsl", "main", horizontalIFFTResources_.specData.data());
-	verticalIFFTPipeline_ = compute_->CreatePipeline("Assets/Water/Shaders/ifft_comp.glsl", "main", verticalIFFTResources_.specData.data());
+	horizontalIFFTPipeline_ = compute_->CreatePipeline("Assets/Water/Shaders/ifft_comp.glsl", "main",
+		Quadbit::QbVkSpecialization::Packed(horizontalIFFTResources_.specData));
+	verticalIFFTPipeline_ = compute_->CreatePipeline("Assets/Water/Shaders/ifft_comp.glsl", "main",
+		Quadbit::QbVkSpecialization::Packed(verticalIFFTResources_.specData));
 
 	compute_->BindResourceArray(horizontalIFFTPipeline_, "input_images", waveheightImageArray);
 	compute_->BindResourceArray(horizontalIFFTPipeline_, "output_images", horizontalImageArray);
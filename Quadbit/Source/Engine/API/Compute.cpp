@@ -13,9 +13,9 @@ namespace Quadbit {
 	Compute::Compute(QbVkRenderer* const renderer) : renderer_(renderer), resourceManager_(renderer->context_->resourceManager.get()) { }
 
 	QbVkPipelineHandle Compute::CreatePipeline(const char* computePath, const char* kernel, 
-		const void* specConstants, const uint32_t maxInstances) {
+		const QbVkSpecialization& specialization, const uint32_t maxInstances, const QbVkShaderDefines& defines) {
 		auto handle = resourceManager_->pipelines_.GetNextHandle();
-		resourceManager_->pipelines_[handle] = eastl::make_unique<QbVkPipeline>(*renderer_->context_, computePath, kernel, specConstants, maxInstances);
+		resourceManager_->pipelines_[handle] = eastl::make_unique<QbVkPipeline>(*renderer_->context_, computePath, kernel, specialization, maxInstances, defines);
 
 		return handle;
 	}
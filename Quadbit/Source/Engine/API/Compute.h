@@ -13,8 +13,9 @@ namespace Quadbit {
 	public:
 		Compute(QbVkRenderer* const renderer);
 
+		// Pass QbVkSpecialization::Packed(constants) to specialise from a struct of all the kernel's constants
 		QbVkPipelineHandle CreatePipeline(const char* computePath, const char* kernel,
-			const void* specConstants = nullptr, const uint32_t maxInstances = 1); 
+			const QbVkSpecialization& specialization = {}, const uint32_t maxInstances = 1, const QbVkShaderDefines& defines = {});
 
 		void BindResource(const QbVkPipelineHandle pipelineHandle, const eastl::string name, 
 			const QbVkBufferHandle bufferHandle, const QbVkDescriptorSetsHandle descriptorsHandle = QBVK_DESCRIPTOR_SETS_NULL_HANDLE);
@@ -7,6 +7,7 @@
 #include "Engine/Rendering/VulkanUtils.h"
 #include "Engine/Rendering/Pipelines/Pipeline.h"
 #include "Engine/Rendering/Pipelines/PBRPipeline.h"
+#include "Engine/Rendering/Memory/DeletionQueue.h"
 #include "Engine/Rendering/Memory/ResourceManager.h"
 
 namespace Quadbit {
@@ -36,9 +37,13 @@ namespace Quadbit {
 		return resourceManager_->CreateGPUBuffer(size, bufferUsage, memoryUsage);
 	}
 
-	void Graphics::TransferDataToGPUBuffer(const void* data, VkDeviceSize size, QbVkBufferHandle destination) {
+	void Graphics::TransferDataToGPUBuffer(const void* data, VkDeviceSize size, QbVkBufferHandle destination, VkDeviceSize dstOffset) {
 		auto& buffer = resourceManager_->buffers_[destination];
-		VkUtils::TransferDataToGPUBuffer(*renderer_->context_, data, size, buffer);
+		VkUtils::TransferDataToGPUBuffer(*renderer_->context_, data, size, buffer, dstOffset);
+	}
+
+	void Graphics::UpdateGPUBuffer(const void* data, VkDeviceSize size, QbVkBufferHandle destination, VkDeviceSize dstOffset) {
+		resourceManager_->TransferDataToGPU(data, size, destination, dstOffset);
 	}
 #pragma endregion
 
@@ -55,6 +60,18 @@ namespace Quadbit {
 		return resourceManager_->LoadTexture(imagePath, samplerInfo);
 	}
 
+	QbVkTextureHandle Graphics::LoadTextureAsync(const char* imagePath, VkSamplerCreateInfo* samplerInfo) {
+		return resourceManager_->LoadTextureAsync(imagePath, samplerInfo);
+	}
+
+	bool Graphics::IsTextureReady(QbVkTextureHandle handle) {
+		return resourceManager_->IsTextureReady(handle);
+	}
+
+	void Graphics::SetTextureStreamingBudget(VkDeviceSize budget) {
+		resourceManager_->SetTextureStreamingBudget(budget);
+	}
+
 	VkSamplerCreateInfo Graphics::CreateImageSamplerInfo(VkFilter samplerFilter, VkSamplerAddressMode addressMode, VkBool32 enableAnisotropy,
 		float maxAnisotropy, VkCompareOp compareOperation, VkSamplerMipmapMode samplerMipmapMode, float maxLod) {
 		auto samplerInfo = VkUtils::Init::SamplerCreateInfo(samplerFilter, addressMode, enableAnisotropy, maxAnisotropy, compareOperation, samplerMipmapMode, maxLod);
@@ -90,11 +107,13 @@ namespace Quadbit {
 	// Max instances here refers to the maximum number shader resource instances
 	QbVkPipelineHandle Graphics::CreatePipeline(const char* vertexPath, const char* vertexEntry, const char* fragmentPath, const char* fragmentEntry,
 		const QbVkPipelineDescription pipelineDescription, const VkRenderPass renderPass, const uint32_t maxInstances, 
-		const eastl::vector<eastl::tuple<VkFormat, uint32_t>>& vertexAttributeOverride) {
+		const eastl::vector<eastl::tuple<VkFormat, uint32_t>>& vertexAttributeOverride, const QbVkShaderDefines& defines,
+		const QbVkSpecialization& vertexSpecialization, const QbVkSpecialization& fragmentSpecialization) {
 
 		auto handle = resourceManager_->pipelines_.GetNextHandle();
 		resourceManager_->pipelines_[handle] = eastl::make_unique<QbVkPipeline>(*renderer_->context_, vertexPath, vertexEntry,
-			fragmentPath, fragmentEntry, pipelineDescription, renderPass == VkRenderPass(-1) ? renderer_->context_->mainRenderPass : renderPass, maxInstances, vertexAttributeOverride);
+			fragmentPath, fragmentEntry, pipelineDescription, renderPass == VkRenderPass(-1) ? renderer_->context_->mainRenderPass : renderPass, maxInstances, vertexAttributeOverride, defines,
+			vertexSpecialization, fragmentSpecialization);
 		
 		auto& pipeline = resourceManager_->pipelines_[handle];
 		pipeline->Rebuild();
@@ -150,14 +169,23 @@ namespace Quadbit {
 		return renderer_->pbrPipeline_->LoadModel(path);
 	}
 
+	void Graphics::DestroyPBRModel(const Entity& entity) {
+		const auto& entityManager = renderer_->context_->entityManager;
+		QB_ASSERT(entityManager->HasComponent<PBRSceneComponent>(entity));
+		renderer_->pbrPipeline_->DestroyModel(*entityManager->GetComponentPtr<PBRSceneComponent>(entity));
+		entityManager->RemoveComponent<PBRSceneComponent>(entity);
+	}
+
 	void Graphics::DestroyMesh(const Entity& entity) {
 		const auto& entityManager = renderer_->context_->entityManager;
 		QB_ASSERT(entityManager->HasComponent<CustomMeshComponent>(entity));
 		const auto& mesh = entityManager->GetComponentPtr<CustomMeshComponent>(entity);
-		entityManager->AddComponent<CustomMeshDeleteComponent>(
-			entityManager->Create(),
-			{ mesh->vertexHandle, mesh->indexHandle }
-		);
+		// The mesh may still be drawn by frames in flight
+		auto* resourceManager = renderer_->context_->resourceManager.get();
+		renderer_->context_->deletionQueue->Enqueue([resourceManager, vertices = mesh->vertices, indices = mesh->indices]() {
+			resourceManager->FreeMeshAllocation(vertices);
+			resourceManager->FreeMeshAllocation(indices);
+		});
 		entityManager->RemoveComponent<CustomMeshComponent>(entity);
 	}
 #pragma endregion
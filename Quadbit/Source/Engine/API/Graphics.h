@@ -31,7 +31,10 @@ namespace Quadbit {
 		/*    GPU     */
 		/**************/
 		QbVkBufferHandle CreateGPUBuffer(VkDeviceSize size, VkBufferUsageFlags bufferUsage, QbVkMemoryUsage = QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY);
-		void TransferDataToGPUBuffer(const void* data, VkDeviceSize size, QbVkBufferHandle destination);
+		void TransferDataToGPUBuffer(const void* data, VkDeviceSize size, QbVkBufferHandle destination, VkDeviceSize dstOffset = 0);
+		// Queues a ranged update that is uploaded with the next frame, updates to
+		// adjacent ranges of the same buffer are merged into a single copy
+		void UpdateGPUBuffer(const void* data, VkDeviceSize size, QbVkBufferHandle destination, VkDeviceSize dstOffset = 0);
 
 		template<typename T>
 		QbVkUniformBuffer<T> CreateUniformBuffer() {
@@ -54,8 +57,14 @@ namespace Quadbit {
 		/*    Images and Textures     */
 		/******************************/
 		QbVkTextureHandle CreateTexture(uint32_t width, uint32_t height, VkSamplerCreateInfo* samplerInfo = nullptr);
+		// Returns QBVK_TEXTURE_NULL_HANDLE if the device can't use the format for storage images
 		QbVkTextureHandle CreateStorageTexture(uint32_t width, uint32_t height, VkFormat format, VkSamplerCreateInfo* samplerInfo = nullptr);
 		QbVkTextureHandle LoadTexture(const char* imagePath, VkSamplerCreateInfo* samplerInfo = nullptr);
+		// Loads in the background, the handle refers to an empty texture until IsTextureReady
+		QbVkTextureHandle LoadTextureAsync(const char* imagePath, VkSamplerCreateInfo* samplerInfo = nullptr);
+		bool IsTextureReady(QbVkTextureHandle handle);
+		// VRAM available to the mip levels of streamed textures, such as those of loaded models
+		void SetTextureStreamingBudget(VkDeviceSize budget);
 
 		VkSamplerCreateInfo CreateImageSamplerInfo(VkFilter samplerFilter, VkSamplerAddressMode addressMode, VkBool32 enableAnisotropy,
 			float maxAnisotropy, VkCompareOp compareOperation, VkSamplerMipmapMode samplerMipmapMode, float maxLod = 0.0f);
@@ -70,7 +79,8 @@ namespace Quadbit {
 		QbVkBufferHandle CreateIndexBuffer(const eastl::vector<uint32_t>& indices);
 		QbVkPipelineHandle CreatePipeline(const char* vertexPath, const char* vertexEntry, const char* fragmentPath, const char* fragmentEntry,
 			const QbVkPipelineDescription pipelineDescription, const VkRenderPass renderPass = VkRenderPass(-1), const uint32_t maxInstances = 1, 
-			const eastl::vector<eastl::tuple<VkFormat, uint32_t>>& vertexAttributeOverride = {});
+			const eastl::vector<eastl::tuple<VkFormat, uint32_t>>& vertexAttributeOverride = {}, const QbVkShaderDefines& defines = {},
+			const QbVkSpecialization& vertexSpecialization = {}, const QbVkSpecialization& fragmentSpecialization = {});
 
 		void BindResource(const QbVkPipelineHandle pipelineHandle, const eastl::string name,
 			const QbVkBufferHandle bufferHandle, const QbVkDescriptorSetsHandle descriptorsHandle = QBVK_DESCRIPTOR_SETS_NULL_HANDLE);
@@ -82,15 +92,19 @@ namespace Quadbit {
 			const eastl::vector<QbVkTextureHandle> textureHandles, const QbVkDescriptorSetsHandle descriptorsHandle = QBVK_DESCRIPTOR_SETS_NULL_HANDLE);
 
 		PBRSceneComponent LoadPBRModel(const char* path);
+		// Removes the scene component, shared geometry, materials and textures are released with their last user
+		void DestroyPBRModel(const Entity& entity);
 
+		// Set streamed for meshes that are regenerated often, e.g. voxel chunks, they get their own buffers
+		// from buddy pools instead of sharing the geometry arenas
 		template<typename T>
 		CustomMeshComponent CreateMesh(const eastl::vector<T>& vertices, uint32_t vertexStride, 
 			const eastl::vector<uint32_t>& indices, QbVkPipelineHandle pipelineHandle,
-			int pushConstantStride = -1, QbVkDescriptorSetsHandle descriptorSets = QBVK_DESCRIPTOR_SETS_NULL_HANDLE) {
+			int pushConstantStride = -1, QbVkDescriptorSetsHandle descriptorSets = QBVK_DESCRIPTOR_SETS_NULL_HANDLE, bool streamed = false) {
 
 			return CustomMeshComponent{
-				CreateVertexBuffer(vertices.data(), vertexStride, static_cast<uint32_t>(vertices.size())),
-				CreateIndexBuffer(indices),
+				resourceManager_->AllocateVertices(vertices.data(), vertexStride, static_cast<uint32_t>(vertices.size()), streamed),
+				resourceManager_->AllocateIndices(indices, streamed),
 				static_cast<uint32_t>(indices.size()),
 				eastl::array<float, 32>(),
 				pushConstantStride,
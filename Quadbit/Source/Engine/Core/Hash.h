@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Quadbit::Hash {
+	inline constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+	inline constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+	// 64-bit FNV-1a, pass a previous hash as the seed to hash several ranges as one
+	inline uint64_t FNV1a(const void* data, size_t size, uint64_t seed = FNV_OFFSET_BASIS) {
+		const auto* bytes = static_cast<const uint8_t*>(data);
+		uint64_t hash = seed;
+		for (size_t i = 0; i < size; i++) {
+			hash ^= bytes[i];
+			hash *= FNV_PRIME;
+		}
+		return hash;
+	}
+
+	// Only for scalars and structs without padding, padding bytes are not guaranteed to be zeroed
+	template<typename T>
+	inline uint64_t Combine(uint64_t seed, const T& value) {
+		return FNV1a(&value, sizeof(T), seed);
+	}
+}
@@ -1,46 +1,130 @@
 #include "Allocator.h"
 
+#include <cstdio>
+
+#include <EASTL/algorithm.h>
+#include <EASTL/hash_map.h>
 #include <imgui/imgui.h>
 
 #include "Engine/Core/Logging.h"
 #include "Engine/Rendering/VulkanTypes.h"
+#include "Engine/Rendering/VulkanUtils.h"
 
 constexpr int DEFAULT_DEVICE_LOCAL_POOLSIZE = 256 * 1024 * 1024;
 constexpr int DEFAULT_HOST_VISIBLE_POOLSIZE = 128 * 1024 * 1024;
+constexpr VkDeviceSize THREAD_CACHE_CHUNK_SIZE = 2 * 1024 * 1024;
+constexpr VkDeviceSize THREAD_CACHE_CHUNK_ALIGNMENT = 256;
+constexpr VkDeviceSize THREAD_CACHE_MAX_ALLOCATION = 64 * 1024;
 
 namespace Quadbit {
+	namespace {
+		std::atomic<uint64_t> nextAllocatorId = 1;
+
+		// Allocators that thread caches may still return chunks to, guarded by the mutex
+		eastl::hash_map<uint64_t, QbVkAllocator*> liveAllocators;
+		std::mutex liveAllocatorsMutex;
+	}
+
+	struct QbVkAllocator::ThreadCache {
+		uint64_t allocatorId = 0;
+		eastl::array<eastl::array<QbVkAllocationChunk*, VK_MAX_MEMORY_TYPES>, static_cast<size_t>(QbVkAllocationTag::QBVK_ALLOCATION_TAG_COUNT)> chunks{};
+
+		~ThreadCache() {
+			Release();
+		}
+
+		// Drops the references of this thread, unless the allocator has been destroyed along with its chunks
+		void Release() {
+			std::lock_guard<std::mutex> lock(liveAllocatorsMutex);
+			auto it = liveAllocators.find(allocatorId);
+			if (it != liveAllocators.end()) {
+				for (auto&& tagChunks : chunks) {
+					for (auto* chunk : tagChunks) {
+						if (chunk != nullptr) it->second->ReleaseChunk(chunk);
+					}
+				}
+			}
+			allocatorId = 0;
+			chunks = {};
+		}
+	};
+	thread_local QbVkAllocator::ThreadCache QbVkAllocator::threadCache_;
+
 	QbVkAllocator::QbVkAllocator(VkDevice device, VkDeviceSize bufferImageGranularity, VkPhysicalDeviceMemoryProperties memoryProperties) :
 		device_(device),
 		bufferImageGranularity_(bufferImageGranularity),
 		memoryProperties_(memoryProperties),
-		garbageIndex_(0) {}
+		backend_(eastl::make_unique<QbVkDeviceMemoryBackend>(device)),
+		id_(nextAllocatorId++),
+		ownerThread_(std::this_thread::get_id()) {
 
-	void QbVkAllocator::CreateStagingBuffer(QbVkBuffer& buffer, VkDeviceSize size, const void* data) {
-		VkBufferCreateInfo bufferInfo{};
-		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferInfo.size = size;
-		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		std::lock_guard<std::mutex> lock(liveAllocatorsMutex);
+		liveAllocators[id_] = this;
+	}
 
-		CreateBuffer(buffer, bufferInfo, QbVkMemoryUsage::QBVK_MEMORY_USAGE_CPU_ONLY);
+	QbVkAllocator::QbVkAllocator(eastl::unique_ptr<QbVkMemoryBackend> backend, VkDeviceSize bufferImageGranularity,
+		VkPhysicalDeviceMemoryProperties memoryProperties) :
+		device_(VK_NULL_HANDLE),
+		bufferImageGranularity_(bufferImageGranularity),
+		memoryProperties_(memoryProperties),
+		backend_(eastl::move(backend)),
+		id_(nextAllocatorId++),
+		ownerThread_(std::this_thread::get_id()) {
+
+		std::lock_guard<std::mutex> lock(liveAllocatorsMutex);
+		liveAllocators[id_] = this;
+	}
+
+	QbVkAllocator::~QbVkAllocator() {
+		EndTrace();
+
+		{
+			// Threads that exit from here on leave their chunks alone
+			std::lock_guard<std::mutex> lock(liveAllocatorsMutex);
+			liveAllocators.erase(id_);
+		}
 
-		// Copy the data to the mapped buffer
-		memcpy(buffer.alloc.data, data, static_cast<size_t>(size));
+		// Chunks only referenced by their thread cache can go back to the pools,
+		// the rest still have live allocations which are reported below
+		for (auto&& chunk : chunks_) {
+			if (chunk->references == 1) FreeToPool(chunk->block);
+		}
+		chunks_.clear();
+
+		// Whatever remains in the pools was never destroyed
+		uint32_t leaks = 0;
+		for (auto&& pools : poolsByType_) {
+			for (auto&& pool : pools) {
+				leaks += pool->ReportLeaks();
+			}
+		}
+		if (leaks > 0) {
+			QB_LOG_WARN("QbVkAllocator: %u allocation(s) were not freed before shutdown\n", leaks);
+		}
 	}
 
-	void QbVkAllocator::CreateBuffer(QbVkBuffer& buffer, VkBufferCreateInfo& bufferInfo, QbVkMemoryUsage memoryUsage) {
+	void QbVkAllocator::CreateStagingBuffer(QbVkBuffer& buffer, VkDeviceSize size, const void* data, const char* name) {
+		auto bufferInfo = VkUtils::Init::BufferCreateInfo(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+		CreateBuffer(buffer, bufferInfo, QbVkMemoryUsage::QBVK_MEMORY_USAGE_CPU_ONLY, name, QbVkAllocationTag::QBVK_ALLOCATION_TAG_STAGING);
+
+		// Copy the data to the mapped buffer, a null pointer leaves it for the caller to fill
+		if (data != nullptr) memcpy(buffer.alloc.data, data, static_cast<size_t>(size));
+	}
+
+	void QbVkAllocator::CreateBuffer(QbVkBuffer& buffer, VkBufferCreateInfo& bufferInfo, QbVkMemoryUsage memoryUsage, const char* name,
+		QbVkAllocationTag tag) {
 		VK_CHECK(vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer.buf));
 
 		// This part finds the required memory properties for the buffer allocation
 		VkMemoryRequirements memoryRequirements;
 		vkGetBufferMemoryRequirements(device_, buffer.buf, &memoryRequirements);
 
-		buffer.alloc = Allocate(memoryRequirements.size, memoryRequirements.alignment,
-			memoryRequirements.memoryTypeBits, memoryUsage, QbVkAllocationType::QBVK_ALLOCATION_TYPE_BUFFER);
+		buffer.alloc = AllocateMemory(memoryRequirements, memoryUsage, QbVkAllocationType::QBVK_ALLOCATION_TYPE_BUFFER, tag, name);
 
 		VK_CHECK(vkBindBufferMemory(device_, buffer.buf, buffer.alloc.deviceMemory, buffer.alloc.offset));
 	}
 
-	void QbVkAllocator::CreateImage(QbVkImage& image, VkImageCreateInfo& imageInfo, QbVkMemoryUsage memoryUsage) {
+	void QbVkAllocator::CreateImage(QbVkImage& image, VkImageCreateInfo& imageInfo, QbVkMemoryUsage memoryUsage, const char* name) {
 		VK_CHECK(vkCreateImage(device_, &imageInfo, nullptr, &image.imgHandle));
 
 		// This part finds the required memory properties for the image allocation
@@ -50,45 +134,129 @@ namespace Quadbit {
 		// Allocation type is determined by the tiling information
 		auto allocType = (imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL) ? QbVkAllocationType::QBVK_ALLOCATION_TYPE_IMAGE_OPTIMAL : QbVkAllocationType::QBVK_ALLOCATION_TYPE_IMAGE_LINEAR;
 
-		image.alloc = Allocate(memoryRequirements.size, memoryRequirements.alignment,
-			memoryRequirements.memoryTypeBits, memoryUsage, allocType);
+		image.alloc = AllocateMemory(memoryRequirements, memoryUsage, allocType, QbVkAllocationTag::QBVK_ALLOCATION_TAG_TEXTURE, name);
 
 		VK_CHECK(vkBindImageMemory(device_, image.imgHandle, image.alloc.deviceMemory, image.alloc.offset));
 	}
 
 	void QbVkAllocator::DestroyBuffer(QbVkBuffer& buffer) {
 		if (buffer.buf != VK_NULL_HANDLE) vkDestroyBuffer(device_, buffer.buf, nullptr);
-		if (buffer.alloc.deviceMemory != VK_NULL_HANDLE) Free(buffer.alloc);
+		if (buffer.alloc.deviceMemory != VK_NULL_HANDLE) FreeMemory(buffer.alloc);
 
 		buffer = QbVkBuffer{};
 	}
 
 	void QbVkAllocator::DestroyImage(QbVkImage& image) {
 		if (image.imgHandle != VK_NULL_HANDLE) vkDestroyImage(device_, image.imgHandle, nullptr);
-		if (image.alloc.deviceMemory != VK_NULL_HANDLE) Free(image.alloc);
+		if (image.alloc.deviceMemory != VK_NULL_HANDLE) FreeMemory(image.alloc);
+
+		image = QbVkImage{};
+	}
+
+	void QbVkAllocator::SetPoolType(QbVkAllocationTag tag, QbVkPoolType poolType) {
+		poolTypes_[static_cast<size_t>(tag)] = poolType;
+	}
+
+	QbVkAllocatorStats QbVkAllocator::GetStats() const {
+		std::lock_guard<std::mutex> lock(statsMutex_);
+		return stats_;
+	}
+
+	eastl::vector<QbVkPoolStats> QbVkAllocator::GetPoolStats() const {
+		eastl::vector<QbVkPoolStats> poolStats;
+		for (auto i = 0; i < poolsByType_.size(); i++) {
+			std::lock_guard<std::mutex> lock(poolMutexes_[i]);
+			for (auto&& pool : poolsByType_[i]) {
+				poolStats.push_back(pool->GetStats());
+			}
+		}
+		return poolStats;
 	}
 
-	void QbVkAllocator::EmptyGarbage() {
-		auto& garbage = garbage_[garbageIndex_];
+	bool QbVkAllocator::DumpJSON(const char* path) const {
+		FILE* file = fopen(path, "w");
+		if (file == nullptr) {
+			QB_LOG_WARN("QbVkAllocator: Failed to open %s for writing\n", path);
+			return false;
+		}
 
-		for (auto&& allocation : garbage) {
-			allocation.pool->Free(allocation);
+		const auto stats = GetStats();
+		fprintf(file, "{\n\"tags\": {");
+		for (auto i = 0; i < static_cast<int>(QbVkAllocationTag::QBVK_ALLOCATION_TAG_COUNT); i++) {
+			fprintf(file, "%s\n\t\"%s\": {\"count\": %u, \"size\": %llu}", i == 0 ? "" : ",",
+				AllocationTagToString(static_cast<QbVkAllocationTag>(i)), stats.liveCount[i], stats.liveSize[i]);
+		}
+		fprintf(file, "\n},\n\"totalAllocations\": %llu,\n\"totalFrees\": %llu,\n\"pools\": [",
+			stats.totalAllocations, stats.totalFrees);
 
-			if (allocation.pool->allocatedSize_ == 0) {
-				poolsByType_[allocation.pool->memoryTypeIndex_].remove_if(
-					[&](const auto& p) { return p.get() == allocation.pool; });
+		bool first = true;
+		for (auto i = 0; i < poolsByType_.size(); i++) {
+			std::lock_guard<std::mutex> lock(poolMutexes_[i]);
+			for (auto&& pool : poolsByType_[i]) {
+				fprintf(file, "%s\n\t", first ? "" : ",");
+				pool->DumpJSON(file);
+				first = false;
 			}
 		}
-		garbage.clear();
-		garbageIndex_ = (garbageIndex_ + 1) % MAX_FRAMES_IN_FLIGHT;
+		fprintf(file, "\n]\n}\n");
+		fclose(file);
+
+		QB_LOG_INFO("QbVkAllocator: Wrote memory dump to %s\n", path);
+		return true;
+	}
+
+	bool QbVkAllocator::BeginTrace(const char* path) {
+		EndTrace();
+
+		FILE* file = fopen(path, "w");
+		if (file == nullptr) {
+			QB_LOG_WARN("QbVkAllocator: Failed to open %s for writing\n", path);
+			return false;
+		}
+		// a <tag> <type> <usage> <size> <alignment> <id>, f <id>. The id is the pool and offset of the allocation
+		fprintf(file, "# Quadbit allocator trace\n");
+
+		std::lock_guard<std::mutex> lock(statsMutex_);
+		trace_ = file;
+		QB_LOG_INFO("QbVkAllocator: Recording allocation trace to %s\n", path);
+		return true;
+	}
+
+	void QbVkAllocator::EndTrace() {
+		std::lock_guard<std::mutex> lock(statsMutex_);
+		if (trace_ == nullptr) return;
+		fclose(trace_);
+		trace_ = nullptr;
 	}
 
 	void QbVkAllocator::ImGuiDrawState() {
 		ImGui::SetNextWindowSize(ImVec2(500, 200), ImGuiCond_FirstUseEver);
 		ImGui::Begin("Quadbit Vulkan Allocator", nullptr);
 
+		const auto stats = GetStats();
+		for (auto i = 0; i < static_cast<int>(QbVkAllocationTag::QBVK_ALLOCATION_TAG_COUNT); i++) {
+			if (stats.liveCount[i] == 0) continue;
+			ImGui::Text("%s: %u allocations, %.2f MB", AllocationTagToString(static_cast<QbVkAllocationTag>(i)),
+				stats.liveCount[i], stats.liveSize[i] / 1024.0f / 1024.0f);
+		}
+		ImGui::Text("Total allocations: %llu, frees: %llu, failed: %u", stats.totalAllocations, stats.totalFrees, stats.failedAllocations);
+		if (ImGui::Button("Dump JSON")) {
+			DumpJSON("quadbit_memory.json");
+		}
+		ImGui::SameLine();
+		bool tracing;
+		{
+			std::lock_guard<std::mutex> lock(statsMutex_);
+			tracing = trace_ != nullptr;
+		}
+		if (ImGui::Button(tracing ? "Stop trace" : "Record trace")) {
+			if (tracing) EndTrace();
+			else BeginTrace("quadbit_allocations.trace");
+		}
+
 		char memoryTypeTitle[16];
 		for (auto i = 0; i < poolsByType_.size(); i++) {
+			std::lock_guard<std::mutex> lock(poolMutexes_[i]);
 			if (poolsByType_[i].empty()) continue;
 			sprintf(memoryTypeTitle, "Memory Type %i", i);
 			if (ImGui::CollapsingHeader(memoryTypeTitle)) {
@@ -150,37 +318,175 @@ namespace Quadbit {
 		return memoryType;
 	}
 
-	QbVkAllocation QbVkAllocator::Allocate(const VkDeviceSize size, const VkDeviceSize alignment,
-		const uint32_t memoryTypeBits, const QbVkMemoryUsage memoryUsage, QbVkAllocationType allocType) {
+	QbVkAllocation QbVkAllocator::AllocateMemory(const VkMemoryRequirements& memoryRequirements, QbVkMemoryUsage memoryUsage,
+		QbVkAllocationType allocType, QbVkAllocationTag tag, const char* name) {
 
 		QbVkAllocation allocation{};
 
-		auto memoryTypeIndex = FindMemoryTypeIndex(memoryTypeBits, memoryUsage);
+		auto memoryTypeIndex = FindMemoryTypeIndex(memoryRequirements.memoryTypeBits, memoryUsage);
 		if (memoryTypeIndex == -1) {
 			QB_LOG_WARN("Couldn't find appropriate memory type for allocation request\n");
+			std::lock_guard<std::mutex> lock(statsMutex_);
+			stats_.failedAllocations++;
 			return QbVkAllocation{};
 		}
 
+		// Small buffers from worker threads are carved out of a chunk owned by the thread, so producers
+		// don't contend on the pool locks for every allocation. Anything else goes directly to the pools,
+		// as do tags placed in another pool type, since a chunk only returns its memory once all of it is freed
+		bool allocated = false;
+		if (allocType == QbVkAllocationType::QBVK_ALLOCATION_TYPE_BUFFER && memoryRequirements.size <= THREAD_CACHE_MAX_ALLOCATION &&
+			poolTypes_[static_cast<size_t>(tag)] == QbVkPoolType::QBVK_POOL_TYPE_FIRST_FIT && std::this_thread::get_id() != ownerThread_) {
+			allocated = AllocateFromThreadCache(memoryRequirements, memoryTypeIndex, memoryUsage, tag, allocation);
+		}
+		if (!allocated) {
+			allocated = AllocateFromPools(memoryRequirements.size, memoryRequirements.alignment, memoryTypeIndex,
+				memoryUsage, allocType, tag, name, allocation);
+		}
+
+		std::lock_guard<std::mutex> lock(statsMutex_);
+		if (!allocated) {
+			stats_.failedAllocations++;
+			return QbVkAllocation{};
+		}
+		allocation.tag = tag;
+		stats_.liveCount[static_cast<size_t>(tag)]++;
+		stats_.liveSize[static_cast<size_t>(tag)] += allocation.size;
+		stats_.totalAllocations++;
+		if (trace_ != nullptr) {
+			fprintf(trace_, "a %d %d %d %llu %llu %p:%llx\n", static_cast<int>(tag), static_cast<int>(allocType), static_cast<int>(memoryUsage),
+				memoryRequirements.size, memoryRequirements.alignment, static_cast<void*>(allocation.pool), allocation.offset);
+		}
+		return allocation;
+	}
+
+	void QbVkAllocator::FreeMemory(QbVkAllocation& allocation) {
+		{
+			std::lock_guard<std::mutex> lock(statsMutex_);
+			const auto tag = static_cast<size_t>(allocation.tag);
+			stats_.liveCount[tag]--;
+			stats_.liveSize[tag] -= allocation.size;
+			stats_.totalFrees++;
+			if (trace_ != nullptr) {
+				fprintf(trace_, "f %p:%llx\n", static_cast<void*>(allocation.pool), allocation.offset);
+			}
+		}
+
+		if (allocation.chunk != nullptr) {
+			ReleaseChunk(allocation.chunk);
+		}
+		else {
+			FreeToPool(allocation);
+		}
+		allocation = QbVkAllocation{};
+	}
+
+	bool QbVkAllocator::AllocateFromPools(VkDeviceSize size, VkDeviceSize alignment, int32_t memoryTypeIndex, QbVkMemoryUsage memoryUsage,
+		QbVkAllocationType allocType, QbVkAllocationTag tag, const char* name, QbVkAllocation& allocation) {
+
+		std::lock_guard<std::mutex> lock(poolMutexes_[memoryTypeIndex]);
+
+		const auto poolType = poolTypes_[static_cast<size_t>(tag)];
+
 		// Now try to allocate from any pool with the right memory type index
 		auto& pools = poolsByType_[memoryTypeIndex];
 		for (auto&& pool : pools) {
-			if (pool->Allocate(size, alignment, bufferImageGranularity_, allocType, allocation)) {
-				return allocation;
+			if (pool->poolType_ != poolType) continue;
+			if (pool->Allocate(size, alignment, bufferImageGranularity_, allocType, tag, name, allocation)) {
+				return true;
 			}
 		}
 
 		// Otherwise we'll just create a new pool
 		// 256MB for device local, 64MB for host-visible
 		VkDeviceSize poolSize = (memoryUsage == QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY) ? DEFAULT_DEVICE_LOCAL_POOLSIZE : DEFAULT_HOST_VISIBLE_POOLSIZE;
-		pools.push_front(eastl::make_unique<QbVkPool>(device_, memoryTypeIndex, poolSize, memoryUsage));
-		if (!pools.front()->Allocate(size, alignment, bufferImageGranularity_, allocType, allocation)) {
+		if (poolType == QbVkPoolType::QBVK_POOL_TYPE_BUDDY) {
+			pools.push_front(eastl::make_unique<QbVkBuddyPool>(*backend_, memoryTypeIndex, poolSize, memoryUsage));
+		}
+		else {
+			pools.push_front(eastl::make_unique<QbVkPool>(*backend_, memoryTypeIndex, poolSize, memoryUsage));
+		}
+		if (pools.front()->deviceMemory_ == VK_NULL_HANDLE) {
+			QB_LOG_WARN("Failed to allocate new memory pool of %llu bytes\n", poolSize);
+			pools.pop_front();
+			return false;
+		}
+		if (!pools.front()->Allocate(size, alignment, bufferImageGranularity_, allocType, tag, name, allocation)) {
 			QB_LOG_WARN("Failed to allocate new memory block\n");
+			return false;
 		}
+		return true;
+	}
 
-		return allocation;
+	void QbVkAllocator::FreeToPool(QbVkAllocation& allocation) {
+		std::lock_guard<std::mutex> lock(poolMutexes_[allocation.pool->memoryTypeIndex_]);
+
+		allocation.pool->Free(allocation);
+
+		if (allocation.pool->allocatedSize_ == 0) {
+			poolsByType_[allocation.pool->memoryTypeIndex_].remove_if(
+				[&](const auto& p) { return p.get() == allocation.pool; });
+		}
+	}
+
+	bool QbVkAllocator::AllocateFromThreadCache(const VkMemoryRequirements& memoryRequirements, int32_t memoryTypeIndex,
+		QbVkMemoryUsage memoryUsage, QbVkAllocationTag tag, QbVkAllocation& allocation) {
+
+		// The cache may still hold chunks of another allocator
+		if (threadCache_.allocatorId != id_) {
+			threadCache_.Release();
+			threadCache_.allocatorId = id_;
+		}
+
+		auto*& chunk = threadCache_.chunks[static_cast<size_t>(tag)][memoryTypeIndex];
+		for (auto attempt = 0; attempt < 2; attempt++) {
+			if (chunk == nullptr) {
+				chunk = CreateChunk(memoryTypeIndex, memoryUsage, tag);
+				if (chunk == nullptr) return false;
+			}
+
+			// The pool the chunk came from may have been created unmapped by a GPU only request
+			if (memoryUsage != QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY && chunk->block.data == nullptr) return false;
+
+			const auto offset = VkUtils::AlignUp(chunk->block.offset + chunk->head, memoryRequirements.alignment);
+			if (offset + memoryRequirements.size <= chunk->block.offset + chunk->block.size) {
+				chunk->head = offset + memoryRequirements.size - chunk->block.offset;
+				chunk->references++;
+
+				allocation = chunk->block;
+				allocation.offset = offset;
+				allocation.size = memoryRequirements.size;
+				allocation.data = (chunk->block.data != nullptr) ? chunk->block.data + (offset - chunk->block.offset) : nullptr;
+				allocation.chunk = chunk;
+				return true;
+			}
+
+			// The chunk is exhausted, drop the reference of this thread so the chunk
+			// is returned once its remaining allocations are freed
+			ReleaseChunk(chunk);
+			chunk = nullptr;
+		}
+		return false;
 	}
 
-	void QbVkAllocator::Free(QbVkAllocation& allocation) {
-		garbage_[garbageIndex_].push_back(allocation);
+	QbVkAllocationChunk* QbVkAllocator::CreateChunk(int32_t memoryTypeIndex, QbVkMemoryUsage memoryUsage, QbVkAllocationTag tag) {
+		auto chunk = eastl::make_unique<QbVkAllocationChunk>();
+		if (!AllocateFromPools(THREAD_CACHE_CHUNK_SIZE, THREAD_CACHE_CHUNK_ALIGNMENT, memoryTypeIndex, memoryUsage,
+			QbVkAllocationType::QBVK_ALLOCATION_TYPE_BUFFER, tag, "Thread cache chunk", chunk->block)) {
+			return nullptr;
+		}
+
+		std::lock_guard<std::mutex> lock(chunkMutex_);
+		chunks_.push_back(eastl::move(chunk));
+		return chunks_.back().get();
+	}
+
+	void QbVkAllocator::ReleaseChunk(QbVkAllocationChunk* chunk) {
+		if (--chunk->references > 0) return;
+
+		FreeToPool(chunk->block);
+
+		std::lock_guard<std::mutex> lock(chunkMutex_);
+		chunks_.erase(eastl::remove_if(chunks_.begin(), chunks_.end(), [&](const auto& c) { return c.get() == chunk; }), chunks_.end());
 	}
-}
\ No newline at end of file
+}
@@ -1,23 +1,74 @@
 #pragma once
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
 #include <EASTL/array.h>
 #include <EASTL/slist.h>
 #include <EASTL/unique_ptr.h>
 
 #include "Engine/Rendering/VulkanTypes.h"
+#include "Engine/Rendering/Memory/BuddyPool.h"
+#include "Engine/Rendering/Memory/MemoryBackend.h"
 #include "Engine/Rendering/Memory/Pool.h"
 
 namespace Quadbit {
+	struct QbVkAllocatorStats {
+		// Live allocations per tag
+		eastl::array<uint32_t, static_cast<size_t>(QbVkAllocationTag::QBVK_ALLOCATION_TAG_COUNT)> liveCount{};
+		eastl::array<VkDeviceSize, static_cast<size_t>(QbVkAllocationTag::QBVK_ALLOCATION_TAG_COUNT)> liveSize{};
+		uint64_t totalAllocations = 0;
+		uint64_t totalFrees = 0;
+		uint32_t failedAllocations = 0;
+	};
+
+	// A block of pool memory that a single worker thread bump allocates small buffers from without locking.
+	// The owning thread holds one reference while the chunk is current and every allocation holds another,
+	// whoever drops the last reference returns the chunk to its pool
+	struct QbVkAllocationChunk {
+		QbVkAllocation block{};
+		VkDeviceSize head = 0;
+		std::atomic<uint32_t> references = 1;
+	};
+
+	// All functions may be called from any thread. Pools are locked per memory type, and small buffers
+	// requested from threads other than the one that created the allocator go through per-thread chunks.
+	// A thread's chunks are kept per tag, and handed back when the thread exits
 	class QbVkAllocator {
 	public:
 		QbVkAllocator(VkDevice device, VkDeviceSize bufferImageGranularity, VkPhysicalDeviceMemoryProperties memoryProperties);
+		// Without a device only AllocateMemory/FreeMemory may be used, e.g. together with a QbVkHostMemoryBackend
+		QbVkAllocator(eastl::unique_ptr<QbVkMemoryBackend> backend, VkDeviceSize bufferImageGranularity, VkPhysicalDeviceMemoryProperties memoryProperties);
+		~QbVkAllocator();
 
-		void CreateStagingBuffer(QbVkBuffer& buffer, VkDeviceSize size, const void* data);
-		void CreateBuffer(QbVkBuffer& buffer, VkBufferCreateInfo& bufferInfo, QbVkMemoryUsage memoryUsage);
-		void CreateImage(QbVkImage& image, VkImageCreateInfo& imageInfo, QbVkMemoryUsage memoryUsage);
+		// The optional name is only used for statistics, leak reports and memory dumps
+		void CreateStagingBuffer(QbVkBuffer& buffer, VkDeviceSize size, const void* data, const char* name = nullptr);
+		void CreateBuffer(QbVkBuffer& buffer, VkBufferCreateInfo& bufferInfo, QbVkMemoryUsage memoryUsage, const char* name = nullptr,
+			QbVkAllocationTag tag = QbVkAllocationTag::QBVK_ALLOCATION_TAG_BUFFER);
+		void CreateImage(QbVkImage& image, VkImageCreateInfo& imageInfo, QbVkMemoryUsage memoryUsage, const char* name = nullptr);
 
 		void DestroyBuffer(QbVkBuffer& buffer);
 		void DestroyImage(QbVkImage& image);
-		void EmptyGarbage();
+
+		// Raw sub-allocations, the buffer and image functions above are built on these
+		QbVkAllocation AllocateMemory(const VkMemoryRequirements& memoryRequirements, QbVkMemoryUsage memoryUsage,
+			QbVkAllocationType allocType, QbVkAllocationTag tag, const char* name = nullptr);
+		// Frees immediately, memory the GPU may still use must go through the QbVkDeletionQueue
+		void FreeMemory(QbVkAllocation& allocation);
+
+		// Selects the kind of pool allocations of the given class are placed in, pools are never shared between types.
+		// Should be set before anything of that class is allocated
+		void SetPoolType(QbVkAllocationTag tag, QbVkPoolType poolType);
+
+		QbVkAllocatorStats GetStats() const;
+		eastl::vector<QbVkPoolStats> GetPoolStats() const;
+		// Writes the block map of every pool to a JSON file
+		bool DumpJSON(const char* path) const;
+		// Records every AllocateMemory/FreeMemory call to a text file until EndTrace,
+		// the trace can be replayed against the pool types with the AllocatorBenchmark tool
+		bool BeginTrace(const char* path);
+		void EndTrace();
 
 		void ImGuiDrawState();
 
@@ -26,16 +77,38 @@ namespace Quadbit {
 		VkDeviceSize bufferImageGranularity_;
 		VkPhysicalDeviceMemoryProperties memoryProperties_;
 
+		// Declared before the pools so it outlives them
+		eastl::unique_ptr<QbVkMemoryBackend> backend_;
+
 		eastl::array<eastl::slist<eastl::unique_ptr<QbVkPool>>, VK_MAX_MEMORY_TYPES> poolsByType_;
+		eastl::array<QbVkPoolType, static_cast<size_t>(QbVkAllocationTag::QBVK_ALLOCATION_TAG_COUNT)> poolTypes_{};
+		mutable eastl::array<std::mutex, VK_MAX_MEMORY_TYPES> poolMutexes_;
 
-		uint32_t garbageIndex_;
-		eastl::array<eastl::vector<QbVkAllocation>, MAX_FRAMES_IN_FLIGHT> garbage_;
+		QbVkAllocatorStats stats_{};
+		mutable std::mutex statsMutex_;
+		// Guarded by the stats mutex
+		FILE* trace_ = nullptr;
+
+		// Identifies the allocator in the thread local caches, in case a new one is created at the same address
+		uint64_t id_;
+		std::thread::id ownerThread_;
+		eastl::vector<eastl::unique_ptr<QbVkAllocationChunk>> chunks_;
+		std::mutex chunkMutex_;
+
+		// The chunks the calling thread allocates from, defined in Allocator.cpp
+		struct ThreadCache;
+		static thread_local ThreadCache threadCache_;
 
 		int32_t FindMemoryProperties(uint32_t memoryTypeBitsRequirement, VkMemoryPropertyFlags requiredProperties);
 		int32_t FindMemoryTypeIndex(const uint32_t memoryTypeBitsRequirement, QbVkMemoryUsage memoryUsage);
 
-		QbVkAllocation Allocate(const VkDeviceSize size, const VkDeviceSize alignment, const uint32_t memoryTypeBits,
-			const QbVkMemoryUsage memoryUsage, QbVkAllocationType allocType);
-		void Free(QbVkAllocation& allocation);
+		bool AllocateFromPools(VkDeviceSize size, VkDeviceSize alignment, int32_t memoryTypeIndex, QbVkMemoryUsage memoryUsage,
+			QbVkAllocationType allocType, QbVkAllocationTag tag, const char* name, QbVkAllocation& allocation);
+		void FreeToPool(QbVkAllocation& allocation);
+
+		bool AllocateFromThreadCache(const VkMemoryRequirements& memoryRequirements, int32_t memoryTypeIndex,
+			QbVkMemoryUsage memoryUsage, QbVkAllocationTag tag, QbVkAllocation& allocation);
+		QbVkAllocationChunk* CreateChunk(int32_t memoryTypeIndex, QbVkMemoryUsage memoryUsage, QbVkAllocationTag tag);
+		void ReleaseChunk(QbVkAllocationChunk* chunk);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,141 @@
+#include "BuddyPool.h"
+
+#include <EASTL/algorithm.h>
+
+#include "Engine/Core/Logging.h"
+
+namespace Quadbit {
+	QbVkBuddyPool::QbVkBuddyPool(QbVkMemoryBackend& backend, const int32_t memoryTypeIndex, const VkDeviceSize size, QbVkMemoryUsage usage) :
+		QbVkPool(backend, memoryTypeIndex, size, usage) {
+		QB_ASSERT(size >= BUDDY_MIN_BLOCK_SIZE && (size & (size - 1)) == 0 && "Buddy pool capacity must be a power of two!");
+		poolType_ = QbVkPoolType::QBVK_POOL_TYPE_BUDDY;
+
+		while (BlockSize(levelCount_) >= BUDDY_MIN_BLOCK_SIZE) levelCount_++;
+		freeLists_.resize(levelCount_);
+		freeLists_[0].insert(0);
+	}
+
+	bool QbVkBuddyPool::Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize granularity, QbVkAllocationType allocationType,
+		QbVkAllocationTag tag, const char* name, QbVkAllocation& allocation) {
+		if (deviceMemory_ == VK_NULL_HANDLE) return false;
+
+		// Blocks are aligned to their own size, so the alignment is met by making the block at least that large.
+		// Optimal images take up whole pages so they can never share a page with a linear resource
+		auto requiredSize = eastl::max(eastl::max(size, alignment), BUDDY_MIN_BLOCK_SIZE);
+		if (allocationType == QbVkAllocationType::QBVK_ALLOCATION_TYPE_IMAGE_OPTIMAL) {
+			requiredSize = eastl::max(requiredSize, granularity);
+		}
+		if (requiredSize > capacity_) return false;
+
+		// Find the deepest level whose blocks still fit the request
+		uint32_t level = 0;
+		while (level + 1 < levelCount_ && BlockSize(level + 1) >= requiredSize) level++;
+
+		// Then walk up until a level with a free block is found
+		int32_t freeLevel = static_cast<int32_t>(level);
+		while (freeLevel >= 0 && freeLists_[freeLevel].empty()) freeLevel--;
+		if (freeLevel < 0) return false;
+
+		auto it = freeLists_[freeLevel].begin();
+		const VkDeviceSize offset = *it;
+		freeLists_[freeLevel].erase(it);
+
+		// Split the block down to the requested level, the upper halves become free buddies
+		for (auto l = static_cast<uint32_t>(freeLevel) + 1; l <= level; l++) {
+			freeLists_[l].insert(offset + BlockSize(l));
+		}
+
+		const uint32_t id = nextBlockId_++;
+		allocatedBlocks_[offset] = { id, level, size, allocationType, tag, (name != nullptr) ? name : "" };
+		allocatedSize_ += BlockSize(level);
+
+		allocation.size = size;
+		allocation.tag = tag;
+		allocation.id = id;
+		allocation.deviceMemory = deviceMemory_;
+		if (memoryUsage_ != QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY) {
+			allocation.data = data_ + offset;
+		}
+		allocation.offset = offset;
+		allocation.pool = this;
+
+		return true;
+	}
+
+	void QbVkBuddyPool::Free(QbVkAllocation& allocation) {
+		auto it = allocatedBlocks_.find(allocation.offset);
+		if (it == allocatedBlocks_.end() || it->second.id != allocation.id) {
+			QB_LOG_WARN("QbVkAllocator: Trying to free an unknown allocation (%i) in buddy pool %p\n", allocation.id, allocation.pool);
+			return;
+		}
+
+		auto level = it->second.level;
+		auto offset = allocation.offset;
+		allocatedBlocks_.erase(it);
+		allocatedSize_ -= BlockSize(level);
+
+		// Keep merging with the buddy for as long as it is free
+		while (level > 0) {
+			const auto buddy = offset ^ BlockSize(level);
+			auto buddyIt = freeLists_[level].find(buddy);
+			if (buddyIt == freeLists_[level].end()) break;
+
+			freeLists_[level].erase(buddyIt);
+			offset = eastl::min(offset, buddy);
+			level--;
+		}
+		freeLists_[level].insert(offset);
+	}
+
+	QbVkPoolStats QbVkBuddyPool::GetStats() const {
+		QbVkPoolStats stats{};
+		stats.capacity = capacity_;
+		stats.allocated = allocatedSize_;
+		stats.freeSize = capacity_ - allocatedSize_;
+		stats.usedBlocks = static_cast<uint32_t>(allocatedBlocks_.size());
+
+		for (uint32_t level = 0; level < levelCount_; level++) {
+			if (freeLists_[level].empty()) continue;
+			stats.freeBlocks += static_cast<uint32_t>(freeLists_[level].size());
+			stats.largestFreeBlock = eastl::max(stats.largestFreeBlock, BlockSize(level));
+		}
+
+		if (stats.freeSize > 0) {
+			stats.fragmentation = 1.0f - static_cast<float>(stats.largestFreeBlock) / static_cast<float>(stats.freeSize);
+		}
+		return stats;
+	}
+
+	uint32_t QbVkBuddyPool::ReportLeaks() const {
+		for (const auto& [offset, block] : allocatedBlocks_) {
+			QB_LOG_WARN("QbVkAllocator: Leaked %s allocation \"%s\" of %llu bytes at offset %llu in memory type %i\n",
+				AllocationTagToString(block.tag), block.name.c_str(), block.requestedSize, offset, memoryTypeIndex_);
+		}
+		return static_cast<uint32_t>(allocatedBlocks_.size());
+	}
+
+	void QbVkBuddyPool::DumpJSON(FILE* file) const {
+		const auto stats = GetStats();
+		fprintf(file, "{\"memoryType\": %i, \"type\": \"buddy\", \"capacity\": %llu, \"allocated\": %llu, \"largestFreeBlock\": %llu, \"fragmentation\": %.4f, \"blocks\": [",
+			memoryTypeIndex_, capacity_, allocatedSize_, stats.largestFreeBlock, stats.fragmentation);
+
+		bool first = true;
+		for (uint32_t level = 0; level < levelCount_; level++) {
+			for (const auto offset : freeLists_[level]) {
+				fprintf(file, "%s\n\t\t{\"offset\": %llu, \"size\": %llu, \"free\": true}", first ? "" : ",", offset, BlockSize(level));
+				first = false;
+			}
+		}
+		for (const auto& [offset, block] : allocatedBlocks_) {
+			fprintf(file, "%s\n\t\t{\"id\": %u, \"offset\": %llu, \"size\": %llu, \"requestedSize\": %llu, \"free\": false, \"tag\": \"%s\", \"name\": \"",
+				first ? "" : ",", block.id, offset, BlockSize(block.level), block.requestedSize, AllocationTagToString(block.tag));
+			for (const char c : block.name) {
+				if (c == '"' || c == '\\') fputc('\\', file);
+				if (static_cast<unsigned char>(c) >= 0x20) fputc(c, file);
+			}
+			fprintf(file, "\"}");
+			first = false;
+		}
+		fprintf(file, "\n\t]}");
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <EASTL/hash_map.h>
+#include <EASTL/hash_set.h>
+#include <EASTL/vector.h>
+
+#include "Engine/Rendering/Memory/Pool.h"
+
+constexpr VkDeviceSize BUDDY_MIN_BLOCK_SIZE = 4096;
+
+namespace Quadbit {
+	// Buddy system pool, every allocation is rounded up to a power of two block that is split off
+	// a larger free block and merged back with its buddy when freed. Allocation and free are O(log n)
+	// and freed memory never leaves odd sized holes, at the cost of internal fragmentation.
+	// The capacity must be a power of two
+	struct QbVkBuddyPool : public QbVkPool {
+		struct BuddyBlock {
+			uint32_t id = 0;
+			uint32_t level = 0;
+			VkDeviceSize requestedSize = 0;
+			QbVkAllocationType allocationType = QbVkAllocationType::QBVK_ALLOCATION_TYPE_UNKNOWN;
+			QbVkAllocationTag tag = QbVkAllocationTag::QBVK_ALLOCATION_TAG_UNKNOWN;
+			eastl::string name;
+		};
+
+		// Level 0 is the whole pool, each following level halves the block size
+		uint32_t levelCount_ = 0;
+		eastl::vector<eastl::hash_set<VkDeviceSize>> freeLists_;
+		eastl::hash_map<VkDeviceSize, BuddyBlock> allocatedBlocks_;
+
+		QbVkBuddyPool(QbVkMemoryBackend& backend, const int32_t memoryTypeIndex, const VkDeviceSize size, QbVkMemoryUsage usage);
+
+		bool Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize granularity, QbVkAllocationType allocationType,
+			QbVkAllocationTag tag, const char* name, QbVkAllocation& allocation) override;
+		void Free(QbVkAllocation& allocation) override;
+
+		QbVkPoolStats GetStats() const override;
+		uint32_t ReportLeaks() const override;
+		void DumpJSON(FILE* file) const override;
+
+	private:
+		VkDeviceSize BlockSize(uint32_t level) const { return capacity_ >> level; }
+	};
+}
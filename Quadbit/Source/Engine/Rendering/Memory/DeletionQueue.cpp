@@ -0,0 +1,90 @@
+#include "DeletionQueue.h"
+
+#include <EASTL/algorithm.h>
+
+#include "Engine/Rendering/Memory/Allocator.h"
+
+namespace Quadbit {
+	QbVkDeletionQueue::QbVkDeletionQueue(QbVkContext& context) : context_(context) {}
+
+	QbVkDeletionQueue::~QbVkDeletionQueue() {
+		QB_ASSERT(entries_.empty() && "Deletion queue must be flushed before it is destroyed!");
+	}
+
+	void QbVkDeletionQueue::Enqueue(eastl::function<void()>&& destroy) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		entries_.push_back({ currentFrame_, eastl::move(destroy) });
+	}
+
+	void QbVkDeletionQueue::DestroyBuffer(QbVkBuffer buffer) {
+		if (buffer.buf == VK_NULL_HANDLE && buffer.alloc.deviceMemory == VK_NULL_HANDLE) return;
+		Enqueue([this, buffer]() mutable { context_.allocator->DestroyBuffer(buffer); });
+	}
+
+	void QbVkDeletionQueue::DestroyImage(QbVkImage image) {
+		if (image.imgHandle == VK_NULL_HANDLE && image.alloc.deviceMemory == VK_NULL_HANDLE) return;
+		Enqueue([this, image]() mutable { context_.allocator->DestroyImage(image); });
+	}
+
+	void QbVkDeletionQueue::DestroyImageView(VkImageView imageView) {
+		if (imageView == VK_NULL_HANDLE) return;
+		Enqueue([this, imageView]() { vkDestroyImageView(context_.device, imageView, nullptr); });
+	}
+
+	void QbVkDeletionQueue::DestroySampler(VkSampler sampler) {
+		if (sampler == VK_NULL_HANDLE) return;
+		Enqueue([this, sampler]() { vkDestroySampler(context_.device, sampler, nullptr); });
+	}
+
+	void QbVkDeletionQueue::DestroyDescriptorPool(VkDescriptorPool descriptorPool) {
+		if (descriptorPool == VK_NULL_HANDLE) return;
+		// Descriptor sets are never freed individually, they go with their pool
+		Enqueue([this, descriptorPool]() { vkDestroyDescriptorPool(context_.device, descriptorPool, nullptr); });
+	}
+
+	void QbVkDeletionQueue::DestroyPipeline(VkPipeline pipeline) {
+		if (pipeline == VK_NULL_HANDLE) return;
+		Enqueue([this, pipeline]() { vkDestroyPipeline(context_.device, pipeline, nullptr); });
+	}
+
+	void QbVkDeletionQueue::DestroyPipelineLayout(VkPipelineLayout pipelineLayout) {
+		if (pipelineLayout == VK_NULL_HANDLE) return;
+		Enqueue([this, pipelineLayout]() { vkDestroyPipelineLayout(context_.device, pipelineLayout, nullptr); });
+	}
+
+	void QbVkDeletionQueue::FrameCompleted(uint32_t resourceIndex) {
+		eastl::vector<eastl::function<void()>> ready;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (resourceIndex < submittedFrames_.size()) {
+				completedFrame_ = eastl::max(completedFrame_, submittedFrames_[resourceIndex]);
+			}
+			while (!entries_.empty() && entries_.front().frame <= completedFrame_) {
+				ready.push_back(eastl::move(entries_.front().destroy));
+				entries_.pop_front();
+			}
+		}
+
+		// Destroy outside the lock, destroying may enqueue further deletions
+		for (auto&& destroy : ready) destroy();
+	}
+
+	void QbVkDeletionQueue::FrameSubmitted(uint32_t resourceIndex) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (resourceIndex >= submittedFrames_.size()) submittedFrames_.resize(resourceIndex + 1, 0);
+		submittedFrames_[resourceIndex] = currentFrame_++;
+	}
+
+	void QbVkDeletionQueue::Flush() {
+		while (true) {
+			eastl::deque<Entry> entries;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (entries_.empty()) break;
+				entries.swap(entries_);
+				completedFrame_ = currentFrame_;
+			}
+			for (auto&& entry : entries) entry.destroy();
+		}
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <mutex>
+
+#include <EASTL/deque.h>
+#include <EASTL/functional.h>
+#include <EASTL/vector.h>
+
+#include "Engine/Rendering/VulkanTypes.h"
+
+namespace Quadbit {
+	// Defers the destruction of GPU objects until every frame that could have used them has finished.
+	// Each submitted frame gets a monotonically increasing number, and the number of the last frame whose fence
+	// signaled is tracked. An object destroyed while recording frame N is released once frame N has completed,
+	// which holds regardless of how many frames are in flight. Safe to use from any thread
+	class QbVkDeletionQueue {
+	public:
+		QbVkDeletionQueue(QbVkContext& context);
+		~QbVkDeletionQueue();
+
+		void Enqueue(eastl::function<void()>&& destroy);
+
+		void DestroyBuffer(QbVkBuffer buffer);
+		void DestroyImage(QbVkImage image);
+		void DestroyImageView(VkImageView imageView);
+		void DestroySampler(VkSampler sampler);
+		void DestroyDescriptorPool(VkDescriptorPool descriptorPool);
+		void DestroyPipeline(VkPipeline pipeline);
+		void DestroyPipelineLayout(VkPipelineLayout pipelineLayout);
+
+		// Called after the fence of the frame using the resource index has been waited on
+		void FrameCompleted(uint32_t resourceIndex);
+		// Called once the frame using the resource index has been submitted
+		void FrameSubmitted(uint32_t resourceIndex);
+		// Destroys everything regardless of frame, the device must be idle
+		void Flush();
+
+	private:
+		struct Entry {
+			uint64_t frame;
+			eastl::function<void()> destroy;
+		};
+
+		QbVkContext& context_;
+		std::mutex mutex_;
+		// Entries are pushed in frame order, so only the front needs to be checked
+		eastl::deque<Entry> entries_;
+
+		// The frame currently being recorded, and the last frame known to have finished on the GPU
+		uint64_t currentFrame_ = 1;
+		uint64_t completedFrame_ = 0;
+		// The frame last submitted with each resource index
+		eastl::vector<uint64_t> submittedFrames_;
+	};
+}
@@ -0,0 +1,56 @@
+#include "GeometryArena.h"
+
+#include "Engine/Core/Logging.h"
+
+namespace Quadbit {
+	QbVkGeometryArena::QbVkGeometryArena(QbVkBufferHandle buffer, uint32_t elementSize, uint32_t capacity) :
+		buffer_(buffer), elementSize_(elementSize), capacity_(capacity) {
+		freeRanges_.push_back({ 0, capacity });
+	}
+
+	bool QbVkGeometryArena::Allocate(uint32_t count, QbVkMeshAllocation& allocation) {
+		QB_ASSERT(count > 0);
+
+		// First fit, same as the memory pools
+		for (auto it = freeRanges_.begin(); it != freeRanges_.end(); ++it) {
+			if (it->count < count) continue;
+
+			allocation.buffer = buffer_;
+			allocation.offset = it->offset;
+			allocation.count = count;
+
+			it->offset += count;
+			it->count -= count;
+			if (it->count == 0) freeRanges_.erase(it);
+
+			allocatedCount_ += count;
+			return true;
+		}
+		return false;
+	}
+
+	void QbVkGeometryArena::Free(const QbVkMeshAllocation& allocation) {
+		QB_ASSERT(allocation.buffer == buffer_ && "Allocation does not belong to this arena!");
+		QB_ASSERT(allocation.offset + allocation.count <= capacity_);
+
+		// Find the first free range after the allocation
+		auto next = freeRanges_.begin();
+		while (next != freeRanges_.end() && next->offset < allocation.offset) ++next;
+		QB_ASSERT((next == freeRanges_.end() || allocation.offset + allocation.count <= next->offset) && "Double free of arena range!");
+
+		auto it = freeRanges_.insert(next, { allocation.offset, allocation.count });
+
+		// Merge with the following range
+		if (it + 1 != freeRanges_.end() && it->offset + it->count == (it + 1)->offset) {
+			it->count += (it + 1)->count;
+			freeRanges_.erase(it + 1);
+		}
+		// Merge with the preceding range
+		if (it != freeRanges_.begin() && (it - 1)->offset + (it - 1)->count == it->offset) {
+			(it - 1)->count += it->count;
+			freeRanges_.erase(it);
+		}
+
+		allocatedCount_ -= allocation.count;
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <EASTL/vector.h>
+
+#include "Engine/Rendering/VulkanTypes.h"
+
+namespace Quadbit {
+	// A single large vertex or index buffer that meshes are sub-allocated from.
+	// Offsets and sizes are in elements rather than bytes, so that they can be
+	// passed directly as vertexOffset/firstIndex when drawing
+	struct QbVkGeometryArena {
+		QbVkBufferHandle buffer_ = QBVK_BUFFER_NULL_HANDLE;
+		uint32_t elementSize_ = 0;
+		uint32_t capacity_ = 0;
+		uint32_t allocatedCount_ = 0;
+
+		struct Range {
+			uint32_t offset = 0;
+			uint32_t count = 0;
+		};
+		// Free ranges sorted by offset, neighbouring ranges are always merged
+		eastl::vector<Range> freeRanges_;
+
+		QbVkGeometryArena(QbVkBufferHandle buffer, uint32_t elementSize, uint32_t capacity);
+
+		bool Allocate(uint32_t count, QbVkMeshAllocation& allocation);
+		void Free(const QbVkMeshAllocation& allocation);
+	};
+}
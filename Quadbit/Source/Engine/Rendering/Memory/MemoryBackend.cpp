@@ -0,0 +1,113 @@
+#include "MemoryBackend.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "Engine/Core/Logging.h"
+#include "Engine/Rendering/VulkanUtils.h"
+
+namespace Quadbit {
+	VkResult QbVkDeviceMemoryBackend::AllocateMemory(uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceMemory& memory) {
+		VkMemoryAllocateInfo memoryAllocateInfo = VkUtils::Init::MemoryAllocateInfo();
+		memoryAllocateInfo.allocationSize = size;
+		memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
+		return vkAllocateMemory(device_, &memoryAllocateInfo, nullptr, &memory);
+	}
+
+	void QbVkDeviceMemoryBackend::FreeMemory(VkDeviceMemory memory) {
+		vkFreeMemory(device_, memory, nullptr);
+	}
+
+	VkResult QbVkDeviceMemoryBackend::MapMemory(VkDeviceMemory memory, VkDeviceSize size, void** data) {
+		return vkMapMemory(device_, memory, 0, size, 0, data);
+	}
+
+	void QbVkDeviceMemoryBackend::UnmapMemory(VkDeviceMemory memory) {
+		vkUnmapMemory(device_, memory);
+	}
+
+	QbVkHostMemoryBackend::~QbVkHostMemoryBackend() {
+		if (!allocations_.empty()) {
+			QB_LOG_WARN("QbVkHostMemoryBackend: %u allocation(s) still alive on destruction\n", static_cast<uint32_t>(allocations_.size()));
+		}
+		for (auto&& [memory, allocation] : allocations_) {
+#ifdef _WIN32
+			_aligned_free(reinterpret_cast<void*>(memory));
+#else
+			free(reinterpret_cast<void*>(memory));
+#endif
+		}
+	}
+
+	VkResult QbVkHostMemoryBackend::AllocateMemory(uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceMemory& memory) {
+		if (budget_ > 0 && allocatedSize_ + size > budget_) {
+			return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+		}
+
+		// aligned_alloc requires the size to be a multiple of the alignment
+		const auto alignedSize = VkUtils::AlignUp(size, alignment_);
+#ifdef _WIN32
+		void* data = _aligned_malloc(static_cast<size_t>(alignedSize), static_cast<size_t>(alignment_));
+#else
+		void* data = aligned_alloc(static_cast<size_t>(alignment_), static_cast<size_t>(alignedSize));
+#endif
+		if (data == nullptr) return VK_ERROR_OUT_OF_HOST_MEMORY;
+
+		// Fill with garbage so reads of uninitialized memory show up in tests
+		memset(data, 0xCD, static_cast<size_t>(alignedSize));
+
+		memory = reinterpret_cast<VkDeviceMemory>(data);
+		allocations_[memory] = { size, memoryTypeIndex, false };
+		allocatedSize_ += size;
+		return VK_SUCCESS;
+	}
+
+	void QbVkHostMemoryBackend::FreeMemory(VkDeviceMemory memory) {
+		auto it = allocations_.find(memory);
+		QB_ASSERT(it != allocations_.end() && "Freeing memory not owned by the host backend!");
+		QB_ASSERT(!it->second.mapped && "Freeing memory that is still mapped!");
+
+		allocatedSize_ -= it->second.size;
+		allocations_.erase(it);
+#ifdef _WIN32
+		_aligned_free(reinterpret_cast<void*>(memory));
+#else
+		free(reinterpret_cast<void*>(memory));
+#endif
+	}
+
+	VkResult QbVkHostMemoryBackend::MapMemory(VkDeviceMemory memory, VkDeviceSize size, void** data) {
+		auto it = allocations_.find(memory);
+		QB_ASSERT(it != allocations_.end() && "Mapping memory not owned by the host backend!");
+		QB_ASSERT(!it->second.mapped && "Memory is already mapped!");
+		QB_ASSERT(size <= it->second.size);
+
+		// Same rule as Vulkan, device local only memory can't be mapped
+		const auto properties = HostMemoryProperties();
+		if (!(properties.memoryTypes[it->second.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+			return VK_ERROR_MEMORY_MAP_FAILED;
+		}
+
+		it->second.mapped = true;
+		*data = reinterpret_cast<void*>(memory);
+		return VK_SUCCESS;
+	}
+
+	void QbVkHostMemoryBackend::UnmapMemory(VkDeviceMemory memory) {
+		auto it = allocations_.find(memory);
+		QB_ASSERT(it != allocations_.end() && it->second.mapped);
+		it->second.mapped = false;
+	}
+
+	VkPhysicalDeviceMemoryProperties QbVkHostMemoryBackend::HostMemoryProperties() {
+		VkPhysicalDeviceMemoryProperties properties{};
+		properties.memoryHeapCount = 2;
+		properties.memoryHeaps[0] = { 8ull * 1024 * 1024 * 1024, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT };
+		properties.memoryHeaps[1] = { 16ull * 1024 * 1024 * 1024, 0 };
+
+		properties.memoryTypeCount = 2;
+		properties.memoryTypes[0] = { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0 };
+		properties.memoryTypes[1] = { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, 1 };
+		return properties;
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <EASTL/hash_map.h>
+
+#include "Engine/Rendering/VulkanTypes.h"
+
+namespace Quadbit {
+	// The device memory calls made by the pools. Everything above this (pools, allocator statistics, garbage)
+	// is backend agnostic, so the allocation logic can be exercised without a GPU
+	class QbVkMemoryBackend {
+	public:
+		virtual ~QbVkMemoryBackend() = default;
+
+		virtual VkResult AllocateMemory(uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceMemory& memory) = 0;
+		virtual void FreeMemory(VkDeviceMemory memory) = 0;
+		virtual VkResult MapMemory(VkDeviceMemory memory, VkDeviceSize size, void** data) = 0;
+		virtual void UnmapMemory(VkDeviceMemory memory) = 0;
+	};
+
+	class QbVkDeviceMemoryBackend : public QbVkMemoryBackend {
+	public:
+		QbVkDeviceMemoryBackend(VkDevice device) : device_(device) {}
+
+		VkResult AllocateMemory(uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceMemory& memory) override;
+		void FreeMemory(VkDeviceMemory memory) override;
+		VkResult MapMemory(VkDeviceMemory memory, VkDeviceSize size, void** data) override;
+		void UnmapMemory(VkDeviceMemory memory) override;
+
+	private:
+		VkDevice device_;
+	};
+
+	// Backs every memory type with aligned host memory, handles are the host pointers themselves.
+	// Pair it with HostMemoryProperties() and a QbVkAllocator for off-device fuzzing and benchmarks
+	class QbVkHostMemoryBackend : public QbVkMemoryBackend {
+	public:
+		QbVkHostMemoryBackend(VkDeviceSize alignment = 4096) : alignment_(alignment) {}
+		~QbVkHostMemoryBackend();
+
+		VkResult AllocateMemory(uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceMemory& memory) override;
+		void FreeMemory(VkDeviceMemory memory) override;
+		VkResult MapMemory(VkDeviceMemory memory, VkDeviceSize size, void** data) override;
+		void UnmapMemory(VkDeviceMemory memory) override;
+
+		// A device local type and a host visible/coherent/cached type, enough for every QbVkMemoryUsage
+		static VkPhysicalDeviceMemoryProperties HostMemoryProperties();
+
+		// Limits the total amount of memory handed out so out-of-memory paths can be tested, 0 is unlimited
+		void SetBudget(VkDeviceSize budget) { budget_ = budget; }
+		VkDeviceSize GetAllocatedSize() const { return allocatedSize_; }
+		uint32_t GetAllocationCount() const { return static_cast<uint32_t>(allocations_.size()); }
+
+	private:
+		struct HostAllocation {
+			VkDeviceSize size = 0;
+			uint32_t memoryTypeIndex = 0;
+			bool mapped = false;
+		};
+
+		VkDeviceSize alignment_;
+		VkDeviceSize budget_ = 0;
+		VkDeviceSize allocatedSize_ = 0;
+		eastl::hash_map<VkDeviceMemory, HostAllocation> allocations_;
+	};
+}
@@ -1,21 +1,30 @@
 #include "Pool.h"
 
+#include <EASTL/algorithm.h>
 #include <imgui/imgui.h>
 
 #include "Engine/Rendering/VulkanUtils.h"
 
 namespace Quadbit {
-	QbVkPool::QbVkPool(VkDevice device, const int32_t memoryTypeIndex, const VkDeviceSize size, QbVkMemoryUsage usage) :
-		capacity_(size), memoryTypeIndex_(memoryTypeIndex), device_(device), memoryUsage_(usage) {
-
-		VkMemoryAllocateInfo memoryAllocateInfo = VkUtils::Init::MemoryAllocateInfo();
-		memoryAllocateInfo.allocationSize = capacity_;
-		memoryAllocateInfo.memoryTypeIndex = static_cast<uint32_t>(memoryTypeIndex_);
-		VK_CHECK(vkAllocateMemory(device_, &memoryAllocateInfo, nullptr, &deviceMemory_));
+	QbVkPool::QbVkPool(QbVkMemoryBackend& backend, const int32_t memoryTypeIndex, const VkDeviceSize size, QbVkMemoryUsage usage) :
+		capacity_(size), memoryTypeIndex_(memoryTypeIndex), backend_(backend), memoryUsage_(usage) {
+
+		// The backend is only called once, a failure leaves the pool without memory for the allocator to discard
+		VkResult result = backend_.AllocateMemory(static_cast<uint32_t>(memoryTypeIndex_), capacity_, deviceMemory_);
+		if (result != VK_SUCCESS) {
+			QB_LOG_WARN("Failed to allocate %llu bytes of memory type %i: %s\n", capacity_, memoryTypeIndex_, VulkanErrorToString(result));
+			deviceMemory_ = VK_NULL_HANDLE;
+		}
 
 		// If the memory is host visible, map it
-		if (memoryUsage_ != QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY) {
-			VK_CHECK(vkMapMemory(device_, deviceMemory_, 0, size, 0, (void**)&data_));
+		if (deviceMemory_ != VK_NULL_HANDLE && memoryUsage_ != QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY) {
+			result = backend_.MapMemory(deviceMemory_, size, (void**)&data_);
+			if (result != VK_SUCCESS) {
+				QB_LOG_WARN("Failed to map memory of type %i: %s\n", memoryTypeIndex_, VulkanErrorToString(result));
+				backend_.FreeMemory(deviceMemory_);
+				deviceMemory_ = VK_NULL_HANDLE;
+				data_ = nullptr;
+			}
 		}
 
 		// Set up the list
@@ -28,14 +37,17 @@ namespace Quadbit {
 	}
 
 	QbVkPool::~QbVkPool() {
-		if (memoryUsage_ != QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY) {
-			vkUnmapMemory(device_, deviceMemory_);
+		if (deviceMemory_ == VK_NULL_HANDLE) return;
+
+		if (data_ != nullptr) {
+			backend_.UnmapMemory(deviceMemory_);
 		}
-		vkFreeMemory(device_, deviceMemory_, nullptr);
+		backend_.FreeMemory(deviceMemory_);
 		deviceMemory_ = VK_NULL_HANDLE;
 	}
 
-	bool QbVkPool::Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize granularity, QbVkAllocationType allocationType, QbVkAllocation& allocation) {
+	bool QbVkPool::Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize granularity, QbVkAllocationType allocationType,
+		QbVkAllocationTag tag, const char* name, QbVkAllocation& allocation) {
 		// Return immediately if there isn't room enough in the pool
 		if ((allocatedSize_ + size) > capacity_) return false;
 
@@ -97,7 +109,7 @@ namespace Quadbit {
 
 		// If the size of the candidate is greater than the size of the requested allocation,
 		// we'll allocate a new block to fill the size leftover in the old block after allocation
-		if (bestCandidate->size > size) {
+		if (bestCandidate->size > alignedSize) {
 			eastl::unique_ptr<Block> newBlock = eastl::make_unique<Block>();
 			newBlock->next = eastl::move(bestCandidate->next);
 
@@ -114,12 +126,16 @@ namespace Quadbit {
 
 			bestCandidate->next = eastl::move(newBlock);
 		}
-		bestCandidate->size = size;
+		// The block includes the alignment padding so the block list always covers the whole pool
+		bestCandidate->size = alignedSize;
 		bestCandidate->allocationType = allocationType;
+		bestCandidate->tag = tag;
+		bestCandidate->name = (name != nullptr) ? name : "";
 
 		allocatedSize_ += alignedSize;
 
-		allocation.size = bestCandidate->size;
+		allocation.size = size;
+		allocation.tag = tag;
 		allocation.id = bestCandidate->id;
 		allocation.deviceMemory = deviceMemory_;
 		if (memoryUsage_ != QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY) {
@@ -145,7 +161,10 @@ namespace Quadbit {
 			return;
 		}
 
+		allocatedSize_ -= current->size;
 		current->allocationType = QbVkAllocationType::QBVK_ALLOCATION_TYPE_FREE;
+		current->tag = QbVkAllocationTag::QBVK_ALLOCATION_TAG_UNKNOWN;
+		current->name.clear();
 
 		// We need to merge either side of the freed allocation in case they are also free.
 		// Merge left side
@@ -174,21 +193,68 @@ namespace Quadbit {
 			// This move invalidates the next block so its merged into the current
 			current->next = eastl::move(next->next);
 		}
+	}
+
+	QbVkPoolStats QbVkPool::GetStats() const {
+		QbVkPoolStats stats{};
+		stats.capacity = capacity_;
+		stats.allocated = allocatedSize_;
+
+		for (const Block* current = head_.get(); current != nullptr; current = current->next.get()) {
+			if (current->allocationType == QbVkAllocationType::QBVK_ALLOCATION_TYPE_FREE) {
+				stats.freeBlocks++;
+				stats.freeSize += current->size;
+				stats.largestFreeBlock = eastl::max(stats.largestFreeBlock, current->size);
+			}
+			else {
+				stats.usedBlocks++;
+			}
+		}
 
-		allocatedSize_ -= allocation.size;
+		if (stats.freeSize > 0) {
+			stats.fragmentation = 1.0f - static_cast<float>(stats.largestFreeBlock) / static_cast<float>(stats.freeSize);
+		}
+		return stats;
 	}
 
-	void QbVkPool::DrawImGuiPool(uint32_t num) {
-		uint32_t occupiedBlocks = 0;
-		uint32_t totalBlocks = 0;
-		Block* current = nullptr;
-		for (current = head_.get(); current != nullptr; current = current->next.get()) {
-			if (current->allocationType != QbVkAllocationType::QBVK_ALLOCATION_TYPE_FREE) {
-				occupiedBlocks++;
+	uint32_t QbVkPool::ReportLeaks() const {
+		uint32_t leaks = 0;
+		for (const Block* current = head_.get(); current != nullptr; current = current->next.get()) {
+			if (current->allocationType == QbVkAllocationType::QBVK_ALLOCATION_TYPE_FREE) continue;
+			QB_LOG_WARN("QbVkAllocator: Leaked %s allocation \"%s\" of %llu bytes at offset %llu in memory type %i\n",
+				AllocationTagToString(current->tag), current->name.c_str(), current->size, current->offset, memoryTypeIndex_);
+			leaks++;
+		}
+		return leaks;
+	}
+
+	void QbVkPool::DumpJSON(FILE* file) const {
+		const auto stats = GetStats();
+		fprintf(file, "{\"memoryType\": %i, \"capacity\": %llu, \"allocated\": %llu, \"largestFreeBlock\": %llu, \"fragmentation\": %.4f, \"blocks\": [",
+			memoryTypeIndex_, capacity_, allocatedSize_, stats.largestFreeBlock, stats.fragmentation);
+
+		bool first = true;
+		for (const Block* current = head_.get(); current != nullptr; current = current->next.get()) {
+			const bool free = current->allocationType == QbVkAllocationType::QBVK_ALLOCATION_TYPE_FREE;
+			fprintf(file, "%s\n\t\t{\"id\": %u, \"offset\": %llu, \"size\": %llu, \"free\": %s, \"tag\": \"%s\", \"name\": \"",
+				first ? "" : ",", current->id, current->offset, current->size, free ? "true" : "false", AllocationTagToString(current->tag));
+			// Names are supplied by the caller, so escape anything that would break the string
+			for (const char c : current->name) {
+				if (c == '"' || c == '\\') fputc('\\', file);
+				if (static_cast<unsigned char>(c) >= 0x20) fputc(c, file);
 			}
-			totalBlocks++;
+			fprintf(file, "\"}");
+			first = false;
 		}
-		ImGui::Text("Pool %i: %.2f/%.2f MB allocated in %i/%i blocks", num,
-			allocatedSize_ / 1024.0f / 1024.0f, capacity_ / 1024.0f / 1024.0f, occupiedBlocks, totalBlocks);
+		fprintf(file, "\n\t]}");
+	}
+
+	void QbVkPool::DrawImGuiPool(uint32_t num) {
+		const auto stats = GetStats();
+		ImGui::Text("%s pool %i: %.2f/%.2f MB allocated in %i/%i blocks",
+			poolType_ == QbVkPoolType::QBVK_POOL_TYPE_BUDDY ? "Buddy" : "First-fit", num,
+			allocatedSize_ / 1024.0f / 1024.0f, capacity_ / 1024.0f / 1024.0f, stats.usedBlocks, stats.usedBlocks + stats.freeBlocks);
+		ImGui::Text("\tLargest free block: %.2f MB, fragmentation: %.1f%%", 
+			stats.largestFreeBlock / 1024.0f / 1024.0f, stats.fragmentation * 100.0f);
 	}
 }
\ No newline at end of file
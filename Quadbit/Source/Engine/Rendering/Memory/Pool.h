@@ -1,19 +1,42 @@
 #pragma once
 
+#include <cstdio>
+
+#include <EASTL/string.h>
 #include <EASTL/unique_ptr.h>
 
 #include "Engine/Rendering/VulkanTypes.h"
+#include "Engine/Rendering/Memory/MemoryBackend.h"
 
 namespace Quadbit {
+	enum class QbVkPoolType {
+		// General purpose first-fit over a list of blocks
+		QBVK_POOL_TYPE_FIRST_FIT,
+		// Power of two blocks, for churny allocations of varying size (see QbVkBuddyPool)
+		QBVK_POOL_TYPE_BUDDY
+	};
+
+	struct QbVkPoolStats {
+		VkDeviceSize capacity = 0;
+		VkDeviceSize allocated = 0;
+		VkDeviceSize freeSize = 0;
+		VkDeviceSize largestFreeBlock = 0;
+		uint32_t usedBlocks = 0;
+		uint32_t freeBlocks = 0;
+		// 0 when all free memory is in one contiguous block, approaching 1 as it gets scattered
+		float fragmentation = 0.0f;
+	};
+
 	struct QbVkPool {
 		VkDeviceSize capacity_ = 0;
 		VkDeviceSize allocatedSize_ = 0;
 		int32_t memoryTypeIndex_;
-		VkDevice device_ = VK_NULL_HANDLE;
+		QbVkMemoryBackend& backend_;
 		uint32_t nextBlockId_ = 0;
 		VkDeviceMemory deviceMemory_ = 0;
 		QbVkMemoryUsage memoryUsage_ = QbVkMemoryUsage::QBVK_MEMORY_USAGE_UNKNOWN;
 		unsigned char* data_ = nullptr;
+		QbVkPoolType poolType_ = QbVkPoolType::QBVK_POOL_TYPE_FIRST_FIT;
 
 		struct Block {
 			uint32_t id = 0;
@@ -22,14 +45,21 @@ namespace Quadbit {
 			Block* prev = nullptr;
 			eastl::unique_ptr<Block> next = nullptr;
 			QbVkAllocationType allocationType = QbVkAllocationType::QBVK_ALLOCATION_TYPE_UNKNOWN;
+			QbVkAllocationTag tag = QbVkAllocationTag::QBVK_ALLOCATION_TAG_UNKNOWN;
+			eastl::string name;
 		};
 		eastl::unique_ptr<Block> head_ = eastl::make_unique<Block>();
 
-		QbVkPool(VkDevice device, const int32_t memoryTypeIndex, const VkDeviceSize size, QbVkMemoryUsage usage);
-		~QbVkPool();
+		QbVkPool(QbVkMemoryBackend& backend, const int32_t memoryTypeIndex, const VkDeviceSize size, QbVkMemoryUsage usage);
+		virtual ~QbVkPool();
+
+		virtual bool Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize granularity, QbVkAllocationType allocationType,
+			QbVkAllocationTag tag, const char* name, QbVkAllocation& allocation);
+		virtual void Free(QbVkAllocation& allocation);
 
-		bool Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize granularity, QbVkAllocationType allocationType, QbVkAllocation& allocation);
-		void Free(QbVkAllocation& allocation);
+		virtual QbVkPoolStats GetStats() const;
+		virtual uint32_t ReportLeaks() const;
+		virtual void DumpJSON(FILE* file) const;
 		void DrawImGuiPool(uint32_t num);
 	};
-}
\ No newline at end of file
+}
@@ -1,6 +1,10 @@
 #include "ResourceManager.h"
 
+#include <cstring>
+
 #include <EASTL/algorithm.h>
+#include <EASTL/chrono.h>
+#include <EASTL/sort.h>
 
 #include <stb/stb_image.h>
 
@@ -11,6 +15,9 @@
 
 #include "Engine/Rendering/VulkanUtils.h"
 #include "Engine/Rendering/Memory/Allocator.h"
+#include "Engine/Rendering/Pipelines/PipelineCache.h"
+#include "Engine/Rendering/Shaders/ShaderCompiler.h"
+#include "Engine/Core/Hash.h"
 #include "Engine/Core/Logging.h"
 
 namespace Quadbit {
@@ -18,94 +25,178 @@ namespace Quadbit {
 		commandBuffer = VkUtils::CreatePersistentCommandBuffer(context);
 	}
 
-	QbVkResourceManager::QbVkResourceManager(QbVkContext& context) : context_(context), transferQueue_(PerFrameTransfers(context)) {}
+	QbVkResourceManager::QbVkResourceManager(QbVkContext& context) : context_(context), transferQueue_(context),
+		textureLoader_(eastl::make_unique<QbVkTextureLoader>(context)), textureStreamer_(eastl::make_unique<QbVkTextureStreamer>(*textureLoader_)) {
 
-	QbVkResourceManager::~QbVkResourceManager() {
-		// Destroy staging buffers...
-		for (auto& stagingBuffer : transferQueue_.stagingBuffers) {
-			// Simply break when we reach the end of the buffers
-			if (stagingBuffer.buf == VK_NULL_HANDLE) break;
-			context_.allocator->DestroyBuffer(stagingBuffer);
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(context_.gpu->physicalDevice, VK_FORMAT_R8G8B8A8_UNORM, &formatProperties);
+		const VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		linearBlitSupported_ = (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+		if (!linearBlitSupported_) {
+			QB_LOG_WARN("Linear blits are not supported for textures, mipmaps will not be generated\n");
 		}
+
+		// Streamed meshes come and go in every size, the buddy pools keep that churn from fragmenting the memory
+		context_.allocator->SetPoolType(QbVkAllocationTag::QBVK_ALLOCATION_TAG_STREAMED_MESH, QbVkPoolType::QBVK_POOL_TYPE_BUDDY);
+	}
+
+	QbVkResourceManager::~QbVkResourceManager() {
+		// Stop the loader threads first, uploads that haven't been collected are dropped
+		textureStreamer_.reset();
+		textureLoader_.reset();
+
 		// Destroy regular GPU buffers
-		for (uint16_t i = 0; i < buffers_.resourceIndex; i++) {
-			if (eastl::find(buffers_.freeList.begin(), buffers_.freeList.end(), i) == buffers_.freeList.end()) {
-				DestroyResource<QbVkBuffer>(buffers_.GetHandle(i));
-			}
-		}
+		buffers_.ForEach([&](QbVkBufferHandle handle, QbVkBuffer&) { DestroyResource<QbVkBuffer>(handle); });
 		// Destroy textures...
-		for (uint16_t i = 0; i < textures_.resourceIndex; i++) {
-			if (eastl::find(textures_.freeList.begin(), textures_.freeList.end(), i) == textures_.freeList.end()) {
-				DestroyResource<QbVkTexture>(textures_.GetHandle(i));
-			}
-		}
+		textures_.ForEach([&](QbVkTextureHandle handle, QbVkTexture&) { DestroyResource<QbVkTexture>(handle); });
 		// Destroy descriptor set allocators
-		for (uint16_t i = 0; i < descriptorAllocators_.resourceIndex; i++) {
-			if (eastl::find(descriptorAllocators_.freeList.begin(), descriptorAllocators_.freeList.end(), i) == descriptorAllocators_.freeList.end()) {
-				DestroyResource<QbVkDescriptorAllocator>(descriptorAllocators_.GetHandle(i));
-			}
-		}
+		descriptorAllocators_.ForEach([&](QbVkDescriptorAllocatorHandle handle, QbVkDescriptorAllocator&) {
+			DestroyResource<QbVkDescriptorAllocator>(handle);
+		});
 
 		vkFreeCommandBuffers(context_.device, context_.commandPool, 1, &transferQueue_.commandBuffer);
 	}
 
 	QbVkPipelineHandle QbVkResourceManager::CreateGraphicsPipeline(const char* vertexPath, const char* vertexEntry, 
 		const char* fragmentPath, const char* fragmentEntry, const QbVkPipelineDescription pipelineDescription, 
-		const VkRenderPass renderPass, const uint32_t maxInstances, const eastl::vector<eastl::tuple<VkFormat, uint32_t>>& vertexAttributeOverride) {
+		const VkRenderPass renderPass, const uint32_t maxInstances, const eastl::vector<eastl::tuple<VkFormat, uint32_t>>& vertexAttributeOverride,
+		const QbVkShaderDefines& defines, const QbVkSpecialization& vertexSpecialization, const QbVkSpecialization& fragmentSpecialization) {
 		
 		auto handle = pipelines_.GetNextHandle();
 		pipelines_[handle] = eastl::make_unique<QbVkPipeline>(context_, vertexPath, vertexEntry, fragmentPath, fragmentEntry,
-			pipelineDescription, renderPass, maxInstances, vertexAttributeOverride);
+			pipelineDescription, renderPass, maxInstances, vertexAttributeOverride, defines, vertexSpecialization, fragmentSpecialization);
 		return handle;
 	}
 
 	QbVkPipelineHandle QbVkResourceManager::CreateComputePipeline(const char* computePath, const char* computeEntry, 
-		const void* specConstants, const uint32_t maxInstances) {
+		const QbVkSpecialization& specialization, const uint32_t maxInstances, const QbVkShaderDefines& defines) {
 		
 		auto handle = pipelines_.GetNextHandle();
-		pipelines_[handle] = eastl::make_unique<QbVkPipeline>(context_, computePath, computeEntry, specConstants, maxInstances);
+		pipelines_[handle] = eastl::make_unique<QbVkPipeline>(context_, computePath, computeEntry, specialization, maxInstances, defines);
 		return handle;
 	}
 
 	void QbVkResourceManager::RebuildPipelines() {
-		// Rebuild all active pipelines
-		for (uint16_t i = 0; i < pipelines_.resourceIndex; i++) {
-			if (eastl::find(pipelines_.freeList.begin(), pipelines_.freeList.end(), i) == pipelines_.freeList.end()) {
-				pipelines_[pipelines_.GetHandle(i)]->Rebuild();
+		context_.shaderCompiler->ResetCacheStats();
+		const auto start = eastl::chrono::high_resolution_clock::now();
+
+		// Queue every shader first so they all compile in parallel, then rebuild all active pipelines
+		pipelines_.ForEach([](QbVkPipelineHandle, eastl::unique_ptr<QbVkPipeline>& pipeline) { pipeline->BeginRebuild(); });
+		pipelines_.ForEach([](QbVkPipelineHandle, eastl::unique_ptr<QbVkPipeline>& pipeline) { pipeline->Rebuild(); });
+		// Any background reloads were finished along with everything else, from the latest sources
+		reloadingPipelines_ = 0;
+		deferredReloads_.clear();
+
+		const auto elapsed = static_cast<eastl::chrono::duration<float, eastl::milli>>(eastl::chrono::high_resolution_clock::now() - start).count();
+		const auto shaderStats = context_.shaderCompiler->GetCacheStats();
+		QB_LOG_INFO("Rebuilt pipelines in %.1fms, %u of %u shaders recompiled (%.1fms of compile time)\n", elapsed,
+			shaderStats.misses, shaderStats.hits + shaderStats.misses, shaderStats.milliseconds);
+
+		context_.pipelineCache->Save();
+	}
+
+	void QbVkResourceManager::RebuildPipelines(VkRenderPass previousRenderPass, VkRenderPass renderPass) {
+		const auto start = eastl::chrono::high_resolution_clock::now();
+
+		// The shaders haven't changed, so the compiler serves them from memory
+		uint32_t rebuilt = 0;
+		pipelines_.ForEach([&](QbVkPipelineHandle, eastl::unique_ptr<QbVkPipeline>& pipeline) {
+			if (pipeline->GetRenderPass() != previousRenderPass) return;
+			pipeline->SetRenderPass(renderPass);
+			pipeline->BeginRebuild();
+			rebuilt++;
+		});
+		pipelines_.ForEach([&](QbVkPipelineHandle, eastl::unique_ptr<QbVkPipeline>& pipeline) {
+			if (pipeline->GetRenderPass() == renderPass && pipeline->IsRebuildQueued()) pipeline->Rebuild();
+		});
+
+		const auto elapsed = static_cast<eastl::chrono::duration<float, eastl::milli>>(eastl::chrono::high_resolution_clock::now() - start).count();
+		QB_LOG_INFO("Rebuilt %u pipelines for a new render pass in %.1fms\n", rebuilt, elapsed);
+	}
+
+	void QbVkResourceManager::ReloadChangedShaders() {
+		const auto changedShaders = context_.shaderCompiler->TakeChangedShaders();
+		if (changedShaders.empty() && reloadingPipelines_ == 0 && deferredReloads_.empty()) return;
+
+		// Rebuilt every time, so reloads of pipelines destroyed in the meantime are dropped
+		const auto deferredReloads = eastl::move(deferredReloads_);
+		deferredReloads_.clear();
+
+		reloadingPipelines_ = 0;
+		pipelines_.ForEach([&](QbVkPipelineHandle handle, eastl::unique_ptr<QbVkPipeline>& pipeline) {
+			if (pipeline->IsRebuildReady()) pipeline->Rebuild();
+
+			const eastl::string* reloadPath = nullptr;
+			for (const auto& deferred : deferredReloads) {
+				if (deferred.pipeline == handle) {
+					reloadPath = &deferred.path;
+					break;
+				}
 			}
-		}
+			for (const auto& path : changedShaders) {
+				if (reloadPath != nullptr) break;
+				if (pipeline->UsesShader(path)) reloadPath = &path;
+			}
+
+			if (reloadPath != nullptr) {
+				// The queued shaders may have been read before this change, so it waits until they're swapped in
+				if (pipeline->IsRebuildQueued()) {
+					deferredReloads_.push_back({ handle, *reloadPath });
+				}
+				else {
+					QB_LOG_INFO("Reloading shaders of a pipeline using %s\n", reloadPath->c_str());
+					pipeline->BeginRebuild();
+				}
+			}
+
+			// Counted again every time, as other rebuilds may finish a queued reload along the way
+			if (pipeline->IsRebuildQueued()) reloadingPipelines_++;
+		});
 	}
 
-	void QbVkResourceManager::TransferDataToGPU(const void* data, VkDeviceSize size, QbVkBufferHandle destination) {
-		// If its the first transfer of the frame, we destroy the staging buffers from the previous transfer frame
-		if (transferQueue_.count == 0) {
-			for (auto& stagingBuffer : transferQueue_.stagingBuffers) {
-				// Simply break when we reach the end of the buffers
-				if (stagingBuffer.buf == VK_NULL_HANDLE) break;
-				context_.allocator->DestroyBuffer(stagingBuffer);
+	void QbVkResourceManager::TransferDataToGPU(const void* data, VkDeviceSize size, QbVkBufferHandle destination, VkDeviceSize dstOffset) {
+		QB_ASSERT(data != nullptr && size > 0);
+
+		const auto* bytes = static_cast<const unsigned char*>(data);
+		std::lock_guard<std::mutex> lock(transferQueue_.mutex);
+		// Checked under the lock, buffers are released under it as well
+		QB_ASSERT(buffers_.IsValid(destination) && dstOffset + size <= buffers_[destination].alloc.size &&
+			"Transfer range exceeds the destination buffer!");
+		auto& queuedData = transferQueue_.data;
+
+		// If the range continues exactly where the last transfer to the same buffer ended
+		// we simply extend that transfer, this covers the common case of sequential updates
+		if (transferQueue_.count > 0) {
+			auto& last = transferQueue_[transferQueue_.count - 1];
+			if (last.destinationBuffer == destination && last.dstOffset + last.size == dstOffset) {
+				queuedData.insert(queuedData.end(), bytes, bytes + size);
+				last.size += size;
+				return;
 			}
 		}
 
-		context_.allocator->CreateStagingBuffer(transferQueue_.stagingBuffers[transferQueue_.count], size, data);
-		transferQueue_.transfers[transferQueue_.count] = { size, destination };
+		QB_ASSERT(transferQueue_.count < MAX_TRANSFERS_PER_FRAME && "Too many transfers queued this frame!");
+		transferQueue_.transfers[transferQueue_.count] = { size, destination, dstOffset, queuedData.size() };
+		queuedData.insert(queuedData.end(), bytes, bytes + size);
 		transferQueue_.count++;
 	}
 
 	bool QbVkResourceManager::TransferQueuedDataToGPU(uint32_t resourceIndex) {
-		if (transferQueue_.count == 0) return false;
+		// Streaming decisions are made before collecting, replacements are held back while descriptors may still use the old images
+		textureStreamer_->Update();
+		eastl::vector<QbVkTextureUpload> uploads;
+		textureLoader_->CollectUploads(uploads, textureStreamer_->CanReplace());
+
+		std::lock_guard<std::mutex> lock(transferQueue_.mutex);
+		if (transferQueue_.count == 0 && uploads.empty()) return false;
 
 		VkCommandBufferBeginInfo commandBufferInfo = VkUtils::Init::CommandBufferBeginInfo();
 		commandBufferInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 		VK_CHECK(vkBeginCommandBuffer(transferQueue_.commandBuffer, &commandBufferInfo));
 
-		for (uint32_t i = 0; i < transferQueue_.count; i++) {
-			// Issue copy command
-			VkBufferCopy copyRegion{};
-			copyRegion.srcOffset = 0;
-			copyRegion.dstOffset = 0;
-			copyRegion.size = transferQueue_[i].size;
-			vkCmdCopyBuffer(transferQueue_.commandBuffer, transferQueue_.stagingBuffers[i].buf, buffers_[transferQueue_[i].destinationBuffer].buf, 1, &copyRegion);
-		}
+		if (transferQueue_.count > 0) RecordBufferTransfers();
+		// Finished texture loads go into the same submission
+		if (!uploads.empty()) RecordTextureUploads(transferQueue_.commandBuffer, uploads);
 
 		// End recording
 		VK_CHECK(vkEndCommandBuffer(transferQueue_.commandBuffer));
@@ -120,15 +211,90 @@ namespace Quadbit {
 		// Submit to queue
 		VK_CHECK(vkQueueSubmit(context_.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE));
 
+		// The transfer is submitted ahead of the frame and completes with it
+		context_.deletionQueue->DestroyBuffer(transferQueue_.stagingBuffer);
+		transferQueue_.stagingBuffer = QbVkBuffer{};
+		for (auto& upload : uploads) {
+			context_.deletionQueue->DestroyBuffer(upload.stagingBuffer);
+		}
+
 		transferQueue_.Reset();
 		return true;
 	}
 
-	QbVkBufferHandle QbVkResourceManager::CreateGPUBuffer(VkDeviceSize size, VkBufferUsageFlags bufferUsage, QbVkMemoryUsage memoryUsage) {
+	void QbVkResourceManager::RecordBufferTransfers() {
+		// Sort the transfers by destination buffer and offset, ties are broken by queue order
+		eastl::vector<uint32_t> order(transferQueue_.count);
+		for (uint32_t i = 0; i < transferQueue_.count; i++) order[i] = i;
+		eastl::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			const auto& lhs = transferQueue_[a];
+			const auto& rhs = transferQueue_[b];
+			if (lhs.destinationBuffer.index != rhs.destinationBuffer.index) return lhs.destinationBuffer.index < rhs.destinationBuffer.index;
+			if (lhs.dstOffset != rhs.dstOffset) return lhs.dstOffset < rhs.dstOffset;
+			return a < b;
+		});
+
+		// Merge adjacent and overlapping ranges of the same buffer, each merged range
+		// becomes a single copy region sourced from a contiguous part of the staging buffer
+		struct MergedRange {
+			QbVkBufferHandle destination;
+			VkDeviceSize dstOffset;
+			VkDeviceSize size;
+			VkDeviceSize stagingOffset;
+			uint32_t first;
+			uint32_t last;
+		};
+		eastl::vector<MergedRange> ranges;
+		for (uint32_t i = 0; i < transferQueue_.count; i++) {
+			const auto& transfer = transferQueue_[order[i]];
+			if (!ranges.empty()) {
+				auto& range = ranges.back();
+				if (range.destination == transfer.destinationBuffer && transfer.dstOffset <= range.dstOffset + range.size) {
+					range.size = eastl::max(range.size, transfer.dstOffset + transfer.size - range.dstOffset);
+					range.last = i + 1;
+					continue;
+				}
+			}
+			ranges.push_back({ transfer.destinationBuffer, transfer.dstOffset, transfer.size, 0, i, i + 1 });
+		}
+
+		VkDeviceSize stagingSize = 0;
+		for (auto& range : ranges) {
+			range.stagingOffset = stagingSize;
+			stagingSize += range.size;
+		}
+		context_.allocator->CreateStagingBuffer(transferQueue_.stagingBuffer, stagingSize, nullptr, "Transfer staging");
+
+		// Fill the staging buffer, within a merged range the transfers are written
+		// in the order they were queued so later writes win where ranges overlap
+		auto* staging = transferQueue_.stagingBuffer.alloc.data;
+		for (const auto& range : ranges) {
+			eastl::sort(order.begin() + range.first, order.begin() + range.last);
+			for (uint32_t i = range.first; i < range.last; i++) {
+				const auto& transfer = transferQueue_[order[i]];
+				memcpy(staging + range.stagingOffset + (transfer.dstOffset - range.dstOffset),
+					transferQueue_.data.data() + transfer.srcOffset, static_cast<size_t>(transfer.size));
+			}
+		}
+
+		// Issue one copy command per destination buffer with all of its regions
+		eastl::vector<VkBufferCopy> copyRegions;
+		for (size_t i = 0; i < ranges.size(); i++) {
+			copyRegions.push_back({ ranges[i].stagingOffset, ranges[i].dstOffset, ranges[i].size });
+			if (i + 1 == ranges.size() || ranges[i + 1].destination != ranges[i].destination) {
+				vkCmdCopyBuffer(transferQueue_.commandBuffer, transferQueue_.stagingBuffer.buf, buffers_[ranges[i].destination].buf,
+					static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+				copyRegions.clear();
+			}
+		}
+	}
+
+	QbVkBufferHandle QbVkResourceManager::CreateGPUBuffer(VkDeviceSize size, VkBufferUsageFlags bufferUsage, QbVkMemoryUsage memoryUsage,
+		QbVkAllocationTag tag) {
 		auto bufferInfo = VkUtils::Init::BufferCreateInfo(size, bufferUsage);
 		auto handle = buffers_.GetNextHandle();
 
-		context_.allocator->CreateBuffer(buffers_[handle], bufferInfo, memoryUsage);
+		context_.allocator->CreateBuffer(buffers_[handle], bufferInfo, memoryUsage, nullptr, tag);
 		buffers_[handle].descriptor = { buffers_[handle].buf, 0, VK_WHOLE_SIZE };
 		return handle;
 	}
@@ -151,20 +317,107 @@ namespace Quadbit {
 		return handle;
 	}
 
+	QbVkMeshAllocation QbVkResourceManager::AllocateVertices(const void* vertices, uint32_t vertexStride, uint32_t vertexCount, bool streamed) {
+		const VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+		QbVkMeshAllocation allocation;
+		{
+			std::lock_guard<std::mutex> lock(arenaMutex_);
+			allocation = streamed
+				? AllocateStreamed(vertexStride, vertexCount, usage)
+				: AllocateFromArenas(vertexArenas_[vertexStride], vertexStride, vertexCount, DEFAULT_VERTEX_ARENA_SIZE, usage);
+		}
+		if (allocation.count == 0) return allocation;
+		TransferDataToGPU(vertices, static_cast<VkDeviceSize>(vertexCount) * vertexStride, allocation.buffer,
+			static_cast<VkDeviceSize>(allocation.offset) * vertexStride);
+		return allocation;
+	}
+
+	QbVkMeshAllocation QbVkResourceManager::AllocateIndices(const eastl::vector<uint32_t>& indices, bool streamed) {
+		const VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+		const auto indexCount = static_cast<uint32_t>(indices.size());
+		QbVkMeshAllocation allocation;
+		{
+			std::lock_guard<std::mutex> lock(arenaMutex_);
+			allocation = streamed
+				? AllocateStreamed(sizeof(uint32_t), indexCount, usage)
+				: AllocateFromArenas(indexArenas_, sizeof(uint32_t), indexCount, DEFAULT_INDEX_ARENA_SIZE, usage);
+		}
+		if (allocation.count == 0) return allocation;
+		TransferDataToGPU(indices.data(), static_cast<VkDeviceSize>(indexCount) * sizeof(uint32_t), allocation.buffer,
+			static_cast<VkDeviceSize>(allocation.offset) * sizeof(uint32_t));
+		return allocation;
+	}
+
+	void QbVkResourceManager::FreeMeshAllocation(const QbVkMeshAllocation& allocation) {
+		if (allocation.count == 0) return;
+
+		std::lock_guard<std::mutex> lock(arenaMutex_);
+		if (streamedMeshBuffers_.erase(allocation.buffer.index) > 0) {
+			DestroyResource<QbVkBuffer>(allocation.buffer);
+			return;
+		}
+		for (auto& arena : indexArenas_) {
+			if (arena.buffer_ == allocation.buffer) {
+				arena.Free(allocation);
+				return;
+			}
+		}
+		for (auto& [stride, arenas] : vertexArenas_) {
+			for (auto& arena : arenas) {
+				if (arena.buffer_ == allocation.buffer) {
+					arena.Free(allocation);
+					return;
+				}
+			}
+		}
+		QB_LOG_WARN("Attempted to free a mesh allocation that does not belong to any arena\n");
+	}
+
+	QbVkMeshAllocation QbVkResourceManager::AllocateFromArenas(eastl::vector<QbVkGeometryArena>& arenas, uint32_t elementSize,
+		uint32_t count, VkDeviceSize arenaSize, VkBufferUsageFlags usage) {
+
+		QbVkMeshAllocation allocation{};
+		if (count == 0) return allocation;
+
+		for (auto& arena : arenas) {
+			if (arena.Allocate(count, allocation)) return allocation;
+		}
+
+		// None of the existing arenas had room, so we create a new one
+		// that is at least large enough to hold the requested range
+		auto capacity = eastl::max(static_cast<uint32_t>(arenaSize / elementSize), count);
+		auto handle = CreateGPUBuffer(static_cast<VkDeviceSize>(capacity) * elementSize, usage, QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY);
+		arenas.push_back(QbVkGeometryArena(handle, elementSize, capacity));
+		if (!arenas.back().Allocate(count, allocation)) {
+			QB_LOG_WARN("Failed to allocate %u elements from a new geometry arena\n", count);
+		}
+		return allocation;
+	}
+
+	QbVkMeshAllocation QbVkResourceManager::AllocateStreamed(uint32_t elementSize, uint32_t count, VkBufferUsageFlags usage) {
+		QbVkMeshAllocation allocation{};
+		if (count == 0) return allocation;
+
+		allocation.buffer = CreateGPUBuffer(static_cast<VkDeviceSize>(count) * elementSize, usage,
+			QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY, QbVkAllocationTag::QBVK_ALLOCATION_TAG_STREAMED_MESH);
+		allocation.count = count;
+		streamedMeshBuffers_.insert(allocation.buffer.index);
+		return allocation;
+	}
+
 	QbVkTextureHandle QbVkResourceManager::CreateTexture(uint32_t width, uint32_t height, VkSamplerCreateInfo* samplerInfo) {
 		auto handle = textures_.GetNextHandle();
 		auto& texture = textures_[handle];
 
 		auto imageInfo = VkUtils::Init::ImageCreateInfo(width, height, VK_FORMAT_R8G8B8A8_UNORM, 
-			VK_IMAGE_TILING_LINEAR, VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
 		context_.allocator->CreateImage(texture.image, imageInfo, QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY);
 		texture.descriptor.imageView = VkUtils::CreateImageView(context_, texture.image.imgHandle, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
 		texture.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		if (samplerInfo != nullptr) VK_CHECK(vkCreateSampler(context_.device, samplerInfo, nullptr, &texture.descriptor.sampler));
+		if (samplerInfo != nullptr) CreateSampler(VK_FORMAT_R8G8B8A8_UNORM, *samplerInfo, texture.descriptor.sampler);
 
-		// Transition the image layout to the desired layout
-		VkUtils::TransitionImageLayout(context_, texture.image.imgHandle, VK_IMAGE_ASPECT_COLOR_BIT, 
-			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		// Optimal tiled images can't be written by the host, the contents are cleared on the GPU instead
+		ClearImage(texture.image.imgHandle, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
 
 		return handle;
 	}
@@ -175,10 +428,23 @@ namespace Quadbit {
 		auto handle = textures_.GetNextHandle();
 		auto& texture = textures_[handle];
 
-		context_.allocator->CreateImage(texture.image, *imageInfo, QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY);
+		// Linear tiling is only meant for images that are read back on the CPU, and supports far fewer formats.
+		// If the format can't be used linearly we fall back to optimal tiling in device local memory
+		auto memoryUsage = QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY;
+		if (imageInfo->tiling == VK_IMAGE_TILING_LINEAR) {
+			if (VkUtils::IsFormatSupported(context_, imageInfo->format, VK_IMAGE_TILING_LINEAR, VkUtils::GetFormatFeatures(imageInfo->usage))) {
+				memoryUsage = QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_TO_CPU;
+			}
+			else {
+				QB_LOG_WARN("Format %i does not support linear tiling for the requested usage, falling back to optimal tiling\n", imageInfo->format);
+				imageInfo->tiling = VK_IMAGE_TILING_OPTIMAL;
+			}
+		}
+
+		context_.allocator->CreateImage(texture.image, *imageInfo, memoryUsage);
 		texture.descriptor.imageView = VkUtils::CreateImageView(context_, texture.image.imgHandle, imageInfo->format, aspectFlags);
 		texture.descriptor.imageLayout = finalLayout;
-		if (samplerInfo != nullptr) VK_CHECK(vkCreateSampler(context_.device, samplerInfo, nullptr, &texture.descriptor.sampler));
+		if (samplerInfo != nullptr) CreateSampler(imageInfo->format, *samplerInfo, texture.descriptor.sampler);
 
 		// Transition the image layout to the desired layout
 		VkUtils::TransitionImageLayout(context_, texture.image.imgHandle, aspectFlags,
@@ -188,54 +454,89 @@ namespace Quadbit {
 	}
 
 	QbVkTextureHandle QbVkResourceManager::CreateStorageTexture(uint32_t width, uint32_t height, VkFormat format, VkSamplerCreateInfo* samplerInfo) {
+		// The shaders declare the format of their storage images, so there's no other format to fall back to
+		const VkImageUsageFlags usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		if (!VkUtils::IsFormatSupported(context_, format, VK_IMAGE_TILING_OPTIMAL, VkUtils::GetFormatFeatures(usage))) {
+			QB_LOG_WARN("Format %i can't be used for storage textures on this device\n", format);
+			return QBVK_TEXTURE_NULL_HANDLE;
+		}
+
 		auto handle = textures_.GetNextHandle();
 		auto& texture = textures_[handle];
 
 		auto imageCreateInfo = VkUtils::Init::ImageCreateInfo(width, height, format,
-			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+			VK_IMAGE_TILING_OPTIMAL, usage, VK_SAMPLE_COUNT_1_BIT);
 		context_.allocator->CreateImage(texture.image, imageCreateInfo, QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY);
 		texture.descriptor.imageView = VkUtils::CreateImageView(context_, texture.image.imgHandle, format, VK_IMAGE_ASPECT_COLOR_BIT);
 		texture.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-		if (samplerInfo != nullptr) VK_CHECK(vkCreateSampler(context_.device, samplerInfo, nullptr, &texture.descriptor.sampler));
+		if (samplerInfo != nullptr) CreateSampler(format, *samplerInfo, texture.descriptor.sampler);
 
-		// Transition the image layout to the desired layout
-		VkUtils::TransitionImageLayout(context_, texture.image.imgHandle, VK_IMAGE_ASPECT_COLOR_BIT,
-			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		// Start out cleared, so compute passes that accumulate into the image don't read garbage
+		ClearImage(texture.image.imgHandle, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
 
 		return handle;
 	}
 
-	QbVkTextureHandle QbVkResourceManager::LoadTexture(uint32_t width, uint32_t height, const void* data, VkSamplerCreateInfo* samplerInfo) {
-		auto handle = textures_.GetNextHandle();
-		auto& texture = textures_[handle];
-
-		VkDeviceSize size = static_cast<uint64_t>(width)* static_cast<uint64_t>(height) * 4;
-
-		auto imageCreateInfo = VkUtils::Init::ImageCreateInfo(width, height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
-		context_.allocator->CreateImage(texture.image, imageCreateInfo, QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY);
-
-		// Create buffer and copy data
-		QbVkBuffer buffer;
-		context_.allocator->CreateStagingBuffer(buffer, size, data);
-
-		// Transition the image layout to the desired layout
-		VkUtils::TransitionImageLayout(context_, texture.image.imgHandle, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
-
-		// Copy the pixel data to the image
-		VkUtils::CopyBufferToImage(context_, buffer.buf, texture.image.imgHandle, width, height);
+	void QbVkResourceManager::ClearImage(VkImage image, VkImageLayout finalLayout, VkPipelineStageFlags dstStage) {
+		VkCommandBuffer commandBuffer = VkUtils::CreateSingleTimeCommandBuffer(context_);
+
+		const VkImageSubresourceRange range{ VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+		VkImageMemoryBarrier barrier = VkUtils::Init::ImageMemoryBarrier();
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.image = image;
+		barrier.subresourceRange = range;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		const VkClearColorValue clearColour{};
+		vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColour, 1, &range);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = finalLayout;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | (finalLayout == VK_IMAGE_LAYOUT_GENERAL ? VK_ACCESS_SHADER_WRITE_BIT : 0);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkUtils::FlushCommandBuffer(context_, commandBuffer);
+	}
 
-		// Transition the image to be read in shader
-		VkUtils::TransitionImageLayout(context_, texture.image.imgHandle, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	void QbVkResourceManager::CreateSampler(VkFormat format, VkSamplerCreateInfo samplerInfo, VkSampler& sampler) {
+		// Not every format can be filtered linearly (32 bit float formats in particular), those get nearest sampling
+		const bool linear = samplerInfo.magFilter == VK_FILTER_LINEAR || samplerInfo.minFilter == VK_FILTER_LINEAR ||
+			samplerInfo.mipmapMode == VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		if (linear && !VkUtils::IsFormatSupported(context_, format, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+			QB_LOG_WARN("Format %i does not support linear filtering, falling back to nearest\n", format);
+			samplerInfo.magFilter = VK_FILTER_NEAREST;
+			samplerInfo.minFilter = VK_FILTER_NEAREST;
+			samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		}
+		VK_CHECK(vkCreateSampler(context_.device, &samplerInfo, nullptr, &sampler));
+	}
 
-		texture.descriptor.imageView = VkUtils::CreateImageView(context_, texture.image.imgHandle, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
-		texture.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		if (samplerInfo != nullptr) VK_CHECK(vkCreateSampler(context_.device, samplerInfo, nullptr, &texture.descriptor.sampler));
+	QbVkTextureHandle QbVkResourceManager::LoadTexture(uint32_t width, uint32_t height, const void* data, VkSamplerCreateInfo* samplerInfo,
+		bool generateMipmaps) {
+		auto handle = textures_.GetNextHandle();
 
-		// Destroy the buffer and free the image
-		context_.allocator->DestroyBuffer(buffer);
+		QbVkTextureUpload upload{};
+		upload.handle = handle;
+		upload.width = width;
+		upload.height = height;
+		upload.generateMipmaps = generateMipmaps;
+		upload.hasSampler = samplerInfo != nullptr;
+		if (samplerInfo != nullptr) upload.samplerInfo = *samplerInfo;
+		VkDeviceSize size = static_cast<uint64_t>(width) * static_cast<uint64_t>(height) * 4;
+		context_.allocator->CreateStagingBuffer(upload.stagingBuffer, size, data, "Texture staging");
+
+		// Record the transitions, the copy and the mip chain into a single submission
+		eastl::vector<QbVkTextureUpload> uploads{ upload };
+		VkCommandBuffer commandBuffer = VkUtils::CreateSingleTimeCommandBuffer(context_);
+		RecordTextureUploads(commandBuffer, uploads);
+		VkUtils::FlushCommandBuffer(context_, commandBuffer);
+
+		// The flush waits for completion, so the staging buffer can be freed right away
+		context_.allocator->DestroyBuffer(uploads[0].stagingBuffer);
 
 		return handle;
 	}
@@ -251,6 +552,290 @@ namespace Quadbit {
 		return handle;
 	}
 
+	QbVkTextureHandle QbVkResourceManager::LoadTextureAsync(const char* imagePath, VkSamplerCreateInfo* samplerInfo) {
+		auto handle = CreatePlaceholderTexture();
+		textureLoader_->Enqueue(handle, imagePath, samplerInfo);
+		return handle;
+	}
+
+	QbVkTextureHandle QbVkResourceManager::LoadTextureAsync(const unsigned char* encoded, size_t size, VkSamplerCreateInfo* samplerInfo) {
+		auto handle = CreatePlaceholderTexture();
+		textureLoader_->Enqueue(handle, encoded, size, samplerInfo);
+		return handle;
+	}
+
+	bool QbVkResourceManager::IsTextureReady(QbVkTextureHandle handle) {
+		return textures_.IsValid(handle) && !textures_[handle].loading;
+	}
+
+	QbVkTextureHandle QbVkResourceManager::LoadStreamedTexture(const char* imagePath, VkSamplerCreateInfo* samplerInfo) {
+		auto handle = CreatePlaceholderTexture();
+		textureStreamer_->Register(handle, imagePath, samplerInfo);
+		return handle;
+	}
+
+	QbVkTextureHandle QbVkResourceManager::LoadStreamedTexture(const unsigned char* encoded, size_t size, VkSamplerCreateInfo* samplerInfo) {
+		auto handle = CreatePlaceholderTexture();
+		textureStreamer_->Register(handle, encoded, size, samplerInfo);
+		return handle;
+	}
+
+	QbVkTextureHandle QbVkResourceManager::AcquireTexture(const char* imagePath, VkSamplerCreateInfo* samplerInfo) {
+		TextureSource source{ imagePath, 0, 0, samplerInfo != nullptr, samplerInfo != nullptr ? *samplerInfo : VkSamplerCreateInfo{} };
+		auto key = GetTextureCacheKey(Hash::FNV1a(imagePath, strlen(imagePath)), samplerInfo);
+		auto handle = AcquireCachedTexture(key, source);
+		if (handle != QBVK_TEXTURE_NULL_HANDLE) return handle;
+
+		handle = LoadStreamedTexture(imagePath, samplerInfo);
+		AddCachedTexture(key, source, handle);
+		return handle;
+	}
+
+	QbVkTextureHandle QbVkResourceManager::AcquireTexture(const unsigned char* encoded, size_t size, VkSamplerCreateInfo* samplerInfo) {
+		// Embedded images are identified by their content, so copies in different models are shared as well
+		const auto contentHash = Hash::FNV1a(encoded, size);
+		TextureSource source{ {}, size, contentHash, samplerInfo != nullptr, samplerInfo != nullptr ? *samplerInfo : VkSamplerCreateInfo{} };
+		auto key = GetTextureCacheKey(contentHash, samplerInfo);
+		auto handle = AcquireCachedTexture(key, source);
+		if (handle != QBVK_TEXTURE_NULL_HANDLE) return handle;
+
+		handle = LoadStreamedTexture(encoded, size, samplerInfo);
+		AddCachedTexture(key, source, handle);
+		return handle;
+	}
+
+	void QbVkResourceManager::ReleaseTexture(QbVkTextureHandle handle) {
+		auto keyIt = textureCacheKeys_.find(handle.index);
+		if (keyIt == textureCacheKeys_.end()) {
+			// Not shared, the caller was the only owner
+			if (textures_.IsValid(handle)) DestroyResource<QbVkTexture>(handle);
+			return;
+		}
+
+		auto& cached = textureCache_[keyIt->second];
+		QB_ASSERT(cached.handle == handle && cached.refCount > 0);
+		if (--cached.refCount == 0) DestroyResource<QbVkTexture>(handle);
+	}
+
+	uint64_t QbVkResourceManager::GetTextureCacheKey(uint64_t sourceHash, const VkSamplerCreateInfo* samplerInfo) {
+		if (samplerInfo == nullptr) return sourceHash;
+
+		// The fields are hashed one by one, the struct has padding and a pNext pointer
+		auto hash = Hash::Combine(sourceHash, samplerInfo->magFilter);
+		hash = Hash::Combine(hash, samplerInfo->minFilter);
+		hash = Hash::Combine(hash, samplerInfo->mipmapMode);
+		hash = Hash::Combine(hash, samplerInfo->addressModeU);
+		hash = Hash::Combine(hash, samplerInfo->addressModeV);
+		hash = Hash::Combine(hash, samplerInfo->addressModeW);
+		hash = Hash::Combine(hash, samplerInfo->mipLodBias);
+		hash = Hash::Combine(hash, samplerInfo->anisotropyEnable);
+		hash = Hash::Combine(hash, samplerInfo->maxAnisotropy);
+		hash = Hash::Combine(hash, samplerInfo->compareEnable);
+		hash = Hash::Combine(hash, samplerInfo->compareOp);
+		hash = Hash::Combine(hash, samplerInfo->minLod);
+		hash = Hash::Combine(hash, samplerInfo->maxLod);
+		hash = Hash::Combine(hash, samplerInfo->borderColor);
+		return Hash::Combine(hash, samplerInfo->unnormalizedCoordinates);
+	}
+
+	bool QbVkResourceManager::TextureSource::Matches(const TextureSource& other) const {
+		if (path != other.path || size != other.size || contentHash != other.contentHash || hasSampler != other.hasSampler) return false;
+		if (!hasSampler) return true;
+
+		// Compared field by field, like they're hashed in GetTextureCacheKey
+		const auto& a = sampler;
+		const auto& b = other.sampler;
+		return a.magFilter == b.magFilter && a.minFilter == b.minFilter && a.mipmapMode == b.mipmapMode &&
+			a.addressModeU == b.addressModeU && a.addressModeV == b.addressModeV && a.addressModeW == b.addressModeW &&
+			a.mipLodBias == b.mipLodBias && a.anisotropyEnable == b.anisotropyEnable && a.maxAnisotropy == b.maxAnisotropy &&
+			a.compareEnable == b.compareEnable && a.compareOp == b.compareOp && a.minLod == b.minLod && a.maxLod == b.maxLod &&
+			a.borderColor == b.borderColor && a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+	}
+
+	QbVkTextureHandle QbVkResourceManager::AcquireCachedTexture(uint64_t& key, const TextureSource& source) {
+		for (auto it = textureCache_.find(key); it != textureCache_.end(); it = textureCache_.find(++key)) {
+			if (!it->second.source.Matches(source)) continue;
+
+			it->second.refCount++;
+			return it->second.handle;
+		}
+		return QBVK_TEXTURE_NULL_HANDLE;
+	}
+
+	void QbVkResourceManager::AddCachedTexture(uint64_t key, const TextureSource& source, QbVkTextureHandle handle) {
+		textureCache_[key] = { handle, 1, source };
+		textureCacheKeys_[handle.index] = key;
+	}
+
+	void QbVkResourceManager::RemoveCachedTexture(QbVkTextureHandle handle) {
+		auto keyIt = textureCacheKeys_.find(handle.index);
+		if (keyIt == textureCacheKeys_.end()) return;
+
+		textureCache_.erase(keyIt->second);
+		textureCacheKeys_.erase(keyIt);
+	}
+
+	void QbVkResourceManager::RequestTextureResolution(QbVkTextureHandle handle, float resolution) {
+		textureStreamer_->RequestResolution(handle, resolution);
+	}
+
+	void QbVkResourceManager::SetTextureStreamingBudget(VkDeviceSize budget) {
+		textureStreamer_->SetBudget(budget);
+	}
+
+	QbVkTextureHandle QbVkResourceManager::CreatePlaceholderTexture() {
+		// Borrow the descriptor of the empty texture, so the handle can be bound safely while loading
+		auto emptyDescriptor = textures_[GetEmptyTexture()].descriptor;
+
+		auto handle = textures_.GetNextHandle();
+		auto& texture = textures_[handle];
+		texture.descriptor = emptyDescriptor;
+		texture.loading = true;
+		texture.placeholder = true;
+		return handle;
+	}
+
+	void QbVkResourceManager::RecordTextureUploads(VkCommandBuffer commandBuffer, eastl::vector<QbVkTextureUpload>& uploads) {
+		struct RecordedUpload {
+			const QbVkTextureUpload* upload;
+			VkImage image;
+			uint32_t mipLevels;
+			// Whether the chain is blitted from the first level, as opposed to copied in from the staging buffer
+			bool generated;
+		};
+		eastl::vector<RecordedUpload> recorded;
+		eastl::vector<VkImageMemoryBarrier> barriers;
+		uint32_t maxMipLevels = 1;
+
+		const auto imageBarrier = [](VkImage image, uint32_t baseMipLevel, uint32_t levelCount, VkImageLayout oldLayout, VkImageLayout newLayout,
+			VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask) {
+			VkImageMemoryBarrier barrier = VkUtils::Init::ImageMemoryBarrier();
+			barrier.oldLayout = oldLayout;
+			barrier.newLayout = newLayout;
+			barrier.srcAccessMask = srcAccessMask;
+			barrier.dstAccessMask = dstAccessMask;
+			barrier.image = image;
+			barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, baseMipLevel, levelCount, 0, 1 };
+			return barrier;
+		};
+
+		for (auto& upload : uploads) {
+			// The texture was destroyed while loading, nothing has been submitted yet so the staging can go now
+			if (!textures_.IsValid(upload.handle)) {
+				context_.allocator->DestroyBuffer(upload.stagingBuffer);
+				continue;
+			}
+			auto& texture = textures_[upload.handle];
+			texture.loading = false;
+			if (upload.streamed) textureStreamer_->OnUploaded(upload);
+			// Failed to decode, it keeps the placeholder (or its current image)
+			if (upload.stagingBuffer.buf == VK_NULL_HANDLE) continue;
+
+			// Streaming replaces the image of a live texture, the old one stays alive until no frame in flight can use it
+			if (!texture.placeholder && texture.image.imgHandle != VK_NULL_HANDLE) {
+				context_.deletionQueue->DestroyImage(texture.image);
+				context_.deletionQueue->DestroyImageView(texture.descriptor.imageView);
+				context_.deletionQueue->DestroySampler(texture.descriptor.sampler);
+				texture.image = QbVkImage{};
+			}
+
+			const bool generated = upload.levels.empty() && upload.generateMipmaps && linearBlitSupported_;
+			const auto mipLevels = !upload.levels.empty() ? static_cast<uint32_t>(upload.levels.size()) :
+				generated ? VkUtils::GetMipLevels(upload.width, upload.height) : 1;
+			VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+			if (generated) usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+			auto imageCreateInfo = VkUtils::Init::ImageCreateInfo(upload.width, upload.height, upload.format, VK_IMAGE_TILING_OPTIMAL,
+				usage, VK_SAMPLE_COUNT_1_BIT, mipLevels);
+			context_.allocator->CreateImage(texture.image, imageCreateInfo, QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY);
+
+			barriers.push_back(imageBarrier(texture.image.imgHandle, 0, mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				0, VK_ACCESS_TRANSFER_WRITE_BIT));
+			recorded.push_back({ &upload, texture.image.imgHandle, mipLevels, generated });
+			maxMipLevels = eastl::max(maxMipLevels, mipLevels);
+		}
+		if (recorded.empty()) return;
+
+		// Every level goes into the transfer layout in one batch, then the first level (or every precomputed level) is copied
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+			static_cast<uint32_t>(barriers.size()), barriers.data());
+
+		eastl::vector<VkBufferImageCopy> copyRegions;
+		for (const auto& entry : recorded) {
+			copyRegions.clear();
+			if (entry.upload->levels.empty()) {
+				VkBufferImageCopy copyRegion{};
+				copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+				copyRegion.imageExtent = { entry.upload->width, entry.upload->height, 1 };
+				copyRegions.push_back(copyRegion);
+			}
+			for (uint32_t level = 0; level < entry.upload->levels.size(); level++) {
+				VkBufferImageCopy copyRegion{};
+				copyRegion.bufferOffset = entry.upload->levels[level].offset;
+				copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+				copyRegion.imageExtent = { entry.upload->levels[level].width, entry.upload->levels[level].height, 1 };
+				copyRegions.push_back(copyRegion);
+			}
+			vkCmdCopyBufferToImage(commandBuffer, entry.upload->stagingBuffer.buf, entry.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+		}
+
+		// The chains are generated level by level across all images, so each level costs one barrier batch.
+		// Level n - 1 becomes a transfer source and is blitted into level n
+		for (uint32_t level = 1; level < maxMipLevels; level++) {
+			barriers.clear();
+			for (const auto& entry : recorded) {
+				if (!entry.generated || level >= entry.mipLevels) continue;
+				barriers.push_back(imageBarrier(entry.image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT));
+			}
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+				static_cast<uint32_t>(barriers.size()), barriers.data());
+
+			for (const auto& entry : recorded) {
+				if (!entry.generated || level >= entry.mipLevels) continue;
+				const auto srcWidth = static_cast<int32_t>(eastl::max(entry.upload->width >> (level - 1), 1u));
+				const auto srcHeight = static_cast<int32_t>(eastl::max(entry.upload->height >> (level - 1), 1u));
+				VkImageBlit blit{};
+				blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1 };
+				blit.srcOffsets[1] = { srcWidth, srcHeight, 1 };
+				blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+				blit.dstOffsets[1] = { eastl::max(srcWidth / 2, 1), eastl::max(srcHeight / 2, 1), 1 };
+				vkCmdBlitImage(commandBuffer, entry.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, entry.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					1, &blit, VK_FILTER_LINEAR);
+			}
+		}
+
+		// All but the last level of each generated chain are now transfer sources, copied chains are still transfer destinations
+		barriers.clear();
+		for (const auto& entry : recorded) {
+			if (!entry.generated) {
+				barriers.push_back(imageBarrier(entry.image, 0, entry.mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+				continue;
+			}
+			if (entry.mipLevels > 1) {
+				barriers.push_back(imageBarrier(entry.image, 0, entry.mipLevels - 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT));
+			}
+			barriers.push_back(imageBarrier(entry.image, entry.mipLevels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+		}
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+			static_cast<uint32_t>(barriers.size()), barriers.data());
+
+		for (const auto& entry : recorded) {
+			auto& texture = textures_[entry.upload->handle];
+			texture.descriptor.imageView = VkUtils::CreateImageView(context_, entry.image, entry.upload->format, VK_IMAGE_ASPECT_COLOR_BIT,
+				VK_IMAGE_VIEW_TYPE_2D, entry.mipLevels);
+			texture.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			texture.descriptor.sampler = VK_NULL_HANDLE;
+			if (entry.upload->hasSampler) CreateSampler(entry.upload->format, entry.upload->samplerInfo, texture.descriptor.sampler);
+			texture.placeholder = false;
+			texture.version++;
+		}
+	}
+
 	QbVkTextureHandle QbVkResourceManager::GetEmptyTexture() {
 		if (emptyTexture_ != QBVK_TEXTURE_NULL_HANDLE) return emptyTexture_;
 
@@ -275,7 +860,7 @@ namespace Quadbit {
 		// so when the user starts requesting descriptor sets to be written we 
 		// hand out handles of pre-allocated descriptor sets
 		for (uint32_t i = 0; i < maxInstances; i++) {
-			auto& sets = allocator.setInstances.elements[i];
+			auto& sets = allocator.setInstances.At(i);
 			eastl::vector<VkDescriptorSetLayout> layouts;
 
 			for (const auto& setLayout : setLayouts) {
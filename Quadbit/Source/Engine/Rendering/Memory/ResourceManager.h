@@ -1,29 +1,43 @@
 #pragma once
 
 #include <cstdint>
+#include <mutex>
 
 #include <EASTL/array.h>
 #include <EASTL/fixed_vector.h>
+#include <EASTL/hash_map.h>
+#include <EASTL/hash_set.h>
 #include <EASTL/string.h>
 #include <EASTL/type_traits.h>
+#include <EASTL/unique_ptr.h>
+#include <EASTL/vector.h>
 
 #include "Engine/Rendering/VulkanTypes.h"
+#include "Engine/Rendering/Memory/DeletionQueue.h"
+#include "Engine/Rendering/Memory/GeometryArena.h"
+#include "Engine/Rendering/Memory/TextureLoader.h"
+#include "Engine/Rendering/Memory/TextureStreamer.h"
 #include "Engine/Rendering/Pipelines/Pipeline.h"
 
 constexpr size_t MAX_TRANSFERS_PER_FRAME = 1024;
-constexpr size_t MAX_BUFFER_COUNT = 65536;
-constexpr size_t MAX_TEXTURE_COUNT = 512;
 constexpr size_t MAX_DESCRIPTOR_INSTANCES = 128;
 constexpr size_t MAX_PIPELINES = 128;
+constexpr VkDeviceSize DEFAULT_VERTEX_ARENA_SIZE = 64 * 1024 * 1024;
+constexpr VkDeviceSize DEFAULT_INDEX_ARENA_SIZE = 32 * 1024 * 1024;
 
 namespace Quadbit {
 	// Handles all buffer transfers submitted during the frame in one commandbuffer,
-	// and signals a semaphore that is waited on by the final queue submit
+	// and signals a semaphore that is waited on by the final queue submit.
+	// Transfers are ranges into the destination buffers, the data is kept host side
+	// until the frame is submitted so adjacent ranges can be merged into a single copy.
+	// Transfers may be queued from any thread
 	struct PerFrameTransfers {
 		uint32_t count;
-		eastl::array<QbVkBuffer, MAX_TRANSFERS_PER_FRAME> stagingBuffers{};
+		eastl::vector<unsigned char> data;
 		eastl::array<QbVkTransfer, MAX_TRANSFERS_PER_FRAME> transfers{};
+		QbVkBuffer stagingBuffer{};
 		VkCommandBuffer commandBuffer;
+		std::mutex mutex;
 
 		PerFrameTransfers(const QbVkContext& context);
 
@@ -33,6 +47,7 @@ namespace Quadbit {
 
 		void Reset() { 
 			count = 0; 
+			data.clear();
 		}
 	};
 
@@ -44,17 +59,32 @@ namespace Quadbit {
 		QbVkPipelineHandle CreateGraphicsPipeline(const char* vertexPath, const char* vertexEntry,
 			const char* fragmentPath, const char* fragmentEntry, const QbVkPipelineDescription pipelineDescription,
 			const VkRenderPass renderPass, const uint32_t maxInstances = 1, 
-			const eastl::vector<eastl::tuple<VkFormat, uint32_t>>& vertexAttributeOverride = {});
+			const eastl::vector<eastl::tuple<VkFormat, uint32_t>>& vertexAttributeOverride = {}, const QbVkShaderDefines& defines = {},
+			const QbVkSpecialization& vertexSpecialization = {}, const QbVkSpecialization& fragmentSpecialization = {});
 		QbVkPipelineHandle CreateComputePipeline(const char* computePath, const char* computeEntry,
-			const void* specConstants = nullptr, const uint32_t maxInstances = 1);
+			const QbVkSpecialization& specialization = {}, const uint32_t maxInstances = 1, const QbVkShaderDefines& defines = {});
 		void RebuildPipelines();
+		// Recreates the pipelines made for one render pass against another, from the compiler's cached SPIR-V
+		void RebuildPipelines(VkRenderPass previousRenderPass, VkRenderPass renderPass);
+		// Recompiles changed shaders in the background, and swaps in the pipelines using them once they're done.
+		// Call at a frame boundary, the old pipelines are released through the deletion queue
+		void ReloadChangedShaders();
 
-		void TransferDataToGPU(const void* data, VkDeviceSize size, QbVkBufferHandle destination);
+		void TransferDataToGPU(const void* data, VkDeviceSize size, QbVkBufferHandle destination, VkDeviceSize dstOffset = 0);
 		bool TransferQueuedDataToGPU(uint32_t resourceIndex);
 
-		QbVkBufferHandle CreateGPUBuffer(VkDeviceSize size, VkBufferUsageFlags bufferUsage, QbVkMemoryUsage memoryUsage);
+		QbVkBufferHandle CreateGPUBuffer(VkDeviceSize size, VkBufferUsageFlags bufferUsage, QbVkMemoryUsage memoryUsage,
+			QbVkAllocationTag tag = QbVkAllocationTag::QBVK_ALLOCATION_TAG_BUFFER);
 		QbVkBufferHandle CreateVertexBuffer(const void* vertices, uint32_t vertexStride, uint32_t vertexCount);
 		QbVkBufferHandle CreateIndexBuffer(const eastl::vector<uint32_t>& indices);
+
+		// Mesh geometry is sub-allocated from shared arenas, one set of arenas per vertex stride
+		// and one for indices, so meshes can be drawn without rebinding buffers.
+		// Streamed geometry, which is freed and reallocated all the time, instead gets a dedicated buffer
+		// from the buddy pools so the churn doesn't fragment the arenas
+		QbVkMeshAllocation AllocateVertices(const void* vertices, uint32_t vertexStride, uint32_t vertexCount, bool streamed = false);
+		QbVkMeshAllocation AllocateIndices(const eastl::vector<uint32_t>& indices, bool streamed = false);
+		void FreeMeshAllocation(const QbVkMeshAllocation& allocation);
 		
 		template<typename T>
 		QbVkUniformBuffer<T> CreateUniformBuffer() {
@@ -82,9 +112,30 @@ namespace Quadbit {
 		QbVkTextureHandle CreateTexture(uint32_t width, uint32_t height, VkSamplerCreateInfo* samplerInfo = nullptr);
 		QbVkTextureHandle CreateTexture(VkImageCreateInfo* imageInfo, VkImageAspectFlags aspectFlags,
 			VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VkSamplerCreateInfo* samplerInfo = nullptr);
+		// Returns QBVK_TEXTURE_NULL_HANDLE if the device can't use the format for storage images
 		QbVkTextureHandle CreateStorageTexture(uint32_t width, uint32_t height, VkFormat format, VkSamplerCreateInfo* samplerInfo = nullptr);
-		QbVkTextureHandle LoadTexture(uint32_t width, uint32_t height, const void* data, VkSamplerCreateInfo* samplerInfo = nullptr);
+		// Loaded textures get a full mip chain unless disabled, the sampler maxLod decides how much of it is used
+		QbVkTextureHandle LoadTexture(uint32_t width, uint32_t height, const void* data, VkSamplerCreateInfo* samplerInfo = nullptr,
+			bool generateMipmaps = true);
 		QbVkTextureHandle LoadTexture(const char* imagePath, VkSamplerCreateInfo* samplerInfo = nullptr);
+		// Returns right away, the image is decoded on a worker thread and uploaded with a later frame transfer.
+		// Until then the handle refers to the empty texture, descriptors should be written once IsTextureReady
+		QbVkTextureHandle LoadTextureAsync(const char* imagePath, VkSamplerCreateInfo* samplerInfo = nullptr);
+		QbVkTextureHandle LoadTextureAsync(const unsigned char* encoded, size_t size, VkSamplerCreateInfo* samplerInfo = nullptr);
+		bool IsTextureReady(QbVkTextureHandle handle);
+		// Like LoadTextureAsync, but only the low mips are loaded at first. The rest is streamed in and out
+		// within the streaming budget, based on the resolutions requested for the texture
+		QbVkTextureHandle LoadStreamedTexture(const char* imagePath, VkSamplerCreateInfo* samplerInfo = nullptr);
+		QbVkTextureHandle LoadStreamedTexture(const unsigned char* encoded, size_t size, VkSamplerCreateInfo* samplerInfo = nullptr);
+		// The number of texels needed across the texture this frame, see QbVkTextureStreamer
+		void RequestTextureResolution(QbVkTextureHandle handle, float resolution);
+		void SetTextureStreamingBudget(VkDeviceSize budget);
+		// Shared, ref counted versions of LoadStreamedTexture. Textures are keyed by path, or by the hash of the encoded data,
+		// together with the sampler, so loading the same image twice returns the same handle
+		QbVkTextureHandle AcquireTexture(const char* imagePath, VkSamplerCreateInfo* samplerInfo = nullptr);
+		QbVkTextureHandle AcquireTexture(const unsigned char* encoded, size_t size, VkSamplerCreateInfo* samplerInfo = nullptr);
+		// Drops a reference taken by AcquireTexture, the texture is destroyed along with the last one
+		void ReleaseTexture(QbVkTextureHandle handle);
 		QbVkTextureHandle GetEmptyTexture();
 
 		QbVkDescriptorAllocatorHandle CreateDescriptorAllocator(const eastl::vector<VkDescriptorSetLayout>& setLayouts,
@@ -98,20 +149,31 @@ namespace Quadbit {
 
 		template<typename T>
 		void DestroyResource(QbVkResourceHandle<T> handle) {
+			// The handle is released right away, the GPU objects once no frame in flight can use them
 			if constexpr (eastl::is_same<T, QbVkBuffer>::value) {
-				context_.allocator->DestroyBuffer(buffers_[handle]);
+				// Transfers to the buffer may be queued from other threads
+				std::lock_guard<std::mutex> lock(transferQueue_.mutex);
+				context_.deletionQueue->DestroyBuffer(buffers_[handle]);
+				buffers_[handle] = QbVkBuffer{};
 				buffers_.DestroyResource(handle);
 			}
 			else if constexpr (eastl::is_same<T, QbVkTexture>::value) {
 				QbVkTexture& texture = textures_[handle];
-				context_.allocator->DestroyImage(texture.image);
-				if (texture.descriptor.imageView != VK_NULL_HANDLE) vkDestroyImageView(context_.device, texture.descriptor.imageView, nullptr);
-				if (texture.descriptor.sampler != VK_NULL_HANDLE) vkDestroySampler(context_.device, texture.descriptor.sampler, nullptr);
+				if (textureStreamer_ != nullptr) textureStreamer_->Unregister(handle);
+				RemoveCachedTexture(handle);
+				context_.deletionQueue->DestroyImage(texture.image);
+				// A load still in flight is dropped once it finds its handle invalid
+				if (!texture.placeholder) {
+					context_.deletionQueue->DestroyImageView(texture.descriptor.imageView);
+					context_.deletionQueue->DestroySampler(texture.descriptor.sampler);
+				}
+				texture = QbVkTexture{};
 				textures_.DestroyResource(handle);
 			}
 			else if constexpr (eastl::is_same<T, QbVkDescriptorAllocator>::value) {
 				QbVkDescriptorAllocator& allocator = descriptorAllocators_[handle];
-				vkDestroyDescriptorPool(context_.device, allocator.pool, nullptr);
+				context_.deletionQueue->DestroyDescriptorPool(allocator.pool);
+				allocator.pool = VK_NULL_HANDLE;
 				descriptorAllocators_.DestroyResource(handle);
 			}
 		}
@@ -133,15 +195,74 @@ namespace Quadbit {
 		}
 
 
-		QbVkResource<QbVkBuffer, MAX_BUFFER_COUNT> buffers_;
-		QbVkResource<QbVkTexture, MAX_TEXTURE_COUNT> textures_;
+		QbVkResource<QbVkBuffer> buffers_;
+		QbVkResource<QbVkTexture> textures_;
 		QbVkResource<QbVkDescriptorAllocator, MAX_DESCRIPTOR_INSTANCES> descriptorAllocators_;
 		QbVkResource<eastl::unique_ptr<QbVkPipeline>, MAX_PIPELINES> pipelines_;
 
 	private:
 		QbVkContext& context_;
 		PerFrameTransfers transferQueue_;
+		eastl::unique_ptr<QbVkTextureLoader> textureLoader_;
+		eastl::unique_ptr<QbVkTextureStreamer> textureStreamer_;
+		// Guards the geometry arenas, which worker threads allocate from
+		std::mutex arenaMutex_;
 		QbVkTextureHandle emptyTexture_ = QBVK_TEXTURE_NULL_HANDLE;
+		// Mip chains are generated with linear blits, which the texture format has to support
+		bool linearBlitSupported_ = false;
+		// Pipelines with a rebuild queued. Recounted on every ReloadChangedShaders rather than kept
+		// up to date, since RebuildPipelines may finish a queued reload in between
+		uint32_t reloadingPipelines_ = 0;
+		// Pipelines whose shaders changed while they were still reloading, reloaded again once that's done
+		struct DeferredReload {
+			QbVkPipelineHandle pipeline;
+			eastl::string path;
+		};
+		eastl::vector<DeferredReload> deferredReloads_;
+
+		eastl::hash_map<uint32_t, eastl::vector<QbVkGeometryArena>> vertexArenas_;
+		eastl::vector<QbVkGeometryArena> indexArenas_;
+		// Handle indices of the dedicated buffers of streamed mesh allocations
+		eastl::hash_set<uint32_t> streamedMeshBuffers_;
+
+		// What a cached texture was loaded from, compared on every hit as the cache key is only a hash of it.
+		// Images are identified by path, or by the size and hash of their encoded data
+		struct TextureSource {
+			eastl::string path;
+			size_t size = 0;
+			uint64_t contentHash = 0;
+			bool hasSampler = false;
+			VkSamplerCreateInfo sampler{};
+
+			bool Matches(const TextureSource& other) const;
+		};
+		struct CachedTexture {
+			QbVkTextureHandle handle;
+			uint32_t refCount;
+			TextureSource source;
+		};
+		eastl::hash_map<uint64_t, CachedTexture> textureCache_;
+		// Cache key of each cached texture by handle index
+		eastl::hash_map<uint32_t, uint64_t> textureCacheKeys_;
+
+		void RecordBufferTransfers();
+		// Creates the images of the uploads and records all copies and layout transitions into the command buffer,
+		// uploads whose handle has since been destroyed get their staging buffer freed and are skipped
+		void RecordTextureUploads(VkCommandBuffer commandBuffer, eastl::vector<QbVkTextureUpload>& uploads);
+		QbVkTextureHandle CreatePlaceholderTexture();
+		uint64_t GetTextureCacheKey(uint64_t sourceHash, const VkSamplerCreateInfo* samplerInfo);
+		// Colliding sources are stored under the next free key, on a miss the key is left at the free one for AddCachedTexture
+		QbVkTextureHandle AcquireCachedTexture(uint64_t& key, const TextureSource& source);
+		void AddCachedTexture(uint64_t key, const TextureSource& source, QbVkTextureHandle handle);
+		void RemoveCachedTexture(QbVkTextureHandle handle);
+		// Clears every level of a freshly created colour image and transitions it to the final layout
+		void ClearImage(VkImage image, VkImageLayout finalLayout, VkPipelineStageFlags dstStage);
+		// Falls back to nearest filtering when the format can't be filtered linearly
+		void CreateSampler(VkFormat format, VkSamplerCreateInfo samplerInfo, VkSampler& sampler);
+
+		QbVkMeshAllocation AllocateFromArenas(eastl::vector<QbVkGeometryArena>& arenas, uint32_t elementSize,
+			uint32_t count, VkDeviceSize arenaSize, VkBufferUsageFlags usage);
+		QbVkMeshAllocation AllocateStreamed(uint32_t elementSize, uint32_t count, VkBufferUsageFlags usage);
 
 		uint32_t GetUniformBufferAlignment(uint32_t structSize);
 		QbVkBufferHandle CreateUniformBuffer(uint32_t alignedSize);
@@ -0,0 +1,210 @@
+#include "TextureLoader.h"
+
+#include <cstdio>
+
+#include <EASTL/algorithm.h>
+
+#include <stb/stb_image.h>
+
+#include "Engine/Core/Logging.h"
+#include "Engine/Rendering/Memory/Allocator.h"
+#include "Engine/Rendering/Textures/BlockCompression.h"
+#include "Engine/Rendering/Textures/Mipmaps.h"
+
+namespace Quadbit {
+	QbVkTextureLoader::QbVkTextureLoader(QbVkContext& context) : context_(context) {
+		// Leave a core for the main thread
+		const auto hardwareThreads = std::thread::hardware_concurrency();
+		const auto workerCount = eastl::clamp(hardwareThreads > 1 ? hardwareThreads - 1 : 1u, 1u, MAX_TEXTURE_LOADER_THREADS);
+		for (uint32_t i = 0; i < workerCount; i++) {
+			workers_.push_back(std::thread(&QbVkTextureLoader::WorkerLoop, this));
+		}
+	}
+
+	QbVkTextureLoader::~QbVkTextureLoader() {
+		{
+			std::lock_guard<std::mutex> lock(requestMutex_);
+			stopping_ = true;
+			requests_.clear();
+		}
+		requestCondition_.notify_all();
+		for (auto& worker : workers_) {
+			worker.join();
+		}
+
+		// Uploads that were never collected have not been submitted, so the staging buffers can go right away
+		for (auto& upload : uploads_) {
+			context_.allocator->DestroyBuffer(upload.stagingBuffer);
+		}
+	}
+
+	void QbVkTextureLoader::Enqueue(QbVkTextureHandle handle, const char* path, const VkSamplerCreateInfo* samplerInfo,
+		const QbVkTextureStreamingInfo* streaming) {
+		Request request{ handle, path, {}, samplerInfo != nullptr, samplerInfo != nullptr ? *samplerInfo : VkSamplerCreateInfo{},
+			streaming != nullptr, streaming != nullptr ? *streaming : QbVkTextureStreamingInfo{} };
+		Enqueue(eastl::move(request));
+	}
+
+	void QbVkTextureLoader::Enqueue(QbVkTextureHandle handle, const unsigned char* encoded, size_t size, const VkSamplerCreateInfo* samplerInfo,
+		const QbVkTextureStreamingInfo* streaming) {
+		Request request{ handle, {}, eastl::vector<unsigned char>(encoded, encoded + size),
+			samplerInfo != nullptr, samplerInfo != nullptr ? *samplerInfo : VkSamplerCreateInfo{},
+			streaming != nullptr, streaming != nullptr ? *streaming : QbVkTextureStreamingInfo{} };
+		Enqueue(eastl::move(request));
+	}
+
+	void QbVkTextureLoader::Enqueue(Request&& request) {
+		pendingCount_.fetch_add(1, std::memory_order_acq_rel);
+		{
+			std::lock_guard<std::mutex> lock(requestMutex_);
+			requests_.push_back(eastl::move(request));
+		}
+		requestCondition_.notify_one();
+	}
+
+	void QbVkTextureLoader::CollectUploads(eastl::vector<QbVkTextureUpload>& uploads, bool includeReplacements) {
+		std::lock_guard<std::mutex> lock(uploadMutex_);
+
+		// Always take at least one upload so a single huge texture can't stall the queue
+		VkDeviceSize size = 0;
+		for (auto it = uploads_.begin(); it != uploads_.end();) {
+			if (it->replace && !includeReplacements) {
+				++it;
+				continue;
+			}
+
+			const auto uploadSize = it->stagingBuffer.alloc.size;
+			if (size > 0 && size + uploadSize > MAX_TEXTURE_UPLOAD_SIZE_PER_FRAME) break;
+
+			size += uploadSize;
+			uploads.push_back(eastl::move(*it));
+			it = uploads_.erase(it);
+			pendingCount_.fetch_sub(1, std::memory_order_acq_rel);
+		}
+	}
+
+	void QbVkTextureLoader::WorkerLoop() {
+		while (true) {
+			Request request;
+			{
+				std::unique_lock<std::mutex> lock(requestMutex_);
+				requestCondition_.wait(lock, [&]() { return stopping_ || !requests_.empty(); });
+				if (stopping_) return;
+
+				request = eastl::move(requests_.front());
+				requests_.pop_front();
+			}
+			Decode(request);
+		}
+	}
+
+	void QbVkTextureLoader::Decode(Request& request) {
+		const char* name = request.path.empty() ? "from memory" : request.path.c_str();
+
+		// Files are read up front so containers can be told apart from regular images
+		if (!request.path.empty()) {
+			FILE* file = fopen(request.path.c_str(), "rb");
+			if (file != nullptr) {
+				fseek(file, 0, SEEK_END);
+				const auto size = ftell(file);
+				if (size > 0) {
+					request.encoded.resize(static_cast<size_t>(size));
+					fseek(file, 0, SEEK_SET);
+					request.encoded.resize(fread(request.encoded.data(), 1, request.encoded.size(), file));
+				}
+				else if (size < 0) {
+					QB_LOG_WARN("Failed to get the size of %s\n", name);
+				}
+				fclose(file);
+			}
+		}
+
+		QbVkTextureUpload upload{};
+		upload.handle = request.handle;
+		upload.hasSampler = request.hasSampler;
+		upload.samplerInfo = request.samplerInfo;
+		upload.streamed = request.streamed;
+		upload.replace = request.streaming.replace;
+
+		// A texture that fails to decode is still handed back so its handle gets resolved,
+		// it simply keeps the placeholder
+		if (TextureContainer::IsContainer(request.encoded.data(), request.encoded.size())) {
+			if (!DecodeContainer(request.encoded, request.streaming.maxSize, upload)) {
+				QB_LOG_WARN("Failed to load texture container %s\n", name);
+			}
+		}
+		else {
+			int width, height, channels;
+			stbi_uc* pixels = stbi_load_from_memory(request.encoded.data(), static_cast<int>(request.encoded.size()), &width, &height, &channels, STBI_rgb_alpha);
+			if (pixels == nullptr) {
+				QB_LOG_WARN("Failed to decode texture %s: %s\n", name, stbi_failure_reason());
+			}
+			else {
+				upload.sourceWidth = upload.width = static_cast<uint32_t>(width);
+				upload.sourceHeight = upload.height = static_cast<uint32_t>(height);
+				upload.generateMipmaps = true;
+
+				// Halve the image until it fits the streaming cap, the rest of the chain is blitted on the GPU as usual
+				eastl::vector<uint8_t> downsampled;
+				const auto maxSize = request.streaming.maxSize;
+				while (maxSize > 0 && eastl::max(upload.width, upload.height) > maxSize) {
+					downsampled = Mipmaps::Downsample(downsampled.empty() ? pixels : downsampled.data(), upload.width, upload.height);
+					upload.width = eastl::max(upload.width / 2, 1u);
+					upload.height = eastl::max(upload.height / 2, 1u);
+					upload.baseMip++;
+				}
+
+				const auto size = static_cast<VkDeviceSize>(upload.width) * static_cast<VkDeviceSize>(upload.height) * 4;
+				context_.allocator->CreateStagingBuffer(upload.stagingBuffer, size, downsampled.empty() ? pixels : downsampled.data(), "Texture staging");
+				stbi_image_free(pixels);
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(uploadMutex_);
+		uploads_.push_back(eastl::move(upload));
+	}
+
+	bool QbVkTextureLoader::DecodeContainer(const eastl::vector<unsigned char>& data, uint32_t maxSize, QbVkTextureUpload& upload) {
+		QbVkTextureContainer container;
+		if (!TextureContainer::Parse(data.data(), data.size(), container)) return false;
+
+		// The levels above the streaming cap are simply skipped, the smallest level is always kept
+		upload.sourceWidth = container.width;
+		upload.sourceHeight = container.height;
+		while (maxSize > 0 && container.levels.size() > 1 && eastl::max(container.levels[0].width, container.levels[0].height) > maxSize) {
+			container.levels.erase(container.levels.begin());
+			upload.baseMip++;
+		}
+		container.width = container.levels[0].width;
+		container.height = container.levels[0].height;
+
+		// Without device support the levels are decoded to RGBA8 here, which costs memory but keeps the texture usable
+		const bool decode = BlockCompression::IsBlockCompressed(container.format) && !context_.gpu->features.textureCompressionBC;
+		if (decode && !BlockCompression::IsSupported(container.format)) {
+			QB_LOG_WARN("Texture format %i is not supported by the device and can't be decoded\n", container.format);
+			return false;
+		}
+
+		// The levels are packed tightly, every level size is a multiple of the block size which keeps the copy offsets aligned
+		eastl::vector<uint8_t> levelData;
+		for (const auto& level : container.levels) {
+			QbVkTextureLevel packed = level;
+			packed.offset = levelData.size();
+			if (decode) {
+				auto pixels = BlockCompression::DecodeImage(container.format, data.data() + level.offset, level.width, level.height);
+				packed.size = pixels.size();
+				levelData.insert(levelData.end(), pixels.begin(), pixels.end());
+			}
+			else {
+				levelData.insert(levelData.end(), data.begin() + level.offset, data.begin() + level.offset + level.size);
+			}
+			upload.levels.push_back(packed);
+		}
+
+		upload.width = container.width;
+		upload.height = container.height;
+		upload.format = decode ? (BlockCompression::IsSRGB(container.format) ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM) : container.format;
+		context_.allocator->CreateStagingBuffer(upload.stagingBuffer, levelData.size(), levelData.data(), "Texture staging");
+		return true;
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <EASTL/deque.h>
+#include <EASTL/string.h>
+#include <EASTL/vector.h>
+
+#include "Engine/Rendering/VulkanTypes.h"
+#include "Engine/Rendering/Textures/TextureContainer.h"
+
+constexpr uint32_t MAX_TEXTURE_LOADER_THREADS = 4;
+// Decoded textures are uploaded in batches of at most this many bytes per frame
+constexpr VkDeviceSize MAX_TEXTURE_UPLOAD_SIZE_PER_FRAME = 64 * 1024 * 1024;
+
+namespace Quadbit {
+	// Streamed textures are decoded with their largest level capped to maxSize (0 for no cap)
+	struct QbVkTextureStreamingInfo {
+		uint32_t maxSize = 0;
+		// The texture is live and its image gets replaced by the upload
+		bool replace = false;
+	};
+
+	// A decoded texture waiting in a staging buffer to be copied into its image
+	struct QbVkTextureUpload {
+		QbVkTextureHandle handle = QBVK_TEXTURE_NULL_HANDLE;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+		QbVkBuffer stagingBuffer{};
+		// Mip levels that come precomputed from a container, packed in the staging buffer.
+		// When empty the staging buffer holds a single level
+		eastl::vector<QbVkTextureLevel> levels;
+		// The rest of the chain is blitted from the first level after the copy
+		bool generateMipmaps = false;
+		bool hasSampler = false;
+		VkSamplerCreateInfo samplerInfo{};
+
+		bool streamed = false;
+		bool replace = false;
+		// Levels dropped from the top of the source to fit the streaming cap, and the size of the source
+		uint32_t baseMip = 0;
+		uint32_t sourceWidth = 0;
+		uint32_t sourceHeight = 0;
+	};
+
+	// Decodes images on a set of worker threads straight into staging buffers.
+	// The resource manager collects the finished uploads once per frame and records them
+	// into the frame transfer, so no load ever blocks on the GPU
+	class QbVkTextureLoader {
+	public:
+		QbVkTextureLoader(QbVkContext& context);
+		~QbVkTextureLoader();
+
+		void Enqueue(QbVkTextureHandle handle, const char* path, const VkSamplerCreateInfo* samplerInfo,
+			const QbVkTextureStreamingInfo* streaming = nullptr);
+		// Encoded image data (png, jpg etc.), the data is copied
+		void Enqueue(QbVkTextureHandle handle, const unsigned char* encoded, size_t size, const VkSamplerCreateInfo* samplerInfo,
+			const QbVkTextureStreamingInfo* streaming = nullptr);
+
+		// Moves finished uploads into the list, up to the per frame size budget.
+		// Uploads replacing live textures are left queued unless allowed
+		void CollectUploads(eastl::vector<QbVkTextureUpload>& uploads, bool includeReplacements = true);
+		uint32_t GetPendingCount() const { return pendingCount_.load(std::memory_order_acquire); }
+
+	private:
+		struct Request {
+			QbVkTextureHandle handle;
+			eastl::string path;
+			eastl::vector<unsigned char> encoded;
+			bool hasSampler;
+			VkSamplerCreateInfo samplerInfo;
+			bool streamed;
+			QbVkTextureStreamingInfo streaming;
+		};
+
+		QbVkContext& context_;
+		eastl::vector<std::thread> workers_;
+
+		std::mutex requestMutex_;
+		std::condition_variable requestCondition_;
+		eastl::deque<Request> requests_;
+		bool stopping_ = false;
+
+		std::mutex uploadMutex_;
+		eastl::deque<QbVkTextureUpload> uploads_;
+
+		// Requests that have not yet been collected
+		std::atomic<uint32_t> pendingCount_ = 0;
+
+		void Enqueue(Request&& request);
+		void WorkerLoop();
+		void Decode(Request& request);
+		bool DecodeContainer(const eastl::vector<unsigned char>& data, uint32_t maxSize, QbVkTextureUpload& upload);
+	};
+}
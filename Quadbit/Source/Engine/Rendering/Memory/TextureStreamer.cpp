@@ -0,0 +1,196 @@
+#include "TextureStreamer.h"
+
+#include <cmath>
+
+#include <EASTL/algorithm.h>
+#include <EASTL/sort.h>
+
+#include "Engine/Rendering/VulkanUtils.h"
+#include "Engine/Rendering/Textures/BlockCompression.h"
+
+namespace Quadbit {
+	QbVkTextureStreamer::QbVkTextureStreamer(QbVkTextureLoader& loader) : loader_(loader) {}
+
+	void QbVkTextureStreamer::Register(QbVkTextureHandle handle, const char* path, const VkSamplerCreateInfo* samplerInfo) {
+		StreamedTexture texture{ handle, path, {}, samplerInfo != nullptr, samplerInfo != nullptr ? *samplerInfo : VkSamplerCreateInfo{} };
+		Register(eastl::move(texture));
+	}
+
+	void QbVkTextureStreamer::Register(QbVkTextureHandle handle, const unsigned char* encoded, size_t size, const VkSamplerCreateInfo* samplerInfo) {
+		StreamedTexture texture{ handle, {}, eastl::vector<unsigned char>(encoded, encoded + size),
+			samplerInfo != nullptr, samplerInfo != nullptr ? *samplerInfo : VkSamplerCreateInfo{} };
+		Register(eastl::move(texture));
+	}
+
+	void QbVkTextureStreamer::Register(StreamedTexture&& texture) {
+		auto& streamed = textures_[texture.handle.index];
+		streamed = eastl::move(texture);
+		// The size isn't known yet, so the first load is capped to the initial size
+		Load(streamed, 0, false);
+	}
+
+	void QbVkTextureStreamer::Unregister(QbVkTextureHandle handle) {
+		auto it = textures_.find(handle.index);
+		if (it == textures_.end() || it->second.handle != handle) return;
+
+		// The upload of a load in flight is dropped once it finds the handle invalid
+		if (it->second.loading) loadsInFlight_--;
+		textures_.erase(it);
+	}
+
+	void QbVkTextureStreamer::RequestResolution(QbVkTextureHandle handle, float resolution) {
+		auto it = textures_.find(handle.index);
+		if (it == textures_.end() || it->second.handle != handle) return;
+
+		auto& texture = it->second;
+		if (texture.mipLevels == 0 || resolution <= 0.0f) return;
+
+		// Each level halves the resolution, the level is picked so it has at least the requested number of texels
+		const auto size = static_cast<float>(eastl::max(texture.width, texture.height));
+		const auto mip = (resolution >= size) ? 0u :
+			eastl::min(static_cast<uint32_t>(std::floor(std::log2(size / resolution))), texture.mipLevels - 1);
+
+		if (texture.lastRequestFrame != frame_) {
+			texture.requestedMip = mip;
+			texture.lastRequestFrame = frame_;
+		}
+		else {
+			texture.requestedMip = eastl::min(texture.requestedMip, mip);
+		}
+	}
+
+	void QbVkTextureStreamer::Update() {
+		frame_++;
+		if (loadsInFlight_ >= MAX_TEXTURE_STREAMING_LOADS) return;
+
+		eastl::vector<StreamedTexture*> promotions;
+		eastl::vector<StreamedTexture*> evictions;
+		for (auto& [index, texture] : textures_) {
+			if (texture.loading || texture.failed || texture.mipLevels == 0) continue;
+
+			const auto wanted = GetWantedMip(texture);
+			if (wanted < texture.residentMip) promotions.push_back(&texture);
+			else if (wanted > texture.residentMip) evictions.push_back(&texture);
+		}
+
+		// The textures furthest from the detail they need go first,
+		// and the textures that have gone the longest without being asked for are evicted first
+		eastl::sort(promotions.begin(), promotions.end(), [&](const StreamedTexture* lhs, const StreamedTexture* rhs) {
+			return lhs->residentMip - GetWantedMip(*lhs) > rhs->residentMip - GetWantedMip(*rhs);
+		});
+		eastl::sort(evictions.begin(), evictions.end(), [](const StreamedTexture* lhs, const StreamedTexture* rhs) {
+			return lhs->lastRequestFrame < rhs->lastRequestFrame;
+		});
+
+		size_t nextEviction = 0;
+		const auto evict = [&](VkDeviceSize& residentSize) {
+			auto* victim = evictions[nextEviction++];
+			const auto victimMip = GetWantedMip(*victim);
+			residentSize -= GetChainSize(*victim, victim->residentMip) - GetChainSize(*victim, victimMip);
+			Load(*victim, victimMip, true);
+		};
+
+		// The budget may have been lowered
+		auto residentSize = GetResidentSize();
+		while (residentSize > budget_ && nextEviction < evictions.size() && loadsInFlight_ < MAX_TEXTURE_STREAMING_LOADS) {
+			evict(residentSize);
+		}
+
+		for (auto* texture : promotions) {
+			if (loadsInFlight_ >= MAX_TEXTURE_STREAMING_LOADS) break;
+
+			const auto wanted = GetWantedMip(*texture);
+			const auto currentSize = GetChainSize(*texture, texture->residentMip);
+
+			// Under budget pressure, make room by dropping the top mips of textures that no longer need them
+			while (residentSize - currentSize + GetChainSize(*texture, wanted) > budget_ && nextEviction < evictions.size() &&
+				loadsInFlight_ + 1 < MAX_TEXTURE_STREAMING_LOADS) {
+				evict(residentSize);
+			}
+
+			// If it still doesn't fit, settle for the most detail that does
+			auto mip = wanted;
+			while (mip < texture->residentMip && residentSize - currentSize + GetChainSize(*texture, mip) > budget_) mip++;
+			if (mip == texture->residentMip) continue;
+
+			residentSize += GetChainSize(*texture, mip) - currentSize;
+			Load(*texture, mip, true);
+		}
+	}
+
+	bool QbVkTextureStreamer::CanReplace() const {
+		return frame_ - lastReplaceFrame_ >= MAX_FRAMES_IN_FLIGHT;
+	}
+
+	void QbVkTextureStreamer::OnUploaded(const QbVkTextureUpload& upload) {
+		auto it = textures_.find(upload.handle.index);
+		if (it == textures_.end() || it->second.handle != upload.handle) return;
+
+		auto& texture = it->second;
+		texture.loading = false;
+		loadsInFlight_--;
+
+		// A failed first load leaves nothing to stream, a failed reload keeps the current residency
+		if (upload.stagingBuffer.buf == VK_NULL_HANDLE) {
+			if (texture.mipLevels == 0) texture.failed = true;
+			return;
+		}
+
+		if (texture.mipLevels == 0) {
+			texture.format = upload.format;
+			texture.width = upload.sourceWidth;
+			texture.height = upload.sourceHeight;
+			// Containers may come with a shorter chain than a full one
+			texture.mipLevels = upload.baseMip + (upload.levels.empty() ? VkUtils::GetMipLevels(upload.width, upload.height) :
+				static_cast<uint32_t>(upload.levels.size()));
+			texture.initialMip = upload.baseMip;
+			texture.requestedMip = upload.baseMip;
+		}
+		texture.residentMip = upload.baseMip;
+		if (upload.replace) lastReplaceFrame_ = frame_;
+	}
+
+	VkDeviceSize QbVkTextureStreamer::GetResidentSize() const {
+		VkDeviceSize size = 0;
+		for (const auto& [index, texture] : textures_) {
+			if (texture.mipLevels == 0) continue;
+			// Both images are alive while a reload is in flight, count the larger one
+			size += GetChainSize(texture, texture.loading ? eastl::min(texture.residentMip, texture.targetMip) : texture.residentMip);
+		}
+		return size;
+	}
+
+	void QbVkTextureStreamer::Load(StreamedTexture& texture, uint32_t mip, bool replace) {
+		QbVkTextureStreamingInfo streaming;
+		streaming.maxSize = (texture.mipLevels == 0) ? TEXTURE_STREAMING_INITIAL_SIZE : eastl::max(eastl::max(texture.width, texture.height) >> mip, 1u);
+		streaming.replace = replace;
+
+		const auto* samplerInfo = texture.hasSampler ? &texture.samplerInfo : nullptr;
+		if (!texture.path.empty()) {
+			loader_.Enqueue(texture.handle, texture.path.c_str(), samplerInfo, &streaming);
+		}
+		else {
+			loader_.Enqueue(texture.handle, texture.encoded.data(), texture.encoded.size(), samplerInfo, &streaming);
+		}
+
+		texture.loading = true;
+		texture.targetMip = mip;
+		loadsInFlight_++;
+	}
+
+	uint32_t QbVkTextureStreamer::GetWantedMip(const StreamedTexture& texture) const {
+		// Textures that haven't been seen for a while fall back to their initial residency
+		if (texture.lastRequestFrame == 0 || frame_ - texture.lastRequestFrame > TEXTURE_STREAMING_EVICTION_DELAY) {
+			return texture.initialMip;
+		}
+		return texture.requestedMip;
+	}
+
+	VkDeviceSize QbVkTextureStreamer::GetChainSize(const StreamedTexture& texture, uint32_t mip) const {
+		VkDeviceSize size = 0;
+		for (uint32_t level = mip; level < texture.mipLevels; level++) {
+			size += BlockCompression::GetLevelSize(texture.format, eastl::max(texture.width >> level, 1u), eastl::max(texture.height >> level, 1u));
+		}
+		return size;
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <EASTL/hash_map.h>
+#include <EASTL/string.h>
+#include <EASTL/vector.h>
+
+#include "Engine/Rendering/VulkanTypes.h"
+#include "Engine/Rendering/Memory/TextureLoader.h"
+
+constexpr VkDeviceSize DEFAULT_TEXTURE_STREAMING_BUDGET = 256 * 1024 * 1024;
+// Streamed textures are first loaded with their largest level capped to this size
+constexpr uint32_t TEXTURE_STREAMING_INITIAL_SIZE = 128;
+// Frames without feedback before a texture may drop back to its initial residency
+constexpr uint64_t TEXTURE_STREAMING_EVICTION_DELAY = 120;
+constexpr uint32_t MAX_TEXTURE_STREAMING_LOADS = 4;
+
+namespace Quadbit {
+	// Keeps the mip residency of streamed textures within a VRAM budget. Textures start out with only their
+	// low mips, and feedback on the resolution they are viewed at raises the residency. When the budget runs out,
+	// the top mips of textures that haven't been asked for in a while are dropped. Changing residency reloads the
+	// texture on the loader threads, and the upload replaces the image in place.
+	// Replacements are only let through every MAX_FRAMES_IN_FLIGHT frames, so anything rewriting descriptors
+	// for a replaced texture knows the previous descriptors are no longer in use. Main thread only
+	class QbVkTextureStreamer {
+	public:
+		QbVkTextureStreamer(QbVkTextureLoader& loader);
+
+		void Register(QbVkTextureHandle handle, const char* path, const VkSamplerCreateInfo* samplerInfo);
+		// Encoded image data (png, jpg etc.), the data is kept to reload other mips later
+		void Register(QbVkTextureHandle handle, const unsigned char* encoded, size_t size, const VkSamplerCreateInfo* samplerInfo);
+		void Unregister(QbVkTextureHandle handle);
+
+		// The number of texels needed across the texture, the highest request of a frame wins
+		void RequestResolution(QbVkTextureHandle handle, float resolution);
+
+		// Called once per frame, issues the loads that raise or lower residency
+		void Update();
+		// Whether uploads replacing live textures may be applied this frame
+		bool CanReplace() const;
+		void OnUploaded(const QbVkTextureUpload& upload);
+
+		void SetBudget(VkDeviceSize budget) { budget_ = budget; }
+		VkDeviceSize GetResidentSize() const;
+
+	private:
+		struct StreamedTexture {
+			QbVkTextureHandle handle;
+			eastl::string path;
+			eastl::vector<unsigned char> encoded;
+			bool hasSampler;
+			VkSamplerCreateInfo samplerInfo;
+
+			// Unknown until the first upload
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uint32_t mipLevels = 0;
+
+			uint32_t initialMip = 0;
+			uint32_t residentMip = 0;
+			// The level a load in flight will make resident
+			uint32_t targetMip = 0;
+			uint32_t requestedMip = 0;
+			uint64_t lastRequestFrame = 0;
+			bool loading = true;
+			bool failed = false;
+		};
+
+		QbVkTextureLoader& loader_;
+		// Keyed by handle index
+		eastl::hash_map<uint32_t, StreamedTexture> textures_;
+
+		VkDeviceSize budget_ = DEFAULT_TEXTURE_STREAMING_BUDGET;
+		uint64_t frame_ = 0;
+		uint64_t lastReplaceFrame_ = 0;
+		uint32_t loadsInFlight_ = 0;
+
+		void Register(StreamedTexture&& texture);
+		void Load(StreamedTexture& texture, uint32_t mip, bool replace);
+		uint32_t GetWantedMip(const StreamedTexture& texture) const;
+		// Size of the chain from the given level down
+		VkDeviceSize GetChainSize(const StreamedTexture& texture, uint32_t mip) const;
+	};
+}
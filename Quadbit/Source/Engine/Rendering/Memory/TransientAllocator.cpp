@@ -0,0 +1,69 @@
+#include "TransientAllocator.h"
+
+#include <EASTL/algorithm.h>
+#include <imgui/imgui.h>
+
+#include "Engine/Core/Logging.h"
+#include "Engine/Rendering/VulkanUtils.h"
+#include "Engine/Rendering/Memory/Allocator.h"
+
+namespace Quadbit {
+	QbVkTransientAllocator::QbVkTransientAllocator(QbVkContext& context, VkDeviceSize frameSize) : context_(context), frameSize_(frameSize) {
+		auto bufferInfo = VkUtils::Init::BufferCreateInfo(frameSize_ * MAX_FRAMES_IN_FLIGHT,
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+		context_.allocator->CreateBuffer(buffer_, bufferInfo, QbVkMemoryUsage::QBVK_MEMORY_USAGE_CPU_TO_GPU, "Transient frame buffer");
+		QB_ASSERT(buffer_.alloc.data != nullptr && "Transient buffer must be host visible!");
+	}
+
+	QbVkTransientAllocator::~QbVkTransientAllocator() {
+		context_.allocator->DestroyBuffer(buffer_);
+	}
+
+	void QbVkTransientAllocator::BeginFrame(uint32_t resourceIndex) {
+		// The fence of this frame has signaled so the region is free to be overwritten
+		lastFrameStats_ = stats_;
+		frameIndex_ = resourceIndex;
+		head_ = 0;
+		stats_.used = 0;
+		stats_.allocationCount = 0;
+	}
+
+	QbVkTransientAllocation QbVkTransientAllocator::Allocate(VkDeviceSize size, VkDeviceSize alignment) {
+		QB_ASSERT(size > 0);
+
+		const auto offset = alignment > 1 ? VkUtils::AlignUp(head_, alignment) : head_;
+		if (offset + size > frameSize_) {
+			if (stats_.overflowCount == 0) {
+				QB_LOG_WARN("QbVkTransientAllocator: Frame region of %llu bytes exhausted, consider increasing the size\n", frameSize_);
+			}
+			stats_.overflowCount++;
+			stats_.overflowSize += size;
+			return QbVkTransientAllocation{};
+		}
+
+		head_ = offset + size;
+		stats_.used = head_;
+		stats_.peak = eastl::max(stats_.peak, head_);
+		stats_.allocationCount++;
+
+		const auto bufferOffset = frameSize_ * frameIndex_ + offset;
+		return QbVkTransientAllocation{ buffer_.buf, bufferOffset, size, buffer_.alloc.data + bufferOffset };
+	}
+
+	QbVkTransientAllocation QbVkTransientAllocator::AllocateUniform(VkDeviceSize size) {
+		const auto alignment = context_.gpu->deviceProps.limits.minUniformBufferOffsetAlignment;
+		return Allocate(size, eastl::max<VkDeviceSize>(alignment, 1));
+	}
+
+	void QbVkTransientAllocator::ImGuiDrawState() {
+		ImGui::SetNextWindowSize(ImVec2(500, 120), ImGuiCond_FirstUseEver);
+		ImGui::Begin("Quadbit Transient Allocator", nullptr);
+
+		ImGui::Text("Frame usage: %.3f / %.3f MB (%u allocations)", lastFrameStats_.used / (1024.0f * 1024.0f),
+			frameSize_ / (1024.0f * 1024.0f), lastFrameStats_.allocationCount);
+		ImGui::Text("Peak usage: %.3f MB", stats_.peak / (1024.0f * 1024.0f));
+		ImGui::Text("Overflows: %u (%.3f MB)", stats_.overflowCount, stats_.overflowSize / (1024.0f * 1024.0f));
+
+		ImGui::End();
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Engine/Rendering/VulkanTypes.h"
+
+constexpr VkDeviceSize DEFAULT_TRANSIENT_FRAME_SIZE = 8 * 1024 * 1024;
+
+namespace Quadbit {
+	struct QbVkTransientAllocation {
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		unsigned char* data = nullptr;
+
+		template<typename T>
+		T* As() {
+			return reinterpret_cast<T*>(data);
+		}
+	};
+
+	struct QbVkTransientStats {
+		VkDeviceSize used = 0;
+		VkDeviceSize peak = 0;
+		uint32_t allocationCount = 0;
+		uint32_t overflowCount = 0;
+		VkDeviceSize overflowSize = 0;
+	};
+
+	// Linear allocator for data that is rewritten every frame (dynamic UBO's, UI geometry etc.)
+	// A single persistently mapped buffer is split into one region per frame in flight,
+	// allocations bump a pointer in the region of the current frame which is reset once
+	// the fence of that frame has signaled. Allocations are therefore only valid while
+	// the current frame is being recorded
+	class QbVkTransientAllocator {
+	public:
+		QbVkTransientAllocator(QbVkContext& context, VkDeviceSize frameSize);
+		~QbVkTransientAllocator();
+
+		void BeginFrame(uint32_t resourceIndex);
+
+		// Returns an allocation with a null data pointer if the frame region is exhausted
+		QbVkTransientAllocation Allocate(VkDeviceSize size, VkDeviceSize alignment);
+		QbVkTransientAllocation AllocateUniform(VkDeviceSize size);
+
+		template<typename T>
+		QbVkTransientAllocation AllocateUniform() {
+			return AllocateUniform(sizeof(T));
+		}
+
+		VkBuffer GetBuffer() const { return buffer_.buf; }
+		const QbVkTransientStats& GetStats() const { return stats_; }
+
+		void ImGuiDrawState();
+
+	private:
+		QbVkContext& context_;
+		VkDeviceSize frameSize_;
+		QbVkBuffer buffer_{};
+
+		uint32_t frameIndex_ = 0;
+		VkDeviceSize head_ = 0;
+
+		QbVkTransientStats stats_{};
+		// Stats of the last completed frame, used for display
+		QbVkTransientStats lastFrameStats_{};
+	};
+}
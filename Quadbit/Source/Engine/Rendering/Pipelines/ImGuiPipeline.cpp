@@ -9,6 +9,7 @@
 #include "Engine/Core/Time.h"
 #include "Engine/Entities/EntityManager.h"
 #include "Engine/Rendering/VulkanUtils.h"
+#include "Engine/Rendering/Memory/TransientAllocator.h"
 
 namespace Quadbit {
 	ImGuiPipeline::ImGuiPipeline(QbVkContext& context) : context_(context) {
@@ -44,36 +45,25 @@ namespace Quadbit {
 
 	ImGuiPipeline::~ImGuiPipeline() {
 		ImGui::DestroyContext();
-
-		// Destroy buffers
-		for (auto i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-			context_.allocator->DestroyBuffer(vertexBuffer_[i]);
-			context_.allocator->DestroyBuffer(indexBuffer_[i]);
-		}
 	}
 
-	void ImGuiPipeline::UpdateBuffers(uint32_t resourceIndex) {
+	bool ImGuiPipeline::UpdateBuffers() {
 		ImDrawData* imDrawData = ImGui::GetDrawData();
 
 		VkDeviceSize vertexBufferSize = imDrawData->TotalVtxCount * sizeof(ImDrawVert);
 		VkDeviceSize indexBufferSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
 
-		if (vertexBufferSize == 0 || indexBufferSize == 0) return;
+		if (vertexBufferSize == 0 || indexBufferSize == 0) return false;
 
-		// Only update buffers if the vertex or index count has changed
-		if ((vertexBuffer_[resourceIndex].buf == VK_NULL_HANDLE) || (vertexBuffer_[resourceIndex].alloc.size != vertexBufferSize)) {
-			context_.allocator->DestroyBuffer(vertexBuffer_[resourceIndex]);
-			VkBufferCreateInfo bufferCreateInfo = VkUtils::Init::BufferCreateInfo(vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-			context_.allocator->CreateBuffer(vertexBuffer_[resourceIndex], bufferCreateInfo, QbVkMemoryUsage::QBVK_MEMORY_USAGE_CPU_TO_GPU);
-		}
-		if ((indexBuffer_[resourceIndex].buf == VK_NULL_HANDLE) || (indexBuffer_[resourceIndex].alloc.size != indexBufferSize)) {
-			context_.allocator->DestroyBuffer(indexBuffer_[resourceIndex]);
-			VkBufferCreateInfo bufferCreateInfo = VkUtils::Init::BufferCreateInfo(vertexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-			context_.allocator->CreateBuffer(indexBuffer_[resourceIndex], bufferCreateInfo, QbVkMemoryUsage::QBVK_MEMORY_USAGE_CPU_TO_GPU);
-		}
+		auto vertexAllocation = context_.transientAllocator->Allocate(vertexBufferSize, sizeof(ImDrawVert));
+		auto indexAllocation = context_.transientAllocator->Allocate(indexBufferSize, sizeof(ImDrawIdx));
+		if (vertexAllocation.data == nullptr || indexAllocation.data == nullptr) return false;
+
+		vertexOffset_ = vertexAllocation.offset;
+		indexOffset_ = indexAllocation.offset;
 
-		ImDrawVert* vertexMappedData = reinterpret_cast<ImDrawVert*>(vertexBuffer_[resourceIndex].alloc.data);
-		ImDrawIdx* indexMappedData = reinterpret_cast<ImDrawIdx*>(indexBuffer_[resourceIndex].alloc.data);
+		ImDrawVert* vertexMappedData = vertexAllocation.As<ImDrawVert>();
+		ImDrawIdx* indexMappedData = indexAllocation.As<ImDrawIdx>();
 		for (auto i = 0; i < imDrawData->CmdListsCount; i++) {
 			const ImDrawList* cmdList = imDrawData->CmdLists[i];
 			// Copy buffer data
@@ -83,14 +73,12 @@ namespace Quadbit {
 			vertexMappedData += cmdList->VtxBuffer.Size;
 			indexMappedData += cmdList->IdxBuffer.Size;
 		}
+		return true;
 	}
 
 	void ImGuiPipeline::DrawFrame(uint32_t resourceIndex, VkCommandBuffer commandBuffer) {
 		auto& pipeline = context_.resourceManager->pipelines_[pipeline_];
 
-		// Build new commandbuffer
-		UpdateBuffers(resourceIndex);
-
 		// Get draw data
 		ImGuiIO& io = ImGui::GetIO();
 		ImDrawData* imDrawData = ImGui::GetDrawData();
@@ -101,6 +89,9 @@ namespace Quadbit {
 			return;
 		}
 
+		// Build new commandbuffer
+		if (!UpdateBuffers()) return;
+
 		pipeline->Bind(commandBuffer);
 		pipeline->BindDescriptorSets(commandBuffer);
 
@@ -114,9 +105,10 @@ namespace Quadbit {
 		vkCmdPushConstants(commandBuffer, pipeline->pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock_);
 
 		if (imDrawData->CmdListsCount > 0) {
-			VkDeviceSize offsets[1] = { 0 };
-			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer_[resourceIndex].buf, offsets);
-			vkCmdBindIndexBuffer(commandBuffer, indexBuffer_[resourceIndex].buf, 0, VK_INDEX_TYPE_UINT16);
+			VkBuffer transientBuffer = context_.transientAllocator->GetBuffer();
+			VkDeviceSize offsets[1] = { vertexOffset_ };
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &transientBuffer, offsets);
+			vkCmdBindIndexBuffer(commandBuffer, transientBuffer, indexOffset_, VK_INDEX_TYPE_UINT16);
 
 			for (auto i = 0; i < imDrawData->CmdListsCount; i++) {
 				const ImDrawList* cmdList = imDrawData->CmdLists[i];
@@ -169,7 +161,7 @@ namespace Quadbit {
 		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
 		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 
-		fontTexture_ = context_.resourceManager->LoadTexture(textureWidth, textureHeight, fontData, &samplerInfo);
+		fontTexture_ = context_.resourceManager->LoadTexture(textureWidth, textureHeight, fontData, &samplerInfo, false);
 	}
 
 	void ImGuiPipeline::ImGuiDrawState() {
@@ -13,7 +13,7 @@ namespace Quadbit {
 		ImGuiPipeline(QbVkContext& context);
 		~ImGuiPipeline();
 
-		void UpdateBuffers(uint32_t resourceIndex);
+		bool UpdateBuffers();
 		void ImGuiDrawState();
 		void DrawFrame(uint32_t resourceIndex, VkCommandBuffer commandBuffer);
 
@@ -35,8 +35,9 @@ namespace Quadbit {
 
 		PushConstBlock pushConstBlock_{};
 
-		eastl::array<QbVkBuffer, MAX_FRAMES_IN_FLIGHT> vertexBuffer_;
-		eastl::array<QbVkBuffer, MAX_FRAMES_IN_FLIGHT> indexBuffer_;
+		// UI geometry is rewritten every frame, so it lives in the transient allocator
+		VkDeviceSize vertexOffset_ = 0;
+		VkDeviceSize indexOffset_ = 0;
 
 		void InitImGui();
 		void CreateFontTexture();
@@ -1,7 +1,12 @@
 #include "PBRPipeline.h"
 
+#include <cfloat>
+#include <cmath>
+#include <cstring>
 #include <string>
 
+#include <EASTL/algorithm.h>
+
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
@@ -16,6 +21,7 @@
 #define TINYGLTF_NO_INCLUDE_STB_IMAGE_WRITE
 #include <tinygltf/tiny_gltf.h>
 
+#include "Engine/Core/Hash.h"
 #include "Engine/Core/Logging.h"
 #include "Engine/Core/Time.h"
 #include "Engine/Rendering/VulkanTypes.h"
@@ -25,15 +31,33 @@
 #include "Engine/Rendering/VulkanUtils.h"
 #include "Engine/Rendering/Geometry/Icosphere.h"
 #include "Engine/Rendering/Memory/ResourceManager.h"
+#include "Engine/Rendering/Memory/TransientAllocator.h"
 #include "Engine/Rendering/Systems/NoClipCameraSystem.h"
 
 
 namespace Quadbit {
+	// Keeps the encoded image data so it can be decoded on the texture loader threads,
+	// only the header is parsed here to fill in the dimensions
+	static bool LoadEncodedImageData(tinygltf::Image* image, const int imageIndex, std::string* err, std::string* warn,
+		int reqWidth, int reqHeight, const unsigned char* bytes, int size, void* userData) {
+		int width, height, components;
+		if (!stbi_info_from_memory(bytes, size, &width, &height, &components)) {
+			if (err != nullptr) (*err) += "Unknown image format for image " + std::to_string(imageIndex) + "\n";
+			return false;
+		}
+		image->width = width;
+		image->height = height;
+		image->component = 4;
+		image->as_is = true;
+		image->image.assign(bytes, bytes + size);
+		return true;
+	}
+
 	PBRPipeline::PBRPipeline(QbVkContext& context) :
 		context_(context) {
 
 		// Register the mesh component to be used by the ECS
-		context.entityManager->RegisterComponents<CustomMeshComponent, CustomMeshDeleteComponent, PBRSceneComponent, RenderTransformComponent,
+		context.entityManager->RegisterComponents<CustomMeshComponent, PBRSceneComponent, RenderTransformComponent,
 			RenderCamera, CameraUpdateAspectRatioTag>();
 
 		QbVkPipelineDescription pipelineDescription;
@@ -45,8 +69,6 @@ namespace Quadbit {
 
 		pipeline_ = context_.resourceManager->CreateGraphicsPipeline("Assets/Quadbit/Shaders/default_vert.glsl", "main",
 			"Assets/Quadbit/Shaders/default_frag.glsl", "main", pipelineDescription, context_.mainRenderPass, 1024);
-
-		sunUBO_ = context.resourceManager->CreateUniformBuffer<SunUBO>();
 	}
 
 	void PBRPipeline::DrawShadows(uint32_t resourceIndex, VkCommandBuffer commandBuffer) {
@@ -114,18 +136,6 @@ namespace Quadbit {
 	void PBRPipeline::DrawFrame(uint32_t resourceIndex, VkCommandBuffer commandBuffer) {
 		auto& pipeline = context_.resourceManager->pipelines_[pipeline_];
 
-		// Here we clean up meshes that are due for removal
-		context_.entityManager->ForEachWithCommandBuffer<CustomMeshDeleteComponent>([&](Entity entity, EntityCommandBuffer* cmdBuf, CustomMeshDeleteComponent& mesh) noexcept {
-			if (mesh.deletionDelay == 0) {
-				context_.resourceManager->DestroyResource(mesh.vertexHandle);
-				context_.resourceManager->DestroyResource(mesh.indexHandle);
-				cmdBuf->DestroyEntity(entity);
-			}
-			else {
-				mesh.deletionDelay--;
-			}
-			});
-
 		context_.entityManager->ForEach<RenderCamera, CameraUpdateAspectRatioTag>([&](Entity entity, auto& camera, auto& tag) noexcept {
 			camera.perspective =
 				glm::perspective(glm::radians(45.0f), static_cast<float>(context_.swapchain.extent.width) / static_cast<float>(context_.swapchain.extent.height), 0.1f, camera.viewDistance);
@@ -169,35 +179,73 @@ namespace Quadbit {
 		ImGui::Text("%f, %f, %f", camera->position.x, camera->position.y, camera->position.z);
 		ImGui::End();
 
+		// Geometry lives in shared arenas, so we only rebind
+		// the vertex and index buffers when the arena changes
 		VkDeviceSize offsets[]{ 0 };
+		QbVkBufferHandle boundVertexBuffer = QBVK_BUFFER_NULL_HANDLE;
+		QbVkBufferHandle boundIndexBuffer = QBVK_BUFFER_NULL_HANDLE;
+		auto bindGeometry = [&](const QbVkMeshAllocation& vertices, const QbVkMeshAllocation& indices) {
+			if (vertices.buffer != boundVertexBuffer) {
+				vkCmdBindVertexBuffers(commandBuffer, 0, 1, &context_.resourceManager->buffers_[vertices.buffer].buf, offsets);
+				boundVertexBuffer = vertices.buffer;
+			}
+			if (indices.buffer != boundIndexBuffer) {
+				vkCmdBindIndexBuffer(commandBuffer, context_.resourceManager->buffers_[indices.buffer].buf, 0, VK_INDEX_TYPE_UINT32);
+				boundIndexBuffer = indices.buffer;
+			}
+		};
+
+		// The sun is rewritten every frame, so it lives in the transient buffer and is selected by its dynamic offset.
+		// Material UBO's hold the same data in every frame's copy, so the first one is used
+		auto sunAllocation = context_.transientAllocator->AllocateUniform<SunUBO>();
+		const bool drawScenes = sunAllocation.data != nullptr;
+		if (drawScenes) {
+			auto* sunUBO = sunAllocation.As<SunUBO>();
+			sunUBO->sunAltitude = context_.sunAltitude;
+			sunUBO->sunAzimuth = context_.sunAzimuth;
+		}
+		else if (!sunAllocationFailed_) {
+			// The shaders would read whatever lies at the offset, so the scenes are left out until there's room again
+			QB_LOG_WARN("PBRPipeline: Transient buffer exhausted, skipping PBR scene draws\n");
+		}
+		sunAllocationFailed_ = !drawScenes;
+		const eastl::vector<uint32_t> dynamicOffsets{ static_cast<uint32_t>(sunAllocation.offset), 0 };
 
 		pipeline->Bind(commandBuffer);
 		SetViewportAndScissor(commandBuffer);
 
-		auto* sunUBO = context_.resourceManager->GetUniformBufferPtr<SunUBO>(sunUBO_);
-		sunUBO->sunAltitude = context_.sunAltitude;
-		sunUBO->sunAzimuth = context_.sunAzimuth;
+		// Pixels per unit of view space size at a distance of one, used to turn texel density into a texture resolution
+		const float projectionScale = 0.5f * static_cast<float>(context_.swapchain.extent.height) * glm::abs(camera->perspective[1][1]);
+
+		// Materials may be shared by several scenes, so they are updated before any of them are drawn
+		UpdateMaterialDescriptors();
 
 		context_.entityManager->ForEach<PBRSceneComponent, RenderTransformComponent>(
 			[&](Entity entity, PBRSceneComponent& scene, RenderTransformComponent& transform) noexcept {
+			if (!drawScenes) return;
+
+			bindGeometry(scene.vertices, scene.indices);
 			for (const auto& mesh : scene.meshes) {
-				eastl::array<VkDeviceSize, 1> offsets{ 0 };
+				const auto model = transform.model * mesh.localTransform;
+				const float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
 
 				for (const auto& primitive : mesh.primitives) {
-					offsets[0] = primitive.vertexOffset * sizeof(QbVkVertex);
-					vkCmdBindVertexBuffers(commandBuffer, 0, 1, &context_.resourceManager->buffers_[scene.vertexHandle].buf, offsets.data());
-					vkCmdBindIndexBuffer(commandBuffer, context_.resourceManager->buffers_[scene.indexHandle].buf, primitive.indexOffset * sizeof(uint32_t), VK_INDEX_TYPE_UINT32);
+					const auto& material = materials_[scene.materials[primitive.materialIndex]];
+					RequestTextureResolutions(material, primitive, model, scale, projectionScale, camera->view);
+
+					// Primitives are drawn once the textures of their material have loaded
+					if (material.pending) continue;
 
 					RenderMeshPushConstants* pushConstants = scene.GetSafePushConstPtr<RenderMeshPushConstants>();
-					auto model = transform.model * mesh.localTransform;
 					pushConstants->model = model;
 					pushConstants->mvp = camera->perspective * camera->view * model;
 
 					vkCmdPushConstants(commandBuffer, pipeline->pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(RenderMeshPushConstants), pushConstants);
 
-					pipeline->BindDescriptorSets(commandBuffer, primitive.material.descriptorSets);
+					pipeline->BindDescriptorSets(commandBuffer, material.descriptorSets[material.activeDescriptorSets], dynamicOffsets);
 
-					vkCmdDrawIndexed(commandBuffer, primitive.indexCount, 1, 0, 0, 0);
+					vkCmdDrawIndexed(commandBuffer, primitive.indexCount, 1, scene.indices.offset + primitive.indexOffset,
+						static_cast<int32_t>(scene.vertices.offset + primitive.vertexOffset), 0);
 				}
 			}
 			});
@@ -218,23 +266,46 @@ namespace Quadbit {
 				vkCmdPushConstants(commandBuffer, meshPipeline->pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0, mesh.pushConstantStride, mesh.pushConstants.data());
 			}
 
-			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &context_.resourceManager->buffers_[mesh.vertexHandle].buf, offsets);
-			vkCmdBindIndexBuffer(commandBuffer, context_.resourceManager->buffers_[mesh.indexHandle].buf, 0, VK_INDEX_TYPE_UINT32);
+			if (mesh.indexCount == 0) return;
+			bindGeometry(mesh.vertices, mesh.indices);
 
 			meshPipeline->BindDescriptorSets(commandBuffer, mesh.descriptorSetsHandle);
 
-			vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, 0, 0, 0);
+			vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, mesh.indices.offset, static_cast<int32_t>(mesh.vertices.offset), 0);
 			});
 	}
 
 	PBRSceneComponent PBRPipeline::LoadModel(const char* path)
 	{
+		// Further instances of a model share everything uploaded for the first one.
+		// A model whose key collides with another's is stored under the next free key
+		auto modelKey = Hash::FNV1a(path, strlen(path));
+		auto cached = modelCache_.find(modelKey);
+		while (cached != modelCache_.end() && cached->second.path != path) {
+			cached = modelCache_.find(++modelKey);
+		}
+		if (cached != modelCache_.end()) {
+			auto& model = cached->second;
+			model.refCount++;
+
+			PBRSceneComponent scene;
+			scene.vertices = model.vertices;
+			scene.indices = model.indices;
+			scene.meshes = model.meshes;
+			scene.materials = model.materials;
+			scene.modelKey = modelKey;
+			return scene;
+		}
+
 		eastl::string extension = VkUtils::GetFileExtension(path);
 		PBRSceneComponent scene;
+		scene.modelKey = modelKey;
+		modelDirectory_ = VkUtils::GetFilePath(path);
 
 		std::string err, warn;
 		tinygltf::TinyGLTF loader;
 		tinygltf::Model model;
+		loader.SetImageLoader(LoadEncodedImageData, nullptr);
 
 		bool loaded = false;
 		if (extension.compare(".gltf") == 0) {
@@ -250,25 +321,43 @@ namespace Quadbit {
 		// For now we only support loading single scenes
 		QB_ASSERT(model.scenes.size() == 1 && "Failed to parse model, only one scene allowed!");
 
-		// Parse materials
-		eastl::vector<QbVkPBRMaterial> materials;
+		// Parse materials, their descriptors are written once their textures have been uploaded
 		for (const auto& material : model.materials) {
-			materials.push_back(ParseMaterial(model, material));
+			scene.materials.push_back(ParseMaterial(model, material));
 		}
 
 		eastl::vector<QbVkVertex> vertices;
 		eastl::vector<uint32_t> indices;
 		// Parse nodes recursively
 		for (const auto& node : model.scenes[model.defaultScene].nodes) {
-			ParseNode(model, model.nodes[node], scene, vertices, indices, materials, glm::mat4(1.0f));
+			ParseNode(model, model.nodes[node], scene, vertices, indices, glm::mat4(1.0f));
 		}
 
-		scene.vertexHandle = context_.resourceManager->CreateVertexBuffer(vertices.data(), sizeof(QbVkVertex), static_cast<uint32_t>(vertices.size()));
-		scene.indexHandle = context_.resourceManager->CreateIndexBuffer(indices);
+		scene.vertices = context_.resourceManager->AllocateVertices(vertices.data(), sizeof(QbVkVertex), static_cast<uint32_t>(vertices.size()));
+		scene.indices = context_.resourceManager->AllocateIndices(indices);
 
+		modelCache_[modelKey] = { path, scene.vertices, scene.indices, scene.meshes, scene.materials, 1 };
 		return scene;
 	}
 
+	void PBRPipeline::DestroyModel(const PBRSceneComponent& scene) {
+		auto it = modelCache_.find(scene.modelKey);
+		QB_ASSERT(it != modelCache_.end() && "Scene was not loaded through LoadModel!");
+		if (--it->second.refCount > 0) return;
+
+		for (const auto& material : it->second.materials) {
+			ReleaseMaterial(material);
+		}
+
+		// The geometry may still be drawn by frames in flight
+		auto* resourceManager = context_.resourceManager.get();
+		context_.deletionQueue->Enqueue([resourceManager, vertices = it->second.vertices, indices = it->second.indices]() {
+			resourceManager->FreeMeshAllocation(vertices);
+			resourceManager->FreeMeshAllocation(indices);
+		});
+		modelCache_.erase(it);
+	}
+
 	void PBRPipeline::SetViewportAndScissor(VkCommandBuffer& commandBuffer) {
 		// Dynamic update viewport and scissor for user-defined pipelines (also doesn't necessitate rebuilding the pipeline on window resize)
 		VkViewport viewport{};
@@ -285,7 +374,7 @@ namespace Quadbit {
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 	}
 
-	QbVkPBRMaterial PBRPipeline::ParseMaterial(const tinygltf::Model& model, const tinygltf::Material& material) {
+	QbVkPBRMaterialHandle PBRPipeline::ParseMaterial(const tinygltf::Model& model, const tinygltf::Material& material) {
 		auto& pipeline = context_.resourceManager->pipelines_[pipeline_];
 
 		QbVkPBRMaterial mat{};
@@ -336,6 +425,21 @@ namespace Quadbit {
 			}
 		}
 
+		// Identical materials share their UBO and descriptors, the textures were acquired again above so the extra references go
+		// A different material under the same key is a collision, the next key is probed
+		mat.cacheKey = GetMaterialCacheKey(mat);
+		auto cached = materialCache_.find(mat.cacheKey);
+		while (cached != materialCache_.end() && !materials_[cached->second].Matches(mat)) {
+			cached = materialCache_.find(++mat.cacheKey);
+		}
+		if (cached != materialCache_.end()) {
+			for (const auto& texture : mat.GetTextures()) {
+				if (texture != QBVK_TEXTURE_NULL_HANDLE) context_.resourceManager->ReleaseTexture(texture);
+			}
+			materials_[cached->second].refCount++;
+			return cached->second;
+		}
+
 		mat.ubo = context_.resourceManager->CreateUniformBuffer<MaterialUBO>();
 		MaterialUBO ubo{};
 		ubo.alphaMask = mat.alphaMask;
@@ -351,12 +455,57 @@ namespace Quadbit {
 		ubo.occlusionTextureIndex = mat.textureIndices.occlusionTextureIndex;
 		context_.resourceManager->InitializeUBO(mat.ubo, &ubo);
 
-		mat.descriptorSets = WriteMaterialDescriptors(mat);
-		return mat;
+		mat.descriptorSets[0] = pipeline->GetNextDescriptorSetsHandle();
+		mat.descriptorSets[1] = pipeline->GetNextDescriptorSetsHandle();
+		mat.refCount = 1;
+
+		auto handle = materials_.GetNextHandle();
+		materials_[handle] = eastl::move(mat);
+		materialCache_[materials_[handle].cacheKey] = handle;
+		return handle;
+	}
+
+	uint64_t PBRPipeline::GetMaterialCacheKey(const QbVkPBRMaterial& material) {
+		// Shared textures come back with the same handle, so the handles identify the images
+		auto hash = Hash::FNV_OFFSET_BASIS;
+		for (const auto& texture : material.GetTextures()) {
+			hash = Hash::Combine(hash, texture);
+		}
+		hash = Hash::Combine(hash, material.textureIndices);
+		hash = Hash::Combine(hash, material.baseColorFactor);
+		hash = Hash::Combine(hash, material.emissiveFactor);
+		hash = Hash::Combine(hash, material.metallicFactor);
+		hash = Hash::Combine(hash, material.roughnessFactor);
+		hash = Hash::Combine(hash, material.alphaMask);
+		return Hash::Combine(hash, material.alphaCutoff);
+	}
+
+	void PBRPipeline::ReleaseMaterial(QbVkPBRMaterialHandle handle) {
+		auto& material = materials_[handle];
+		if (--material.refCount > 0) return;
+
+		for (const auto& texture : material.GetTextures()) {
+			if (texture != QBVK_TEXTURE_NULL_HANDLE) context_.resourceManager->ReleaseTexture(texture);
+		}
+		context_.resourceManager->DestroyResource<QbVkBuffer>(material.ubo.handle);
+
+		// The sets may still be bound by frames in flight, so their slots are only handed out again once those complete
+		auto* resourceManager = context_.resourceManager.get();
+		const auto allocator = context_.resourceManager->pipelines_[pipeline_]->descriptorAllocator_;
+		context_.deletionQueue->Enqueue([resourceManager, allocator, descriptorSets = material.descriptorSets]() {
+			if (!resourceManager->descriptorAllocators_.IsValid(allocator)) return;
+			for (const auto& sets : descriptorSets) {
+				resourceManager->descriptorAllocators_[allocator].setInstances.DestroyResource(sets);
+			}
+		});
+
+		materialCache_.erase(material.cacheKey);
+		material = QbVkPBRMaterial{};
+		materials_.DestroyResource(handle);
 	}
 
 	void PBRPipeline::ParseNode(const tinygltf::Model& model, const tinygltf::Node& node, PBRSceneComponent& scene,
-		eastl::vector<QbVkVertex>& vertices, eastl::vector<uint32_t>& indices, const eastl::vector<QbVkPBRMaterial> materials, glm::mat4 parentTransform) {
+		eastl::vector<QbVkVertex>& vertices, eastl::vector<uint32_t>& indices, glm::mat4 parentTransform) {
 		// Construct transform matrix from node data and parent data
 		// Even though the data read is in double precision, we will 
 		// take the precision hit and store them as floats since it should
@@ -384,20 +533,20 @@ namespace Quadbit {
 		// Let parent transform data propagate down through children on recurse
 		if (node.children.size() > 0) {
 			for (const auto& node : node.children) {
-				ParseNode(model, model.nodes[node], scene, vertices, indices, materials, transform);
+				ParseNode(model, model.nodes[node], scene, vertices, indices, transform);
 			}
 		}
 
 		// Parse mesh if node contains a mesh
 		if (node.mesh > -1) {
-			QbVkPBRMesh mesh = ParseMesh(model, model.meshes[node.mesh], vertices, indices, materials);
+			QbVkPBRMesh mesh = ParseMesh(model, model.meshes[node.mesh], vertices, indices);
 			mesh.localTransform = transform;
 			scene.meshes.push_back(mesh);
 		}
 	}
 
 	QbVkPBRMesh PBRPipeline::ParseMesh(const tinygltf::Model& model, const tinygltf::Mesh& mesh,
-		eastl::vector<QbVkVertex>& vertices, eastl::vector<uint32_t>& indices, const eastl::vector<QbVkPBRMaterial>& materials) {
+		eastl::vector<QbVkVertex>& vertices, eastl::vector<uint32_t>& indices) {
 		QbVkPBRMesh qbMesh{};
 
 		for (const auto& primitive : mesh.primitives) {
@@ -488,20 +637,106 @@ namespace Quadbit {
 			}
 
 			QbVkPBRPrimitive qbPrimitive;
+			qbPrimitive.materialIndex = static_cast<uint32_t>(primitive.material);
 			qbPrimitive.vertexOffset = vertexOffset;
 			qbPrimitive.indexOffset = indexOffset;
 			qbPrimitive.indexCount = static_cast<uint32_t>(indices.size()) - indexOffset;
-			qbPrimitive.material = materials[primitive.material];
+			ComputePrimitiveBounds(qbPrimitive, vertices, indices);
 			qbMesh.primitives.push_back(qbPrimitive);
 		}
 
 		return qbMesh;
 	}
 
-	QbVkDescriptorSetsHandle PBRPipeline::WriteMaterialDescriptors(const QbVkPBRMaterial& material) {
+	void PBRPipeline::ComputePrimitiveBounds(QbVkPBRPrimitive& primitive, const eastl::vector<QbVkVertex>& vertices, const eastl::vector<uint32_t>& indices) {
+		const auto* first = &vertices[primitive.vertexOffset];
+		const auto vertexCount = vertices.size() - primitive.vertexOffset;
+
+		glm::vec3 min(FLT_MAX);
+		glm::vec3 max(-FLT_MAX);
+		for (size_t i = 0; i < vertexCount; i++) {
+			min = glm::min(min, first[i].position);
+			max = glm::max(max, first[i].position);
+		}
+		primitive.boundsCenter = (min + max) * 0.5f;
+		primitive.boundsRadius = 0.0f;
+		for (size_t i = 0; i < vertexCount; i++) {
+			primitive.boundsRadius = glm::max(primitive.boundsRadius, glm::length(first[i].position - primitive.boundsCenter));
+		}
+
+		// Average texel density over all triangles, weighted by their area
+		double surfaceArea = 0.0;
+		double uvArea = 0.0;
+		for (uint32_t i = primitive.indexOffset; i + 2 < primitive.indexOffset + primitive.indexCount; i += 3) {
+			const auto& v0 = first[indices[i]];
+			const auto& v1 = first[indices[i + 1]];
+			const auto& v2 = first[indices[i + 2]];
+			surfaceArea += 0.5 * glm::length(glm::cross(v1.position - v0.position, v2.position - v0.position));
+			const auto uv1 = v1.uv0 - v0.uv0;
+			const auto uv2 = v2.uv0 - v0.uv0;
+			uvArea += 0.5 * glm::abs(uv1.x * uv2.y - uv1.y * uv2.x);
+		}
+		primitive.uvDensity = (surfaceArea > 0.0) ? static_cast<float>(std::sqrt(uvArea / surfaceArea)) : 0.0f;
+	}
+
+	void PBRPipeline::RequestTextureResolutions(const QbVkPBRMaterial& material, const QbVkPBRPrimitive& primitive, const glm::mat4& model,
+		float scale, float projectionScale, const glm::mat4& view) {
+		if (primitive.uvDensity <= 0.0f) return;
+
+		// Behind the camera, nothing is requested and the textures eventually drop back to their initial residency
+		const float depth = -(view * model * glm::vec4(primitive.boundsCenter, 1.0f)).z;
+		const float radius = primitive.boundsRadius * scale;
+		if (depth + radius <= 0.0f) return;
+
+		// The nearest point of the bounds decides the resolution, a texture of this size maps one texel to a pixel.
+		// Pixels per object unit over UV units per object unit gives the texels needed across the UV range
+		const float distance = glm::max(depth - radius, 0.1f);
+		const float resolution = projectionScale * scale / (primitive.uvDensity * distance);
+
+		for (const auto& handle : material.GetTextures()) {
+			if (handle != QBVK_TEXTURE_NULL_HANDLE) context_.resourceManager->RequestTextureResolution(handle, resolution);
+		}
+	}
+
+	void PBRPipeline::UpdateMaterialDescriptors() {
+		const auto getVersion = [&](QbVkTextureHandle handle) {
+			return (handle == QBVK_TEXTURE_NULL_HANDLE) ? 0u : context_.resourceManager->textures_[handle].version;
+		};
+		const auto isReady = [&](QbVkTextureHandle handle) {
+			return handle == QBVK_TEXTURE_NULL_HANDLE || context_.resourceManager->IsTextureReady(handle);
+		};
+
+		materials_.ForEach([&](QbVkPBRMaterialHandle handle, QbVkPBRMaterial& material) {
+			const auto textures = material.GetTextures();
+
+			if (material.pending) {
+				if (!eastl::all_of(textures.begin(), textures.end(), isReady)) return;
+				// The sets have never been bound, so they can be written while frames are in flight
+				WriteMaterialDescriptors(material, material.descriptorSets[material.activeDescriptorSets]);
+				material.pending = false;
+			}
+			else {
+				bool replaced = false;
+				for (size_t i = 0; i < textures.size(); i++) {
+					replaced |= getVersion(textures[i]) != material.textureVersions[i];
+				}
+				if (!replaced) return;
+
+				// Texture replacements are spaced MAX_FRAMES_IN_FLIGHT frames apart (see QbVkTextureStreamer),
+				// so the inactive sets were last bound by a frame that has completed
+				material.activeDescriptorSets ^= 1;
+				WriteMaterialDescriptors(material, material.descriptorSets[material.activeDescriptorSets]);
+			}
+
+			for (size_t i = 0; i < textures.size(); i++) {
+				material.textureVersions[i] = getVersion(textures[i]);
+			}
+		});
+	}
+
+	void PBRPipeline::WriteMaterialDescriptors(const QbVkPBRMaterial& material, QbVkDescriptorSetsHandle descriptorSetsHandle) {
 		auto& pipeline = context_.resourceManager->pipelines_[pipeline_];
 
-		auto descriptorSetsHandle = pipeline->GetNextDescriptorSetsHandle();
 		auto emptyTextureHandle = context_.resourceManager->GetEmptyTexture();
 
 		std::vector<VkWriteDescriptorSet> writeDescSets;
@@ -522,7 +757,7 @@ namespace Quadbit {
 			material.emissiveTexture : emptyTextureHandle;
 
 		// Bind UBO for vertex shader
-		pipeline->BindResource(descriptorSetsHandle, "SunUBO", sunUBO_.handle);
+		pipeline->BindTransientResource(descriptorSetsHandle, "SunUBO", sizeof(SunUBO));
 
 		// Bind texture for fragment shader
 		pipeline->BindResource(descriptorSetsHandle, "shadowMap", context_.shadowmapResources.texture);
@@ -533,14 +768,25 @@ namespace Quadbit {
 		pipeline->BindResource(descriptorSetsHandle, "emissiveMap", emissiveHandle);
 
 		pipeline->BindResource(descriptorSetsHandle, "MaterialUBO", material.ubo.handle);
-
-		return descriptorSetsHandle;
 	}
 	QbVkTextureHandle PBRPipeline::CreateTextureFromResource(const tinygltf::Model& model, const tinygltf::Texture& texture) {
 		auto& image = model.images[texture.source];
 
 		auto samplerInfo = GetSamplerInfo(model, texture.sampler);
-		return context_.resourceManager->LoadTexture(image.width, image.height, image.image.data(), &samplerInfo);
+
+		// Prefer a block compressed version of the image made by the texture cooker, it sits next to the source image
+		if (!image.uri.empty() && image.uri.compare(0, 5, "data:") != 0) {
+			const auto uri = eastl::string(image.uri.c_str());
+			const auto cookedPath = modelDirectory_ + "/" + uri.substr(0, uri.find_last_of('.')) + ".ktx2";
+			FILE* cooked = fopen(cookedPath.c_str(), "rb");
+			if (cooked != nullptr) {
+				fclose(cooked);
+				return context_.resourceManager->AcquireTexture(cookedPath.c_str(), &samplerInfo);
+			}
+		}
+
+		// The image holds the encoded data, see LoadEncodedImageData
+		return context_.resourceManager->AcquireTexture(image.image.data(), image.image.size(), &samplerInfo);
 	}
 
 	VkSamplerCreateInfo PBRPipeline::GetSamplerInfo(const tinygltf::Model& model, int samplerIndex) {
@@ -557,13 +803,16 @@ namespace Quadbit {
 		samplerCreateInfo.compareEnable = VK_FALSE;
 		samplerCreateInfo.compareOp = VK_COMPARE_OP_ALWAYS;
 		samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-		samplerCreateInfo.maxLod = 0.0f;
+		samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
 
 		if (samplerIndex > -1) {
 			auto& sampler = model.samplers[samplerIndex];
 			// Hardcoded conversiosn from OpenGL constants...
 			samplerCreateInfo.magFilter = (sampler.magFilter == 9728 || sampler.magFilter == 9984 || sampler.magFilter == 9986) ? VK_FILTER_NEAREST : VK_FILTER_LINEAR;
 			samplerCreateInfo.minFilter = (sampler.minFilter == 9728 || sampler.minFilter == 9984 || sampler.minFilter == 9986) ? VK_FILTER_NEAREST : VK_FILTER_LINEAR;
+			// NEAREST_MIPMAP_NEAREST and LINEAR_MIPMAP_NEAREST pick a single level, plain NEAREST and LINEAR don't use the chain at all
+			if (sampler.minFilter == 9984 || sampler.minFilter == 9985) samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+			if (sampler.minFilter == 9728 || sampler.minFilter == 9729) samplerCreateInfo.maxLod = 0.0f;
 			switch (sampler.wrapS) {
 			case 10497: { samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT; break; }
 			case 33071: { samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE; break; }
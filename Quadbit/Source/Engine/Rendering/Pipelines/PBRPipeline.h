@@ -1,5 +1,7 @@
 #pragma once
 #include <EASTL/array.h>
+#include <EASTL/hash_map.h>
+#include <EASTL/string.h>
 #include <EASTL/unique_ptr.h>
 #include <EASTL/vector.h>
 
@@ -11,6 +13,9 @@
 #include "Engine/Rendering/Shaders/ShaderInstance.h"
 #include "Engine/Rendering/VulkanTypes.h"
 
+// Each material uses two descriptor set instances of the PBR pipeline
+constexpr size_t MAX_PBR_MATERIALS = 512;
+
 namespace Quadbit {
 	struct SunUBO {
 		float sunAzimuth;
@@ -24,7 +29,10 @@ namespace Quadbit {
 		void DrawShadows(uint32_t resourceIndex, VkCommandBuffer commandBuffer);
 		void DrawFrame(uint32_t resourceIndex, VkCommandBuffer commandBuffer);
 
+		// Models are cached by path, and textures and materials by content, so repeated and overlapping loads share GPU memory
 		PBRSceneComponent LoadModel(const char* path);
+		// Releases what the scene uses once no other scene of the same model is left
+		void DestroyModel(const PBRSceneComponent& scene);
 
 		QbVkPipelineHandle pipeline_;
 		QbVkPipelineHandle skyPipeline_;
@@ -34,19 +42,42 @@ namespace Quadbit {
 
 
 		// PBR Loader Helpers
-		QbVkPBRMaterial ParseMaterial(const tinygltf::Model& model, const tinygltf::Material& material);
+		QbVkPBRMaterialHandle ParseMaterial(const tinygltf::Model& model, const tinygltf::Material& material);
+		uint64_t GetMaterialCacheKey(const QbVkPBRMaterial& material);
+		void ReleaseMaterial(QbVkPBRMaterialHandle handle);
 		void ParseNode(const tinygltf::Model& model, const tinygltf::Node& node, PBRSceneComponent& scene,
-			eastl::vector<QbVkVertex>& vertices, eastl::vector<uint32_t>& indices, const eastl::vector<QbVkPBRMaterial> materials, glm::mat4 parentTransform);
+			eastl::vector<QbVkVertex>& vertices, eastl::vector<uint32_t>& indices, glm::mat4 parentTransform);
 		QbVkPBRMesh ParseMesh(const tinygltf::Model& model, const tinygltf::Mesh& mesh,
-			eastl::vector<QbVkVertex>& vertices, eastl::vector<uint32_t>& indices, const eastl::vector<QbVkPBRMaterial>& materials);
-		QbVkDescriptorSetsHandle WriteMaterialDescriptors(const QbVkPBRMaterial& material);
+			eastl::vector<QbVkVertex>& vertices, eastl::vector<uint32_t>& indices);
+		void ComputePrimitiveBounds(QbVkPBRPrimitive& primitive, const eastl::vector<QbVkVertex>& vertices, const eastl::vector<uint32_t>& indices);
+		// Texture streaming feedback, the resolution the primitive is seen at this frame
+		void RequestTextureResolutions(const QbVkPBRMaterial& material, const QbVkPBRPrimitive& primitive, const glm::mat4& model,
+			float scale, float projectionScale, const glm::mat4& view);
+		// Writes the sets of materials that finished loading, and swaps in new sets for materials with replaced textures
+		void UpdateMaterialDescriptors();
+		void WriteMaterialDescriptors(const QbVkPBRMaterial& material, QbVkDescriptorSetsHandle descriptorSetsHandle);
 		QbVkTextureHandle CreateTextureFromResource(const tinygltf::Model& model, const tinygltf::Texture& texture);
 		VkSamplerCreateInfo GetSamplerInfo(const tinygltf::Model& model, int samplerIndex);
 
 		friend class QbVkRenderer;
 
 		QbVkContext& context_;
+		// Directory of the model being loaded, cooked textures are looked up relative to it
+		eastl::string modelDirectory_;
+		// Set while scenes are skipped for lack of transient memory, so it's only logged once per run of such frames
+		bool sunAllocationFailed_ = false;
 
-		QbVkUniformBuffer<SunUBO> sunUBO_;
+		struct CachedModel {
+			// Compared on every hit, the cache key is only a hash of it
+			eastl::string path;
+			QbVkMeshAllocation vertices;
+			QbVkMeshAllocation indices;
+			eastl::vector<QbVkPBRMesh> meshes;
+			eastl::vector<QbVkPBRMaterialHandle> materials;
+			uint32_t refCount;
+		};
+		QbVkResource<QbVkPBRMaterial, MAX_PBR_MATERIALS> materials_;
+		eastl::hash_map<uint64_t, QbVkPBRMaterialHandle> materialCache_;
+		eastl::hash_map<uint64_t, CachedModel> modelCache_;
 	};
 }
\ No newline at end of file
@@ -1,11 +1,16 @@
 #include "Pipeline.h"
 
-#include <SPIRV-Cross/spirv_cross.hpp>
+#include <cstring>
 
+#include <EASTL/algorithm.h>
+#include <EASTL/sort.h>
+
+#include "Engine/Core/Hash.h"
 #include "Engine/Core/Logging.h"
-#include "Engine/Rendering/Shaders/ShaderInstance.h"
 #include "Engine/Rendering/VulkanUtils.h"
 #include "Engine/Rendering/Memory/ResourceManager.h"
+#include "Engine/Rendering/Memory/TransientAllocator.h"
+#include "Engine/Rendering/Pipelines/PipelineCache.h"
 #include "Engine/Rendering/Shaders/ShaderCompiler.h"
 
 namespace Quadbit {
@@ -13,41 +18,41 @@ namespace Quadbit {
 	QbVkPipeline::QbVkPipeline(QbVkContext& context, const char* vertexPath, const char* vertexEntry,
         const char* fragmentPath, const char* fragmentEntry, const QbVkPipelineDescription pipelineDescription,
         const VkRenderPass renderPass, const uint32_t maxInstances, 
-        const eastl::vector<eastl::tuple<VkFormat, uint32_t>>& vertexAttributeOverride) : context_(context) {
+        const eastl::vector<eastl::tuple<VkFormat, uint32_t>>& vertexAttributeOverride, const QbVkShaderDefines& defines,
+        const QbVkSpecialization& vertexSpecialization, const QbVkSpecialization& fragmentSpecialization) : context_(context) {
 
         graphicsResources_ = eastl::make_unique<GraphicsResources>();
         graphicsResources_->vertexPath = vertexPath;
         graphicsResources_->vertexEntry = vertexEntry;
         graphicsResources_->fragmentPath = fragmentPath;
         graphicsResources_->fragmentEntry = fragmentEntry;
+        graphicsResources_->defines = defines;
         graphicsResources_->renderPass = renderPass;
+        graphicsResources_->description = pipelineDescription;
 
-        auto vertexBytecode = context_.shaderCompiler->CompileShader(vertexPath, QbVkShaderType::QBVK_SHADER_TYPE_VERTEX);
-        auto fragmentBytecode = context_.shaderCompiler->CompileShader(fragmentPath, QbVkShaderType::QBVK_SHADER_TYPE_FRAGMENT);
-        QB_ASSERT(!vertexBytecode.empty() && "Can't continue pipeline creation, shader compilation failed!");
-        QB_ASSERT(!fragmentBytecode.empty() && "Can't continue pipeline creation, shader compilation failed!");
+        // Both stages are submitted before waiting so they compile side by side
+        auto vertexJob = context_.shaderCompiler->Submit(vertexPath, QbVkShaderType::QBVK_SHADER_TYPE_VERTEX, defines);
+        auto fragmentJob = context_.shaderCompiler->Submit(fragmentPath, QbVkShaderType::QBVK_SHADER_TYPE_FRAGMENT, defines);
+        const auto vertexShader = context_.shaderCompiler->Wait(vertexJob);
+        const auto fragmentShader = context_.shaderCompiler->Wait(fragmentJob);
+        QB_ASSERT(!vertexShader.spirv.empty() && "Can't continue pipeline creation, shader compilation failed!");
+        QB_ASSERT(!fragmentShader.spirv.empty() && "Can't continue pipeline creation, shader compilation failed!");
 
-        QbVkShaderInstance shaderInstance(context_);
-        shaderInstance.AddShader(vertexBytecode.data(), vertexBytecode.size(), vertexEntry, VK_SHADER_STAGE_VERTEX_BIT);
-        shaderInstance.AddShader(fragmentBytecode.data(), fragmentBytecode.size(), fragmentEntry, VK_SHADER_STAGE_FRAGMENT_BIT);
+        shaderStages_.push_back(AcquireShaderStage(vertexShader, graphicsResources_->vertexEntry.c_str(), VK_SHADER_STAGE_VERTEX_BIT));
+        shaderStages_.push_back(AcquireShaderStage(fragmentShader, graphicsResources_->fragmentEntry.c_str(), VK_SHADER_STAGE_FRAGMENT_BIT));
+        AddSpecialization(vertexSpecialization, vertexShader.reflection);
+        AddSpecialization(fragmentSpecialization, fragmentShader.reflection);
 
-        spirv_cross::Compiler vertexCompiler(vertexBytecode.data(), vertexBytecode.size());
-        spirv_cross::Compiler fragmentCompiler(fragmentBytecode.data(), fragmentBytecode.size());
-        const auto vertexResources = vertexCompiler.get_shader_resources();
-        const auto fragmentResources = fragmentCompiler.get_shader_resources();
-        
 		// Build the descriptor set layout
 		eastl::vector<eastl::vector<VkDescriptorSetLayoutBinding>> setLayoutBindings;
         eastl::vector<VkDescriptorPoolSize> poolSizes;
 
-        ParseShader(vertexCompiler, vertexResources, setLayoutBindings, poolSizes, VK_SHADER_STAGE_VERTEX_BIT);
-        ParseShader(fragmentCompiler, fragmentResources, setLayoutBindings, poolSizes, VK_SHADER_STAGE_FRAGMENT_BIT);
+        ParseShader(vertexShader.reflection, setLayoutBindings, poolSizes, VK_SHADER_STAGE_VERTEX_BIT);
+        ParseShader(fragmentShader.reflection, setLayoutBindings, poolSizes, VK_SHADER_STAGE_FRAGMENT_BIT);
 
-        // Create descriptor set layouts
-        descriptorSetLayouts_.resize(setLayoutBindings.size());
-        for (int i = 0; i < descriptorSetLayouts_.size(); i++) {
-            auto setLayoutInfo = VkUtils::Init::DescriptorSetLayoutCreateInfo(setLayoutBindings[i]);
-            VK_CHECK(vkCreateDescriptorSetLayout(context_.device, &setLayoutInfo, nullptr, &descriptorSetLayouts_[i]));
+        // Get the descriptor set layouts, identical ones are shared between pipelines
+        for (const auto& bindings : setLayoutBindings) {
+            descriptorSetLayouts_.push_back(context_.pipelineCache->AcquireDescriptorSetLayout(bindings));
         }
 
         // Let the resource manager take care of the actual allocations
@@ -60,23 +65,13 @@ namespace Quadbit {
             }
         }
 
-        if (!vertexResources.stage_inputs.empty()) {
+        if (!vertexShader.reflection.vertexInputs.empty()) {
             // Now we will parse the vertex attributes. Here we make the assumption that
             // all vectors are in 32-bit floating point format. That means a vec2 is an R32G32_SFLOAT,
             // a vec3 is an R32G32B32_SFLOAT etc. The user can override the vertex attribute formats
-            // by placing the VkFormats in order, in the vertexAttributeOverride vector
-            eastl::vector<VertexInput> vertexInput;
-            for (const auto& input : vertexResources.stage_inputs) {
-                auto location = vertexCompiler.get_decoration(input.id, spv::DecorationLocation);
-                auto type = vertexCompiler.get_type(input.type_id);
-                vertexInput.push_back({ location, type.vecsize * static_cast<uint32_t>(sizeof(float)) });
-            }
-            // We will sort the inputs so the first location is the first entry, 
-            // this makes it easier to build the attribute descriptions
-            const auto compare = [](const VertexInput& a, const VertexInput& b) {
-                return a.location < b.location;
-            };
-            eastl::sort(vertexInput.begin(), vertexInput.end(), compare);
+            // by placing the VkFormats in order, in the vertexAttributeOverride vector.
+            // The reflected inputs are sorted by location, which makes it easier to build the attribute descriptions
+            const auto& vertexInput = vertexShader.reflection.vertexInputs;
 
             auto offset = 0;
             for (int i = 0; i < vertexInput.size(); i++) {
@@ -107,19 +102,10 @@ namespace Quadbit {
         persistentPipelineInfo_.inputAssemblyInfo =
             VkUtils::Init::PipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
 
-        persistentPipelineInfo_.viewport = VkViewport{};
-        persistentPipelineInfo_.viewport.width = static_cast<float>(context_.swapchain.extent.width);
-        persistentPipelineInfo_.viewport.height = static_cast<float>(context_.swapchain.extent.height);
-        persistentPipelineInfo_.viewport.minDepth = 0.0f;
-        persistentPipelineInfo_.viewport.maxDepth = 1.0f;
-        persistentPipelineInfo_.scissor = VkRect2D{};
-        persistentPipelineInfo_.scissor.extent = context_.swapchain.extent;
-
+        // Viewport and scissor are always dynamic, so the pipeline outlives swapchain resizes
         persistentPipelineInfo_.viewportInfo = VkUtils::Init::PipelineViewportStateCreateInfo();
         persistentPipelineInfo_.viewportInfo.viewportCount = 1;
-        persistentPipelineInfo_.viewportInfo.pViewports = &persistentPipelineInfo_.viewport;
         persistentPipelineInfo_.viewportInfo.scissorCount = 1;
-        persistentPipelineInfo_.viewportInfo.pScissors = &persistentPipelineInfo_.scissor;
 
         persistentPipelineInfo_.multisampleInfo = VkUtils::Init::PipelineMultisampleStateCreateInfo();
         persistentPipelineInfo_.multisampleInfo.minSampleShading = 1.0f;
@@ -134,59 +120,46 @@ namespace Quadbit {
             persistentPipelineInfo_.colourBlendInfo = VkUtils::Init::PipelineColorBlendStateCreateInfo(0, nullptr);
         }
 
-
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo = VkUtils::Init::PipelineLayoutCreateInfo();
-        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts_.size());
-        pipelineLayoutInfo.pSetLayouts = (!descriptorSetLayouts_.empty()) ? descriptorSetLayouts_.data() : nullptr;
-
         // Check for push constants
         eastl::fixed_vector<VkPushConstantRange, 2> pushConstantRanges;
-        if (!vertexResources.push_constant_buffers.empty()) {
+        if (vertexShader.reflection.pushConstantSize > 0) {
             VkPushConstantRange range{};
-            range.size = static_cast<uint32_t>(vertexCompiler.get_declared_struct_size(
-                vertexCompiler.get_type(vertexResources.push_constant_buffers.front().base_type_id)));
+            range.size = vertexShader.reflection.pushConstantSize;
             range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
             pushConstantRanges.push_back(range);
         }
-        if (!fragmentResources.push_constant_buffers.empty()) {
+        if (fragmentShader.reflection.pushConstantSize > 0) {
             VkPushConstantRange range{};
-            range.size = static_cast<uint32_t>(fragmentCompiler.get_declared_struct_size(
-                fragmentCompiler.get_type(fragmentResources.push_constant_buffers.front().base_type_id)));
+            range.size = fragmentShader.reflection.pushConstantSize;
             range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
             pushConstantRanges.push_back(range);
         }
-        pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
-        pipelineLayoutInfo.pPushConstantRanges = (!pushConstantRanges.empty()) ? pushConstantRanges.data() : nullptr;
-        VK_CHECK(vkCreatePipelineLayout(context_.device, &pipelineLayoutInfo, nullptr, &pipelineLayout_));
+        pipelineLayout_ = context_.pipelineCache->AcquirePipelineLayout(descriptorSetLayouts_,
+            pushConstantRanges.data(), static_cast<uint32_t>(pushConstantRanges.size()));
 
         persistentPipelineInfo_.rasterizationInfo = Presets::GetRasterization(pipelineDescription.rasterization);
         persistentPipelineInfo_.depthStencilInfo = Presets::GetDepth(pipelineDescription.depth);
-        persistentPipelineInfo_.dynamicStateInfo = Presets::GetDynamicState(pipelineDescription.dynamicState);;
-
-        VkGraphicsPipelineCreateInfo pipelineInfo = VkUtils::Init::GraphicsPipelineCreateInfo();
-        pipelineInfo.stageCount = 2;
-        pipelineInfo.pStages = shaderInstance.stages.data();
-        pipelineInfo.pVertexInputState = &persistentPipelineInfo_.vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &persistentPipelineInfo_.inputAssemblyInfo;
-        pipelineInfo.pViewportState = &persistentPipelineInfo_.viewportInfo;
-        pipelineInfo.pRasterizationState = &persistentPipelineInfo_.rasterizationInfo;
-        pipelineInfo.pMultisampleState = &persistentPipelineInfo_.multisampleInfo;
-        pipelineInfo.pDepthStencilState = &persistentPipelineInfo_.depthStencilInfo;
-        pipelineInfo.pColorBlendState = &persistentPipelineInfo_.colourBlendInfo;
-        pipelineInfo.pDynamicState = &persistentPipelineInfo_.dynamicStateInfo;
-        pipelineInfo.layout = pipelineLayout_;
-        pipelineInfo.renderPass = renderPass;
+        const auto dynamicStatePreset = Presets::GetDynamicState(pipelineDescription.dynamicState);
+        persistentPipelineInfo_.dynamicStates.assign(dynamicStatePreset.pDynamicStates, dynamicStatePreset.pDynamicStates + dynamicStatePreset.dynamicStateCount);
+        for (const auto dynamicState : { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR }) {
+            auto& dynamicStates = persistentPipelineInfo_.dynamicStates;
+            if (eastl::find(dynamicStates.begin(), dynamicStates.end(), dynamicState) == dynamicStates.end()) dynamicStates.push_back(dynamicState);
+        }
+        persistentPipelineInfo_.dynamicStateInfo = VkUtils::Init::PipelineDynamicStateCreateInfo();
+        persistentPipelineInfo_.dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(persistentPipelineInfo_.dynamicStates.size());
+        persistentPipelineInfo_.dynamicStateInfo.pDynamicStates = persistentPipelineInfo_.dynamicStates.data();
 
-        VK_CHECK(vkCreateGraphicsPipelines(context_.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline_));
+        pipeline_ = AcquirePipeline();
 	}
 
     QbVkPipeline::QbVkPipeline(QbVkContext& context, const char* computePath, const char* computeEntry,
-        const void* specConstants, const uint32_t maxInstances) : context_(context) {
+        const QbVkSpecialization& specialization, const uint32_t maxInstances, const QbVkShaderDefines& defines) : context_(context) {
         compute_ = true;
 
         computeResources_ = eastl::make_unique<ComputeResources>();
         computeResources_->computePath = computePath;
         computeResources_->computeEntry = computeEntry;
+        computeResources_->defines = defines;
 
         // Fence for compute sync
         VkFenceCreateInfo fenceCreateInfo = VkUtils::Init::FenceCreateInfo();
@@ -210,25 +183,20 @@ namespace Quadbit {
         VK_CHECK(vkCreateQueryPool(context_.device, &queryPoolCreateInfo, nullptr, &computeResources_->queryPool));
 
 
-        auto bytecode = context_.shaderCompiler->CompileShader(computePath, QbVkShaderType::QBVK_SHADER_TYPE_COMPUTE);
-        QB_ASSERT(!bytecode.empty() && "Can't continue pipeline creation, shader compilation failed!");
-        QbVkShaderInstance shaderInstance(context_);
-        shaderInstance.AddShader(bytecode.data(), bytecode.size(), computeEntry, VK_SHADER_STAGE_COMPUTE_BIT);
-
-        spirv_cross::Compiler compiler(bytecode.data(), bytecode.size());
-        const auto resources = compiler.get_shader_resources();
+        const auto shader = context_.shaderCompiler->CompileShader(computePath, QbVkShaderType::QBVK_SHADER_TYPE_COMPUTE, defines);
+        QB_ASSERT(!shader.spirv.empty() && "Can't continue pipeline creation, shader compilation failed!");
+        shaderStages_.push_back(AcquireShaderStage(shader, computeResources_->computeEntry.c_str(), VK_SHADER_STAGE_COMPUTE_BIT));
+        AddSpecialization(specialization, shader.reflection);
 
         // Build the descriptor set layout
         eastl::vector<eastl::vector<VkDescriptorSetLayoutBinding>> setLayoutBindings;
         eastl::vector<VkDescriptorPoolSize> poolSizes;
 
-        ParseShader(compiler, resources, setLayoutBindings, poolSizes, VK_SHADER_STAGE_COMPUTE_BIT);
+        ParseShader(shader.reflection, setLayoutBindings, poolSizes, VK_SHADER_STAGE_COMPUTE_BIT);
 
-        // Create descriptor set layouts
-        descriptorSetLayouts_.resize(setLayoutBindings.size());
-        for (int i = 0; i < descriptorSetLayouts_.size(); i++) {
-            auto setLayoutInfo = VkUtils::Init::DescriptorSetLayoutCreateInfo(setLayoutBindings[i]);
-            VK_CHECK(vkCreateDescriptorSetLayout(context_.device, &setLayoutInfo, nullptr, &descriptorSetLayouts_[i]));
+        // Get the descriptor set layouts, identical ones are shared between pipelines
+        for (const auto& bindings : setLayoutBindings) {
+            descriptorSetLayouts_.push_back(context_.pipelineCache->AcquireDescriptorSetLayout(bindings));
         }
 
         // Let the resource manager take care of the actual allocations
@@ -243,67 +211,28 @@ namespace Quadbit {
 
         // Check for push constants
         eastl::fixed_vector<VkPushConstantRange, 1> pushConstantRanges;
-        if (!resources.push_constant_buffers.empty()) {
+        if (shader.reflection.pushConstantSize > 0) {
             VkPushConstantRange range{};
-            range.size = static_cast<uint32_t>(compiler.get_declared_struct_size(
-                compiler.get_type(resources.push_constant_buffers.front().base_type_id)));
+            range.size = shader.reflection.pushConstantSize;
             range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
             pushConstantRanges.push_back(range);
         }
 
-        // Check for specialization constants
-        // Only supports 4-byte specialization constants
-        if (specConstants != nullptr) {
-            auto constants = compiler.get_specialization_constants();
-            for (const auto& sc : constants) {
-                auto constant = compiler.get_constant(sc.id);
-                auto type = compiler.get_type(constant.constant_type);
-                QB_ASSERT((type.basetype == spirv_cross::SPIRType::Int || type.basetype == spirv_cross::SPIRType::UInt ||
-                        type.basetype == spirv_cross::SPIRType::Boolean || type.basetype == spirv_cross::SPIRType::Float)
-                        && "Unsupported specialization constant type!");
-
-                VkSpecializationMapEntry entry;
-                entry.constantID = sc.constant_id;
-                entry.offset = sizeof(uint32_t) * sc.constant_id;
-                entry.size = sizeof(uint32_t);
-                persistentPipelineInfo_.specializationConstants.push_back(entry);
-            }
-
-            // We copy the specialization constant data to a local buffer to be
-            // reused when rebuilding the pipeline
-            auto byteSize = persistentPipelineInfo_.specializationConstants.size() * sizeof(uint32_t);
-            persistentPipelineInfo_.specConstantsRawData.resize(byteSize);
-            memcpy(persistentPipelineInfo_.specConstantsRawData.data(), specConstants, byteSize);
+        pipelineLayout_ = context_.pipelineCache->AcquirePipelineLayout(descriptorSetLayouts_,
+            pushConstantRanges.data(), static_cast<uint32_t>(pushConstantRanges.size()));
 
-            persistentPipelineInfo_.specInfo.dataSize = byteSize;
-            persistentPipelineInfo_.specInfo.mapEntryCount = static_cast<uint32_t>(persistentPipelineInfo_.specializationConstants.size());
-            persistentPipelineInfo_.specInfo.pData = persistentPipelineInfo_.specConstantsRawData.data();
-            persistentPipelineInfo_.specInfo.pMapEntries = persistentPipelineInfo_.specializationConstants.data();
-
-            shaderInstance.stages[0].pSpecializationInfo = &persistentPipelineInfo_.specInfo;
-        }
-
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo = VkUtils::Init::PipelineLayoutCreateInfo();
-        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts_.size());
-        pipelineLayoutInfo.pSetLayouts = (!descriptorSetLayouts_.empty()) ? descriptorSetLayouts_.data() : nullptr;
-        pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
-        pipelineLayoutInfo.pPushConstantRanges = (!pushConstantRanges.empty()) ? pushConstantRanges.data() : nullptr;
-        VK_CHECK(vkCreatePipelineLayout(context_.device, &pipelineLayoutInfo, nullptr, &pipelineLayout_));
-
-        VkComputePipelineCreateInfo computePipelineCreateInfo = VkUtils::Init::ComputePipelineCreateInfo();
-        computePipelineCreateInfo.layout = pipelineLayout_;
-        computePipelineCreateInfo.stage = shaderInstance.stages[0];
-        VK_CHECK(vkCreateComputePipelines(context_.device, nullptr, 1, &computePipelineCreateInfo, nullptr, &pipeline_));
+        pipeline_ = AcquirePipeline();
     }
 
     QbVkPipeline::~QbVkPipeline() {
-        vkDestroyPipelineLayout(context_.device, pipelineLayout_, nullptr);
-        vkDestroyPipeline(context_.device, pipeline_, nullptr);
-
-        if (!descriptorSetLayouts_.empty()) {
-            for (auto& descriptorSetLayout : descriptorSetLayouts_) {
-                vkDestroyDescriptorSetLayout(context_.device, descriptorSetLayout, nullptr);
-            }
+        // Shared objects are only destroyed along with their last user
+        context_.pipelineCache->Release(pipeline_);
+        context_.pipelineCache->Release(pipelineLayout_);
+        for (auto& descriptorSetLayout : descriptorSetLayouts_) {
+            context_.pipelineCache->Release(descriptorSetLayout);
+        }
+        for (const auto& stage : shaderStages_) {
+            context_.pipelineCache->Release(stage.module);
         }
 
         if (compute_) {
@@ -314,53 +243,222 @@ namespace Quadbit {
         }
     }
 
+    void QbVkPipeline::BeginRebuild() {
+        if (!rebuildJobs_.empty()) return;
+
+        if (!compute_) {
+            rebuildJobs_.push_back(context_.shaderCompiler->Submit(graphicsResources_->vertexPath.c_str(), 
+                QbVkShaderType::QBVK_SHADER_TYPE_VERTEX, graphicsResources_->defines));
+            rebuildJobs_.push_back(context_.shaderCompiler->Submit(graphicsResources_->fragmentPath.c_str(), 
+                QbVkShaderType::QBVK_SHADER_TYPE_FRAGMENT, graphicsResources_->defines));
+        }
+        else {
+            rebuildJobs_.push_back(context_.shaderCompiler->Submit(computeResources_->computePath.c_str(), 
+                QbVkShaderType::QBVK_SHADER_TYPE_COMPUTE, computeResources_->defines));
+        }
+    }
+
+    bool QbVkPipeline::IsRebuildReady() const {
+        if (rebuildJobs_.empty()) return false;
+        for (const auto& job : rebuildJobs_) {
+            if (!job->done) return false;
+        }
+        return true;
+    }
+
+    bool QbVkPipeline::UsesShader(const eastl::string& path) const {
+        if (compute_) return computeResources_->computePath == path;
+        return graphicsResources_->vertexPath == path || graphicsResources_->fragmentPath == path;
+    }
+
+    VkRenderPass QbVkPipeline::GetRenderPass() const {
+        return compute_ ? VK_NULL_HANDLE : graphicsResources_->renderPass;
+    }
+
+    void QbVkPipeline::SetRenderPass(VkRenderPass renderPass) {
+        QB_ASSERT(!compute_ && "Compute pipelines don't have a render pass!");
+        graphicsResources_->renderPass = renderPass;
+    }
+
     void QbVkPipeline::Rebuild() {
+        BeginRebuild();
+        auto jobs = eastl::move(rebuildJobs_);
+        rebuildJobs_.clear();
+
+        // A failed compile keeps the current stages, the pipeline is still recreated
+        // since the render pass may have been replaced through SetRenderPass
         if (!compute_) {
-            auto vertexBytecode = context_.shaderCompiler->CompileShader(graphicsResources_->vertexPath.c_str(), 
-                QbVkShaderType::QBVK_SHADER_TYPE_VERTEX);
-            auto fragmentBytecode = context_.shaderCompiler->CompileShader(graphicsResources_->fragmentPath.c_str(), 
-                QbVkShaderType::QBVK_SHADER_TYPE_FRAGMENT);
-            if (vertexBytecode.empty() || fragmentBytecode.empty()) {
-                return;
+            const auto vertexShader = context_.shaderCompiler->Wait(jobs[0]);
+            const auto fragmentShader = context_.shaderCompiler->Wait(jobs[1]);
+            if (!vertexShader.spirv.empty() && !fragmentShader.spirv.empty()) {
+                ReplaceShaderStages({
+                    AcquireShaderStage(vertexShader, graphicsResources_->vertexEntry.c_str(), VK_SHADER_STAGE_VERTEX_BIT),
+                    AcquireShaderStage(fragmentShader, graphicsResources_->fragmentEntry.c_str(), VK_SHADER_STAGE_FRAGMENT_BIT)
+                });
+            }
+        }
+        else {
+            const auto shader = context_.shaderCompiler->Wait(jobs[0]);
+            if (!shader.spirv.empty()) {
+                ReplaceShaderStages({ AcquireShaderStage(shader, computeResources_->computeEntry.c_str(), VK_SHADER_STAGE_COMPUTE_BIT) });
             }
+        }
+
+        // Acquired before the old one is released, so an unchanged pipeline is reused rather than recreated.
+        // The old pipeline may still be referenced by frames in flight, the cache defers its destruction
+        const auto pipeline = AcquirePipeline();
+        context_.pipelineCache->Release(pipeline_);
+        pipeline_ = pipeline;
+    }
 
-            QbVkShaderInstance shaderInstance(context_);
-            shaderInstance.AddShader(vertexBytecode.data(), vertexBytecode.size(), graphicsResources_->vertexEntry.c_str(), VK_SHADER_STAGE_VERTEX_BIT);
-            shaderInstance.AddShader(fragmentBytecode.data(), fragmentBytecode.size(), graphicsResources_->fragmentEntry.c_str(), VK_SHADER_STAGE_FRAGMENT_BIT);
-
-            VkGraphicsPipelineCreateInfo pipelineInfo = VkUtils::Init::GraphicsPipelineCreateInfo();
-            pipelineInfo.stageCount = 2;
-            pipelineInfo.pStages = shaderInstance.stages.data();
-            pipelineInfo.pVertexInputState = &persistentPipelineInfo_.vertexInputInfo;
-            pipelineInfo.pInputAssemblyState = &persistentPipelineInfo_.inputAssemblyInfo;
-            pipelineInfo.pViewportState = &persistentPipelineInfo_.viewportInfo;
-            pipelineInfo.pRasterizationState = &persistentPipelineInfo_.rasterizationInfo;
-            pipelineInfo.pMultisampleState = &persistentPipelineInfo_.multisampleInfo;
-            pipelineInfo.pDepthStencilState = &persistentPipelineInfo_.depthStencilInfo;
-            pipelineInfo.pColorBlendState = &persistentPipelineInfo_.colourBlendInfo;
-            pipelineInfo.pDynamicState = &persistentPipelineInfo_.dynamicStateInfo;
-            pipelineInfo.layout = pipelineLayout_;
-            pipelineInfo.renderPass = graphicsResources_->renderPass;
-
-            vkDestroyPipeline(context_.device, pipeline_, nullptr);
-            VK_CHECK(vkCreateGraphicsPipelines(context_.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline_));
+    VkPipelineShaderStageCreateInfo QbVkPipeline::AcquireShaderStage(const QbVkCompiledShader& shader, const char* entry, VkShaderStageFlagBits stage) {
+        auto stageInfo = VkUtils::Init::PipelineShaderStageCreateInfo();
+        stageInfo.stage = stage;
+        stageInfo.module = context_.pipelineCache->AcquireShaderModule(shader.spirv.data(), shader.spirv.size());
+        stageInfo.pName = entry;
+        return stageInfo;
+    }
+
+    void QbVkPipeline::ReplaceShaderStages(const ShaderStages& stages) {
+        for (const auto& stage : shaderStages_) {
+            context_.pipelineCache->Release(stage.module);
+        }
+        shaderStages_ = stages;
+    }
+
+    void QbVkPipeline::AddSpecialization(const QbVkSpecialization& specialization, const QbVkShaderReflection& reflection) {
+        QbVkSpecialization resolved;
+
+        if (specialization.packed != nullptr) {
+            // Lay the constants out the way the compiler lays out a struct with a member per constant
+            auto specConstants = reflection.specConstants;
+            eastl::sort(specConstants.begin(), specConstants.end(),
+                [](const QbVkReflectedSpecConstant& a, const QbVkReflectedSpecConstant& b) { return a.constantId < b.constantId; });
+
+            uint32_t offset = 0;
+            for (const auto& specConstant : specConstants) {
+                QB_ASSERT(specConstant.size > 0 && "Unsupported specialization constant type!");
+                offset = (offset + specConstant.size - 1) & ~(specConstant.size - 1);
+                resolved.entries.push_back({ specConstant.constantId, offset, specConstant.size });
+                offset += specConstant.size;
+            }
+            QB_ASSERT(offset <= specialization.packedSize && "Packed specialization struct is smaller than the shader's constants!");
+
+            // Constants past the end of a too small struct are left zeroed rather than read out of bounds
+            resolved.data.resize(offset);
+            const auto copySize = eastl::min(offset, specialization.packedSize);
+            if (copySize > 0) {
+                memcpy(resolved.data.data(), specialization.packed, copySize);
+            }
         }
         else {
-            auto bytecode = context_.shaderCompiler->CompileShader(computeResources_->computePath.c_str(), QbVkShaderType::QBVK_SHADER_TYPE_COMPUTE);
-            if (bytecode.empty()) {
-                return;
+            // Only the constants the shader declares are kept, their values are repacked behind each other
+            for (const auto& entry : specialization.entries) {
+                const auto specConstant = eastl::find_if(reflection.specConstants.begin(), reflection.specConstants.end(),
+                    [&](const QbVkReflectedSpecConstant& specConstant) { return specConstant.constantId == entry.constantID; });
+                if (specConstant == reflection.specConstants.end()) {
+                    QB_LOG_WARN("Shader has no specialization constant with id %u, the value is ignored\n", entry.constantID);
+                    continue;
+                }
+                QB_ASSERT(specConstant->size == entry.size && "Specialization constant size doesn't match the shader!");
+
+                const auto offset = static_cast<uint32_t>(resolved.data.size());
+                resolved.entries.push_back({ entry.constantID, offset, entry.size });
+                resolved.data.insert(resolved.data.end(), specialization.data.begin() + entry.offset,
+                    specialization.data.begin() + entry.offset + entry.size);
+            }
+        }
+
+        persistentPipelineInfo_.specializations.push_back(eastl::move(resolved));
+
+        // The stages are added before their specialisations, so they line up once every stage has one
+        if (persistentPipelineInfo_.specializations.size() == shaderStages_.size()) {
+            persistentPipelineInfo_.specInfos.clear();
+            for (const auto& stageSpecialization : persistentPipelineInfo_.specializations) {
+                VkSpecializationInfo specInfo{};
+                specInfo.mapEntryCount = static_cast<uint32_t>(stageSpecialization.entries.size());
+                specInfo.pMapEntries = stageSpecialization.entries.data();
+                specInfo.dataSize = stageSpecialization.data.size();
+                specInfo.pData = stageSpecialization.data.data();
+                persistentPipelineInfo_.specInfos.push_back(specInfo);
+            }
+        }
+    }
+
+    uint64_t QbVkPipeline::GetPipelineKey() {
+        uint64_t key = Hash::Combine(Hash::FNV_OFFSET_BASIS, pipelineLayout_);
+        for (const auto& stage : shaderStages_) {
+            key = Hash::Combine(key, stage.module);
+            key = Hash::Combine(key, stage.stage);
+            key = Hash::FNV1a(stage.pName, strlen(stage.pName), key);
+        }
+
+        // Each stage's constants are hashed separately, the same values in another stage make another pipeline
+        for (const auto& specialization : persistentPipelineInfo_.specializations) {
+            key = Hash::Combine(key, static_cast<uint32_t>(specialization.entries.size()));
+            for (const auto& entry : specialization.entries) {
+                key = Hash::Combine(key, entry.constantID);
+                key = Hash::Combine(key, entry.offset);
+                key = Hash::Combine(key, static_cast<uint64_t>(entry.size));
+            }
+            key = Hash::FNV1a(specialization.data.data(), specialization.data.size(), key);
+        }
+
+        if (!compute_) {
+            const auto& description = graphicsResources_->description;
+            key = Hash::Combine(key, graphicsResources_->renderPass);
+            key = Hash::Combine(key, description.colourBlending);
+            key = Hash::Combine(key, description.depth);
+            key = Hash::Combine(key, description.enableMSAA);
+            key = Hash::Combine(key, description.rasterization);
+            key = Hash::Combine(key, description.dynamicState);
+            key = Hash::Combine(key, persistentPipelineInfo_.multisampleInfo.rasterizationSamples);
+
+            for (const auto& attribute : persistentPipelineInfo_.attributeDescriptions) {
+                key = Hash::Combine(key, attribute.location);
+                key = Hash::Combine(key, attribute.binding);
+                key = Hash::Combine(key, attribute.format);
+                key = Hash::Combine(key, attribute.offset);
             }
-            QbVkShaderInstance shaderInstance(context_);
-            shaderInstance.AddShader(bytecode.data(), bytecode.size(), computeResources_->computeEntry.c_str(), VK_SHADER_STAGE_COMPUTE_BIT);
+            if (persistentPipelineInfo_.vertexInputInfo.vertexBindingDescriptionCount > 0) {
+                key = Hash::Combine(key, persistentPipelineInfo_.inputBindingDescription.stride);
+            }
+            for (const auto dynamicState : persistentPipelineInfo_.dynamicStates) {
+                key = Hash::Combine(key, dynamicState);
+            }
+        }
+        return key;
+    }
 
+    VkPipeline QbVkPipeline::AcquirePipeline() {
+        const auto key = GetPipelineKey();
+
+        for (size_t i = 0; i < shaderStages_.size(); i++) {
+            const auto& specInfo = persistentPipelineInfo_.specInfos[i];
+            shaderStages_[i].pSpecializationInfo = (specInfo.mapEntryCount > 0) ? &specInfo : nullptr;
+        }
+
+        if (compute_) {
             VkComputePipelineCreateInfo computePipelineCreateInfo = VkUtils::Init::ComputePipelineCreateInfo();
             computePipelineCreateInfo.layout = pipelineLayout_;
-            shaderInstance.stages[0].pSpecializationInfo = &persistentPipelineInfo_.specInfo;
-            computePipelineCreateInfo.stage = shaderInstance.stages[0];
-
-            vkDestroyPipeline(context_.device, pipeline_, nullptr);
-            VK_CHECK(vkCreateComputePipelines(context_.device, nullptr, 1, &computePipelineCreateInfo, nullptr, &pipeline_));
+            computePipelineCreateInfo.stage = shaderStages_[0];
+            return context_.pipelineCache->AcquireComputePipeline(key, computePipelineCreateInfo);
         }
+
+        VkGraphicsPipelineCreateInfo pipelineInfo = VkUtils::Init::GraphicsPipelineCreateInfo();
+        pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages_.size());
+        pipelineInfo.pStages = shaderStages_.data();
+        pipelineInfo.pVertexInputState = &persistentPipelineInfo_.vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &persistentPipelineInfo_.inputAssemblyInfo;
+        pipelineInfo.pViewportState = &persistentPipelineInfo_.viewportInfo;
+        pipelineInfo.pRasterizationState = &persistentPipelineInfo_.rasterizationInfo;
+        pipelineInfo.pMultisampleState = &persistentPipelineInfo_.multisampleInfo;
+        pipelineInfo.pDepthStencilState = &persistentPipelineInfo_.depthStencilInfo;
+        pipelineInfo.pColorBlendState = &persistentPipelineInfo_.colourBlendInfo;
+        pipelineInfo.pDynamicState = &persistentPipelineInfo_.dynamicStateInfo;
+        pipelineInfo.layout = pipelineLayout_;
+        pipelineInfo.renderPass = graphicsResources_->renderPass;
+        return context_.pipelineCache->AcquireGraphicsPipeline(key, pipelineInfo);
     }
 
     void QbVkPipeline::Bind(VkCommandBuffer& commandBuffer) {
@@ -390,6 +488,21 @@ namespace Quadbit {
         }
     }
 
+    void QbVkPipeline::BindDescriptorSets(VkCommandBuffer& commandBuffer, QbVkDescriptorSetsHandle descriptorSets, const eastl::vector<uint32_t>& dynamicOffsets) {
+        if (descriptorAllocator_ == QBVK_DESCRIPTOR_ALLOCATOR_NULL_HANDLE) return;
+
+        QB_ASSERT(descriptorSets != QBVK_DESCRIPTOR_SETS_NULL_HANDLE || mainDescriptors_ != QBVK_DESCRIPTOR_SETS_NULL_HANDLE
+            && "No bindable descriptor sets given!");
+        QB_ASSERT(dynamicOffsets.size() == uboSizes_.size() && "Dynamic offset count must match the number of dynamic UBO's in the pipeline!");
+
+        VkPipelineBindPoint bindPoint = compute_ ? VK_PIPELINE_BIND_POINT_COMPUTE : VK_PIPELINE_BIND_POINT_GRAPHICS;
+
+        const auto& sets = context_.resourceManager->GetDescriptorSets(descriptorAllocator_,
+            descriptorSets != QBVK_DESCRIPTOR_SETS_NULL_HANDLE ? descriptorSets : mainDescriptors_);
+        vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout_, 0,
+            static_cast<uint32_t>(sets.size()), sets.data(), static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.empty() ? 0 : dynamicOffsets.data());
+    }
+
     QbVkDescriptorSetsHandle QbVkPipeline::GetNextDescriptorSetsHandle() {
         return context_.resourceManager->descriptorAllocators_[descriptorAllocator_].setInstances.GetNextHandle();
     }
@@ -521,6 +634,23 @@ namespace Quadbit {
         }
     }
 
+    void QbVkPipeline::BindTransientResource(const QbVkDescriptorSetsHandle descriptorSetsHandle, const eastl::string name, VkDeviceSize range) {
+        QB_ASSERT(resourceInfo_.find(name) != resourceInfo_.end() && "Resource name not found in pipeline shaders!");
+        const auto resourceInfo = resourceInfo_[name];
+        QB_ASSERT(resourceInfo.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC && "Transient resources can only be bound to uniform buffers!");
+        const auto& descriptorSets = context_.resourceManager->descriptorAllocators_[descriptorAllocator_].setInstances[
+            descriptorSetsHandle != QBVK_DESCRIPTOR_SETS_NULL_HANDLE ? descriptorSetsHandle : mainDescriptors_];
+
+        // The descriptor covers a single element at the start of the transient buffer,
+        // the actual sub-range is selected through the dynamic offset at bind time
+        VkDescriptorBufferInfo bufferInfo{ context_.transientAllocator->GetBuffer(), 0, range };
+        eastl::array<VkWriteDescriptorSet, 1> writeDescSets = {
+            VkUtils::Init::WriteDescriptorSet(descriptorSets[resourceInfo.dstSet], resourceInfo.dstBinding,
+            resourceInfo.descriptorType, &bufferInfo, resourceInfo.descriptorCount)
+        };
+        vkUpdateDescriptorSets(context_.device, static_cast<uint32_t>(writeDescSets.size()), writeDescSets.data(), 0, nullptr);
+    }
+
     void QbVkPipeline::BindResource(const eastl::string name, const QbVkBufferHandle bufferHandle) {
         QB_ASSERT(mainDescriptors_ != QBVK_DESCRIPTOR_SETS_NULL_HANDLE && 
             "The pipeline has more than one set of shader resources, call GetNextDescriptorSetsHandle to manually retrieve one!");
@@ -629,61 +759,48 @@ namespace Quadbit {
         }
     }
 
-    void QbVkPipeline::ParseShader(const spirv_cross::Compiler& compiler, const spirv_cross::ShaderResources& resources,
+    void QbVkPipeline::ParseShader(const QbVkShaderReflection& reflection,
         eastl::vector<eastl::vector<VkDescriptorSetLayoutBinding>>& setLayoutBindings,
         eastl::vector<VkDescriptorPoolSize>& poolSizes, VkShaderStageFlags shaderStage) {
 
-        const auto ParseResource = [&](const spirv_cross::Resource& resource, VkDescriptorType descriptorType) {
-                uint32_t binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
-                uint64_t set = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
-
-                eastl::string name = resource.name.c_str();
-
-                uint32_t descriptorCount = 1;
-                const spirv_cross::SPIRType type = compiler.get_type(resource.type_id);
-                if (!type.array.empty()) {
-                    QB_ASSERT(type.array.size() == 1 &&
-                        "There is currently no support for multidimensional arrays in shaders!");
-                    descriptorCount = type.array[0];
-                }
+        for (const auto& resource : reflection.resources) {
+            const auto descriptorType = resource.descriptorType;
+            const uint32_t binding = resource.binding;
+            const uint64_t set = resource.set;
+
+            if (descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC) {
+                // For dynamic UBO's we store the aligned sizes in an array of uint32_t's used 
+                // by the rendering systems for indexing when rendering. Each UBO needs N buffers
+                // allocated, where N is the number of frames in flight. This way if we write directly
+                // to a mapped UBO we don't write while the GPU is reading the same data
+                uboSizes_.push_back(VkUtils::GetDynamicUBOAlignment(context_, resource.size));
+            }
 
-                // Since we are allocating a descriptor set for each frame in flight
-                // we are multiplying the amount of descriptor counts up front
-                poolSizes.push_back(VkUtils::Init::DescriptorPoolSize(descriptorType, descriptorCount));
+            // Since we are allocating a descriptor set for each frame in flight
+            // we are multiplying the amount of descriptor counts up front
+            poolSizes.push_back(VkUtils::Init::DescriptorPoolSize(descriptorType, resource.descriptorCount));
 
-                if ((set + 1) > setLayoutBindings.size()) {
-                    setLayoutBindings.resize(set + 1);
-                }
+            if ((set + 1) > setLayoutBindings.size()) {
+                setLayoutBindings.resize(set + 1);
+            }
 
-                // If the resource has already been parsed but is used by multiple shaders,
-                // just add the shader to the shaderflags and return
-                for (auto& setBinding : setLayoutBindings[set]) {
-                    if (setBinding.binding == binding) {
-                        setBinding.stageFlags |= shaderStage;
-                        return;
-                    }
+            // If the resource has already been parsed but is used by multiple shaders,
+            // just add the shader to the shaderflags and continue
+            bool shared = false;
+            for (auto& setBinding : setLayoutBindings[set]) {
+                if (setBinding.binding == binding) {
+                    setBinding.stageFlags |= shaderStage;
+                    shared = true;
+                    break;
                 }
+            }
+            if (shared) continue;
 
-                auto setBinding = VkUtils::Init::DescriptorSetLayoutBinding(binding,
-                    descriptorType, shaderStage, descriptorCount);
-                setLayoutBindings[set].push_back(setBinding);
-
-                resourceInfo_[name] = ResourceInformation { descriptorType, static_cast<uint32_t>(set), binding, descriptorCount };
-        };
-
-        for (const auto& sampler : resources.sampled_images) ParseResource(sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-        for (const auto& uniformBuffer : resources.uniform_buffers) {
-            // For dynamic UBO's we store the aligned sizes in an array of uint32_t's used 
-            // by the rendering systems for indexing when rendering. Each UBO needs N buffers
-            // allocated, where N is the number of frames in flight. This way if we write directly
-            // to a mapped UBO we don't write while the GPU is reading the same data
-            const spirv_cross::SPIRType& type = compiler.get_type(uniformBuffer.base_type_id);
-            uint32_t size = static_cast<uint32_t>(compiler.get_declared_struct_size(type));
-            uboSizes_.push_back(VkUtils::GetDynamicUBOAlignment(context_, size));
+            auto setBinding = VkUtils::Init::DescriptorSetLayoutBinding(binding,
+                descriptorType, shaderStage, resource.descriptorCount);
+            setLayoutBindings[set].push_back(setBinding);
 
-            ParseResource(uniformBuffer, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+            resourceInfo_[resource.name] = ResourceInformation { descriptorType, static_cast<uint32_t>(set), binding, resource.descriptorCount };
         }
-        for (const auto& storageBuffer : resources.storage_buffers) ParseResource(storageBuffer, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-        for (const auto& storageImage : resources.storage_images) ParseResource(storageImage, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
     }
 }
\ No newline at end of file
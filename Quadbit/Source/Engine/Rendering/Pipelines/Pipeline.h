@@ -3,15 +3,19 @@
 #include <EASTL/fixed_vector.h>
 #include <EASTL/functional.h>
 #include <EASTL/hash_map.h>
+#include <EASTL/shared_ptr.h>
 #include <EASTL/string.h>
 
 #include <vulkan/vulkan.h>
-#include <SPIRV-Cross/spirv_cross.hpp>
 
 #include "Engine/Rendering/VulkanTypes.h"
 #include "Engine/Rendering/Pipelines/PipelinePresets.h"
+#include "Engine/Rendering/Shaders/ShaderReflection.h"
 
 namespace Quadbit {
+	struct QbVkShaderJob;
+	struct QbVkCompiledShader;
+
 	struct ResourceInformation {
 		VkDescriptorType descriptorType;
 		uint32_t dstSet;
@@ -19,22 +23,20 @@ namespace Quadbit {
 		uint32_t descriptorCount;
 	};
 
-	struct VertexInput {
-		uint32_t location;
-		uint32_t size;
-	};
-
 	struct GraphicsResources {
 		eastl::string vertexPath;
 		eastl::string vertexEntry;
 		eastl::string fragmentPath;
 		eastl::string fragmentEntry;
+		QbVkShaderDefines defines;
 		VkRenderPass renderPass;
+		QbVkPipelineDescription description;
 	};
 	
 	struct ComputeResources {
 		eastl::string computePath;
 		eastl::string computeEntry;
+		QbVkShaderDefines defines;
 		VkCommandBuffer commandBuffer;
 		VkFence computeFence;
 		VkCommandPool commandPool;
@@ -47,18 +49,17 @@ namespace Quadbit {
 		VkVertexInputBindingDescription inputBindingDescription;
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo;
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo;
-		VkViewport viewport;
-		VkRect2D scissor;
 		VkPipelineViewportStateCreateInfo viewportInfo;
 		VkPipelineMultisampleStateCreateInfo multisampleInfo;
 		VkPipelineColorBlendAttachmentState colourBlendingAttachment;
 		VkPipelineColorBlendStateCreateInfo colourBlendInfo;
 		VkPipelineRasterizationStateCreateInfo rasterizationInfo;
 		VkPipelineDepthStencilStateCreateInfo depthStencilInfo;
+		eastl::fixed_vector<VkDynamicState, 4, false> dynamicStates;
 		VkPipelineDynamicStateCreateInfo dynamicStateInfo;
-		eastl::vector<VkSpecializationMapEntry> specializationConstants;
-		eastl::vector<unsigned char> specConstantsRawData;
-		VkSpecializationInfo specInfo{};
+		// Resolved specialisation of each shader stage, in the order of the stages
+		eastl::fixed_vector<QbVkSpecialization, 2, false> specializations;
+		eastl::fixed_vector<VkSpecializationInfo, 2, false> specInfos;
 	};
 
 	class QbVkPipeline {
@@ -72,17 +73,30 @@ namespace Quadbit {
 
 		QbVkPipeline(QbVkContext& context, const char* vertexPath, const char* vertexEntry,
 			const char* fragmentPath, const char* fragmentEntry, const QbVkPipelineDescription pipelineDescription,
-			const VkRenderPass renderPass, const uint32_t maxInstances = 1, const eastl::vector<eastl::tuple<VkFormat, uint32_t>>& vertexAttributeOverride = {});
+			const VkRenderPass renderPass, const uint32_t maxInstances = 1, const eastl::vector<eastl::tuple<VkFormat, uint32_t>>& vertexAttributeOverride = {},
+			const QbVkShaderDefines& defines = {}, const QbVkSpecialization& vertexSpecialization = {},
+			const QbVkSpecialization& fragmentSpecialization = {});
 		QbVkPipeline(QbVkContext& context, const char* computePath, const char* computeEntry, 
-			const void* specConstants = nullptr, const uint32_t maxInstances = 1);
+			const QbVkSpecialization& specialization = {}, const uint32_t maxInstances = 1, const QbVkShaderDefines& defines = {});
 		~QbVkPipeline();
 
 		QbVkDescriptorSetsHandle GetNextDescriptorSetsHandle();
 
 		// General purpose actions
+		// Queues the shaders for compilation, call on every pipeline before Rebuild so they all compile at once
+		void BeginRebuild();
+		bool IsRebuildQueued() const { return !rebuildJobs_.empty(); }
+		// Whether the shaders queued by BeginRebuild are compiled, so Rebuild won't block
+		bool IsRebuildReady() const;
 		void Rebuild();
+		bool UsesShader(const eastl::string& path) const;
+		// Graphics pipelines only, the pipeline is created against the new render pass on the next Rebuild
+		VkRenderPass GetRenderPass() const;
+		void SetRenderPass(VkRenderPass renderPass);
 		void Bind(VkCommandBuffer& commandBuffer);
 		void BindDescriptorSets(VkCommandBuffer& commandBuffer, QbVkDescriptorSetsHandle descriptorSets = QBVK_DESCRIPTOR_SETS_NULL_HANDLE);
+		// Binds with explicit dynamic offsets, e.g. offsets of allocations from the transient allocator
+		void BindDescriptorSets(VkCommandBuffer& commandBuffer, QbVkDescriptorSetsHandle descriptorSets, const eastl::vector<uint32_t>& dynamicOffsets);
 
 		// Compute specific actions
 		void Dispatch(uint32_t xGroups, uint32_t yGroups, uint32_t zGroups, const void* pushConstants = nullptr,
@@ -93,6 +107,7 @@ namespace Quadbit {
 		void BindResource(const QbVkDescriptorSetsHandle descriptorSetsHandle, const eastl::string name, const QbVkBufferHandle bufferHandle);
 		void BindResource(const QbVkDescriptorSetsHandle descriptorSetsHandle, const eastl::string name, const QbVkTextureHandle textureHandle);
 		void BindResource(const eastl::string name, const QbVkBufferHandle bufferHandle);
+		void BindTransientResource(const QbVkDescriptorSetsHandle descriptorSetsHandle, const eastl::string name, VkDeviceSize range);
 		void BindResource(const eastl::string name, const QbVkTextureHandle textureHandle);
 
 		void BindResourceArray(const QbVkDescriptorSetsHandle descriptorSetsHandle, const eastl::string name, const eastl::vector<QbVkBufferHandle> bufferHandles);
@@ -113,9 +128,25 @@ namespace Quadbit {
 		// Aligned sizes of dynamic UBO's used in the pipeline
 		eastl::vector<uint32_t> uboSizes_;
 
-		void ParseShader(const spirv_cross::Compiler& compiler, const spirv_cross::ShaderResources& resources,
+		// Shaders queued by BeginRebuild
+		eastl::fixed_vector<eastl::shared_ptr<QbVkShaderJob>, 2, false> rebuildJobs_;
+
+		// Modules, set layouts, the pipeline layout and the pipeline itself are owned by the pipeline cache,
+		// pipelines built from the same shaders and state share them
+		using ShaderStages = eastl::fixed_vector<VkPipelineShaderStageCreateInfo, 2, false>;
+		ShaderStages shaderStages_;
+
+		void ParseShader(const QbVkShaderReflection& reflection,
 			eastl::vector<eastl::vector<VkDescriptorSetLayoutBinding>>& setLayoutBindings,
 			eastl::vector<VkDescriptorPoolSize>& poolSizes, VkShaderStageFlags shaderStage);
+		// Appends the stage's specialisation, explicit values are checked against the reflection and packed ones are laid out from it
+		void AddSpecialization(const QbVkSpecialization& specialization, const QbVkShaderReflection& reflection);
+		VkPipelineShaderStageCreateInfo AcquireShaderStage(const QbVkCompiledShader& shader, const char* entry, VkShaderStageFlagBits stage);
+		// Releases the current stages' modules
+		void ReplaceShaderStages(const ShaderStages& stages);
+		// Covers the shaders, the pipeline layout, the specialisation constants and, for graphics pipelines, the fixed function state
+		uint64_t GetPipelineKey();
+		VkPipeline AcquirePipeline();
 
 	};
 }
\ No newline at end of file
@@ -0,0 +1,186 @@
+#include "PipelineCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#include "Engine/Core/Hash.h"
+#include "Engine/Core/Logging.h"
+#include "Engine/Rendering/VulkanUtils.h"
+#include "Engine/Rendering/Memory/DeletionQueue.h"
+
+namespace Quadbit {
+	QbVkPipelineCache::QbVkPipelineCache(QbVkContext& context) : context_(context) {
+		eastl::vector<unsigned char> data;
+
+		FILE* file = fopen(PIPELINE_CACHE_PATH, "rb");
+		if (file != nullptr) {
+			fseek(file, 0, SEEK_END);
+			const auto size = ftell(file);
+			rewind(file);
+
+			if (size > 0) {
+				data.resize(size);
+				if (fread(data.data(), 1, size, file) != static_cast<size_t>(size)) data.clear();
+			}
+			fclose(file);
+		}
+
+		// Drivers are meant to reject foreign data themselves, but not all of them do
+		if (!data.empty() && !IsCompatible(data)) {
+			QB_LOG_INFO("Discarding pipeline cache written by a different driver or device\n");
+			data.clear();
+		}
+
+		auto createInfo = VkUtils::Init::PipelineCacheCreateInfo();
+		createInfo.initialDataSize = data.size();
+		createInfo.pInitialData = data.empty() ? nullptr : data.data();
+		if (vkCreatePipelineCache(context_.device, &createInfo, nullptr, &cache_) != VK_SUCCESS) {
+			// Start over with an empty cache if the driver still refuses the data
+			createInfo.initialDataSize = 0;
+			createInfo.pInitialData = nullptr;
+			VK_CHECK(vkCreatePipelineCache(context_.device, &createInfo, nullptr, &cache_));
+		}
+	}
+
+	QbVkPipelineCache::~QbVkPipelineCache() {
+		Save();
+		vkDestroyPipelineCache(context_.device, cache_, nullptr);
+	}
+
+	void QbVkPipelineCache::Save() {
+		size_t size = 0;
+		VK_CHECK(vkGetPipelineCacheData(context_.device, cache_, &size, nullptr));
+		if (size == 0) return;
+
+		eastl::vector<unsigned char> data(size);
+		VK_CHECK(vkGetPipelineCacheData(context_.device, cache_, &size, data.data()));
+
+		const std::filesystem::path path(PIPELINE_CACHE_PATH);
+		std::error_code error;
+		std::filesystem::create_directories(path.parent_path(), error);
+
+		// Written to a temporary file first, so an interrupted write never leaves a truncated cache behind
+		auto temporaryPath = path;
+		temporaryPath += ".tmp";
+		FILE* file = fopen(temporaryPath.string().c_str(), "wb");
+		if (file == nullptr) {
+			QB_LOG_WARN("Failed to write pipeline cache %s\n", PIPELINE_CACHE_PATH);
+			return;
+		}
+		const bool written = fwrite(data.data(), 1, size, file) == size;
+		fclose(file);
+
+		if (written) std::filesystem::rename(temporaryPath, path, error);
+		if (!written || error) {
+			QB_LOG_WARN("Failed to write pipeline cache %s\n", PIPELINE_CACHE_PATH);
+			std::filesystem::remove(temporaryPath, error);
+		}
+	}
+
+	VkShaderModule QbVkPipelineCache::AcquireShaderModule(const uint32_t* spirv, size_t size) {
+		const auto key = Hash::FNV1a(spirv, size * sizeof(uint32_t));
+		auto shaderModule = shaderModules_.Acquire(key);
+		if (shaderModule != VK_NULL_HANDLE) return shaderModule;
+
+		shaderModule = VkUtils::CreateShaderModule(spirv, static_cast<uint32_t>(size), context_.device);
+		shaderModules_.Add(key, shaderModule);
+		return shaderModule;
+	}
+
+	VkDescriptorSetLayout QbVkPipelineCache::AcquireDescriptorSetLayout(const eastl::vector<VkDescriptorSetLayoutBinding>& bindings) {
+		// Bindings are hashed field by field as the struct has padding, immutable samplers aren't used
+		auto key = Hash::FNV_OFFSET_BASIS;
+		for (const auto& binding : bindings) {
+			QB_ASSERT(binding.pImmutableSamplers == nullptr);
+			key = Hash::Combine(key, binding.binding);
+			key = Hash::Combine(key, binding.descriptorType);
+			key = Hash::Combine(key, binding.descriptorCount);
+			key = Hash::Combine(key, binding.stageFlags);
+		}
+		auto setLayout = setLayouts_.Acquire(key);
+		if (setLayout != VK_NULL_HANDLE) return setLayout;
+
+		auto setLayoutInfo = VkUtils::Init::DescriptorSetLayoutCreateInfo(bindings);
+		VK_CHECK(vkCreateDescriptorSetLayout(context_.device, &setLayoutInfo, nullptr, &setLayout));
+		setLayouts_.Add(key, setLayout);
+		return setLayout;
+	}
+
+	VkPipelineLayout QbVkPipelineCache::AcquirePipelineLayout(const eastl::vector<VkDescriptorSetLayout>& setLayouts,
+		const VkPushConstantRange* pushConstantRanges, uint32_t pushConstantRangeCount) {
+		// Identical set layouts are shared, so their handles identify them
+		auto key = Hash::Combine(Hash::FNV_OFFSET_BASIS, static_cast<uint32_t>(setLayouts.size()));
+		key = Hash::FNV1a(setLayouts.data(), setLayouts.size() * sizeof(VkDescriptorSetLayout), key);
+		key = Hash::FNV1a(pushConstantRanges, pushConstantRangeCount * sizeof(VkPushConstantRange), key);
+		auto pipelineLayout = pipelineLayouts_.Acquire(key);
+		if (pipelineLayout != VK_NULL_HANDLE) return pipelineLayout;
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = VkUtils::Init::PipelineLayoutCreateInfo();
+		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+		pipelineLayoutInfo.pSetLayouts = (!setLayouts.empty()) ? setLayouts.data() : nullptr;
+		pipelineLayoutInfo.pushConstantRangeCount = pushConstantRangeCount;
+		pipelineLayoutInfo.pPushConstantRanges = (pushConstantRangeCount > 0) ? pushConstantRanges : nullptr;
+		VK_CHECK(vkCreatePipelineLayout(context_.device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+		pipelineLayouts_.Add(key, pipelineLayout);
+		return pipelineLayout;
+	}
+
+	VkPipeline QbVkPipelineCache::AcquireGraphicsPipeline(uint64_t key, const VkGraphicsPipelineCreateInfo& createInfo) {
+		auto pipeline = pipelines_.Acquire(key);
+		if (pipeline != VK_NULL_HANDLE) return pipeline;
+
+		VK_CHECK(vkCreateGraphicsPipelines(context_.device, cache_, 1, &createInfo, nullptr, &pipeline));
+		pipelines_.Add(key, pipeline);
+		return pipeline;
+	}
+
+	VkPipeline QbVkPipelineCache::AcquireComputePipeline(uint64_t key, const VkComputePipelineCreateInfo& createInfo) {
+		// Compute and graphics keys share the map, the compute ones are salted so they can't collide
+		key = Hash::Combine(key, VK_PIPELINE_BIND_POINT_COMPUTE);
+		auto pipeline = pipelines_.Acquire(key);
+		if (pipeline != VK_NULL_HANDLE) return pipeline;
+
+		VK_CHECK(vkCreateComputePipelines(context_.device, cache_, 1, &createInfo, nullptr, &pipeline));
+		pipelines_.Add(key, pipeline);
+		return pipeline;
+	}
+
+	void QbVkPipelineCache::Release(VkShaderModule shaderModule) {
+		if (shaderModules_.Release(shaderModule)) vkDestroyShaderModule(context_.device, shaderModule, nullptr);
+	}
+
+	void QbVkPipelineCache::Release(VkDescriptorSetLayout setLayout) {
+		if (setLayouts_.Release(setLayout)) vkDestroyDescriptorSetLayout(context_.device, setLayout, nullptr);
+	}
+
+	void QbVkPipelineCache::Release(VkPipelineLayout pipelineLayout) {
+		if (pipelineLayouts_.Release(pipelineLayout)) context_.deletionQueue->DestroyPipelineLayout(pipelineLayout);
+	}
+
+	void QbVkPipelineCache::Release(VkPipeline pipeline) {
+		if (pipelines_.Release(pipeline)) context_.deletionQueue->DestroyPipeline(pipeline);
+	}
+
+	bool QbVkPipelineCache::IsCompatible(const eastl::vector<unsigned char>& data) const {
+		// Header layout is VkPipelineCacheHeaderVersionOne
+		struct Header {
+			uint32_t headerSize;
+			uint32_t headerVersion;
+			uint32_t vendorID;
+			uint32_t deviceID;
+			uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		};
+		if (data.size() < sizeof(Header)) return false;
+
+		Header header;
+		memcpy(&header, data.data(), sizeof(Header));
+
+		const auto& deviceProps = context_.gpu->deviceProps;
+		return header.headerSize >= sizeof(Header) &&
+			header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			header.vendorID == deviceProps.vendorID &&
+			header.deviceID == deviceProps.deviceID &&
+			memcmp(header.pipelineCacheUUID, deviceProps.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+}
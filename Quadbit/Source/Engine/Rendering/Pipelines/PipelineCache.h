@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+
+#include <EASTL/hash_map.h>
+#include <EASTL/vector.h>
+
+#include <vulkan/vulkan.h>
+
+#include "Engine/Rendering/VulkanTypes.h"
+
+constexpr const char* PIPELINE_CACHE_PATH = "ShaderCache/Pipelines.bin";
+
+namespace Quadbit {
+	// The VkPipelineCache every pipeline is created with. It is seeded from disk at startup, unless the
+	// data was written by a different driver or device, and written back at shutdown and after rebuilds.
+	// Shader modules, descriptor set layouts, pipeline layouts and pipelines are also shared through it,
+	// each is created once per distinct description and destroyed when its last user releases it
+	class QbVkPipelineCache {
+	public:
+		QbVkPipelineCache(QbVkContext& context);
+		~QbVkPipelineCache();
+
+		VkPipelineCache Get() const { return cache_; }
+		void Save();
+
+		VkShaderModule AcquireShaderModule(const uint32_t* spirv, size_t size);
+		VkDescriptorSetLayout AcquireDescriptorSetLayout(const eastl::vector<VkDescriptorSetLayoutBinding>& bindings);
+		VkPipelineLayout AcquirePipelineLayout(const eastl::vector<VkDescriptorSetLayout>& setLayouts,
+			const VkPushConstantRange* pushConstantRanges, uint32_t pushConstantRangeCount);
+		// The key has to cover everything in the create info that isn't covered by the handles it refers to
+		VkPipeline AcquireGraphicsPipeline(uint64_t key, const VkGraphicsPipelineCreateInfo& createInfo);
+		VkPipeline AcquireComputePipeline(uint64_t key, const VkComputePipelineCreateInfo& createInfo);
+
+		// Pipelines and pipeline layouts may still be used by frames in flight, they go through the deletion queue
+		void Release(VkShaderModule shaderModule);
+		void Release(VkDescriptorSetLayout setLayout);
+		void Release(VkPipelineLayout pipelineLayout);
+		void Release(VkPipeline pipeline);
+
+	private:
+		template<typename T>
+		struct SharedObjects {
+			struct Entry {
+				T object;
+				uint32_t refCount;
+			};
+			eastl::hash_map<uint64_t, Entry> entries;
+			eastl::hash_map<T, uint64_t> keys;
+
+			T Acquire(uint64_t key) {
+				const auto it = entries.find(key);
+				if (it == entries.end()) return VK_NULL_HANDLE;
+				it->second.refCount++;
+				return it->second.object;
+			}
+			void Add(uint64_t key, T object) {
+				entries[key] = { object, 1 };
+				keys[object] = key;
+			}
+			// Returns whether that was the last reference
+			bool Release(T object) {
+				const auto key = keys.find(object);
+				QB_ASSERT(key != keys.end() && "Released an object the pipeline cache doesn't own!");
+				auto& entry = entries[key->second];
+				if (--entry.refCount > 0) return false;
+				entries.erase(key->second);
+				keys.erase(key);
+				return true;
+			}
+		};
+
+		QbVkContext& context_;
+		VkPipelineCache cache_ = VK_NULL_HANDLE;
+
+		SharedObjects<VkShaderModule> shaderModules_;
+		SharedObjects<VkDescriptorSetLayout> setLayouts_;
+		SharedObjects<VkPipelineLayout> pipelineLayouts_;
+		SharedObjects<VkPipeline> pipelines_;
+
+		bool IsCompatible(const eastl::vector<unsigned char>& data) const;
+	};
+}
@@ -113,16 +113,52 @@ namespace Quadbit {
 		float alphaMask = 0.0f;
 		float alphaCutoff = 0.0f;
 
-		QbVkDescriptorSetsHandle descriptorSets = QBVK_DESCRIPTOR_SETS_NULL_HANDLE;
+		// Streamed textures replace their images, so the sets are double buffered. The inactive instance
+		// is rewritten with the new views and becomes the active one, while frames in flight use the other
+		eastl::array<QbVkDescriptorSetsHandle, 2> descriptorSets{ QBVK_DESCRIPTOR_SETS_NULL_HANDLE, QBVK_DESCRIPTOR_SETS_NULL_HANDLE };
+		uint32_t activeDescriptorSets = 0;
+		// Versions of the textures the active sets were written with
+		eastl::array<uint32_t, 5> textureVersions{};
+		// The sets are written once the textures have loaded, primitives using the material are skipped until then
+		bool pending = true;
 		QbVkUniformBuffer<MaterialUBO> ubo;
+
+		// Materials are shared between models with the same textures and factors, see PBRPipeline
+		uint64_t cacheKey = 0;
+		uint32_t refCount = 0;
+
+		eastl::array<QbVkTextureHandle, 5> GetTextures() const {
+			return { baseColorTexture, metallicRoughnessTexture, normalTexture, occlusionTexture, emissiveTexture };
+		}
+
+		// Compares what GetMaterialCacheKey hashes, the cache key alone may collide
+		bool Matches(const QbVkPBRMaterial& other) const {
+			const auto& a = textureIndices;
+			const auto& b = other.textureIndices;
+			return GetTextures() == other.GetTextures() &&
+				a.baseColorTextureIndex == b.baseColorTextureIndex && a.metallicRoughnessTextureIndex == b.metallicRoughnessTextureIndex &&
+				a.normalTextureIndex == b.normalTextureIndex && a.occlusionTextureIndex == b.occlusionTextureIndex &&
+				a.emissiveTextureIndex == b.emissiveTextureIndex &&
+				baseColorFactor == other.baseColorFactor && emissiveFactor == other.emissiveFactor &&
+				metallicFactor == other.metallicFactor && roughnessFactor == other.roughnessFactor &&
+				alphaMask == other.alphaMask && alphaCutoff == other.alphaCutoff;
+		}
 	};
+	using QbVkPBRMaterialHandle = QbVkResourceHandle<QbVkPBRMaterial>;
 
 	struct QbVkPBRPrimitive {
-		QbVkPBRMaterial material;
+		// Index into the materials of the scene
+		uint32_t materialIndex;
 
 		uint32_t vertexOffset;
 		uint32_t indexOffset;
 		uint32_t indexCount;
+
+		// Object space bounding sphere
+		glm::vec3 boundsCenter;
+		float boundsRadius;
+		// UV units per object space unit, the square root of the ratio of uv area to surface area
+		float uvDensity;
 	};
 
 	struct QbVkPBRMesh {
@@ -131,10 +167,14 @@ namespace Quadbit {
 	};
 
 	struct PBRSceneComponent {
-		QbVkResourceHandle<QbVkBuffer> vertexHandle;
-		QbVkResourceHandle<QbVkBuffer> indexHandle;
+		// Primitive vertex and index offsets are relative to the start of these allocations
+		QbVkMeshAllocation vertices;
+		QbVkMeshAllocation indices;
 
 		eastl::vector<QbVkPBRMesh> meshes;
+		eastl::vector<QbVkPBRMaterialHandle> materials;
+		// Loading the same model again shares its geometry and materials, they are released with the last scene using them
+		uint64_t modelKey = 0;
 
 		eastl::array<float, 32> pushConstants;
 		int pushConstantStride;
@@ -148,8 +188,8 @@ namespace Quadbit {
 
 	class QbVkPipeline;
 	struct CustomMeshComponent {
-		QbVkResourceHandle<QbVkBuffer> vertexHandle;
-		QbVkResourceHandle<QbVkBuffer> indexHandle;
+		QbVkMeshAllocation vertices;
+		QbVkMeshAllocation indices;
 		uint32_t indexCount;
 		eastl::array<float, 32> pushConstants;
 		int pushConstantStride;
@@ -164,14 +204,6 @@ namespace Quadbit {
 	};
 
 
-	// The deletion delay should be the number of potential frames 
-	// in a row that the mesh could be used by the rendering system
-	struct CustomMeshDeleteComponent {
-		QbVkBufferHandle vertexHandle;
-		QbVkBufferHandle indexHandle;
-		uint32_t deletionDelay = MAX_FRAMES_IN_FLIGHT;
-	};
-
 	// Just a tag, the tag is automatically removed when an entity with the tag is iterated over
 	struct EventTagComponent {};
 	struct CameraUpdateAspectRatioTag : public EventTagComponent {};
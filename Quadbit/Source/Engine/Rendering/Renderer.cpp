@@ -9,11 +9,14 @@
 #include "Engine/Entities/SystemDispatch.h"
 #include "Engine/Rendering/RenderTypes.h"
 #include "Engine/Rendering/VulkanUtils.h"
+#include "Engine/Rendering/Memory/DeletionQueue.h"
 #include "Engine/Rendering/Memory/ResourceManager.h"
+#include "Engine/Rendering/Memory/TransientAllocator.h"
 #include "Engine/Rendering/Pipelines/PBRPipeline.h"
 #include "Engine/Rendering/Pipelines/SkyPipeline.h"
 #include "Engine/Rendering/Pipelines/ImGuiPipeline.h"
 #include "Engine/Rendering/Pipelines/Pipeline.h"
+#include "Engine/Rendering/Pipelines/PipelineCache.h"
 #include "Engine/Rendering/Shaders/ShaderCompiler.h"
 
 
@@ -70,8 +73,11 @@ namespace Quadbit {
 		AllocateCommandBuffers();
 
 		context_->allocator = eastl::make_unique<QbVkAllocator>(context_->device, context_->gpu->deviceProps.limits.bufferImageGranularity, context_->gpu->memoryProps);
+		context_->deletionQueue = eastl::make_unique<QbVkDeletionQueue>(*context_);
 		context_->shaderCompiler = eastl::make_unique<QbVkShaderCompiler>(*context_);
+		context_->pipelineCache = eastl::make_unique<QbVkPipelineCache>(*context_);
 		context_->resourceManager = eastl::make_unique<QbVkResourceManager>(*context_);
+		context_->transientAllocator = eastl::make_unique<QbVkTransientAllocator>(*context_, DEFAULT_TRANSIENT_FRAME_SIZE);
 
 		// Swapchain and dependent resources
 		CreateSwapChain();
@@ -85,6 +91,10 @@ namespace Quadbit {
 		imGuiPipeline_ = eastl::make_unique<ImGuiPipeline>(*context_);
 		skyPipeline_ = eastl::make_unique<SkyPipeline>(*context_);
 
+		const auto shaderStats = context_->shaderCompiler->GetCacheStats();
+		QB_LOG_INFO("Loaded %u shaders (%u from the shader cache, %u reflected) in %.1fms\n", shaderStats.hits + shaderStats.misses, shaderStats.hits,
+			shaderStats.reflected, shaderStats.milliseconds);
+
 		// Set up camera
 		context_->fallbackCamera = context_->entityManager->Create();
 		context_->entityManager->AddComponent<RenderCamera>(context_->fallbackCamera, 
@@ -95,12 +105,20 @@ namespace Quadbit {
 		// We need to start off by waiting for the GPU to be idle
 		VK_CHECK(vkDeviceWaitIdle(context_->device));
 
+		// Nothing is in flight anymore, so everything queued for deletion can go.
+		// This happens before the resource manager is destroyed as queued mesh frees refer to it
+		context_->deletionQueue->Flush();
+
 		// Destroy pipelines
 		pbrPipeline_.reset();
 		imGuiPipeline_.reset();
 
+		// Destroy the per-frame transient buffer
+		context_->transientAllocator.reset();
+
 		// Destroy persistent buffers and textures from the resource manager
 		context_->resourceManager.reset();
+		context_->deletionQueue->Flush();
 
 		// Destroy rendering resources
 		for (const auto& renderingResource : context_->renderingResources) {
@@ -137,8 +155,12 @@ namespace Quadbit {
 		// Destroy render passes
 		vkDestroyRenderPass(context_->device, context_->mainRenderPass, nullptr);
 
-		// Empty garbage and destroy allocator
-		context_->allocator->EmptyGarbage();
+		// Writes the pipeline cache back to disk
+		context_->pipelineCache.reset();
+
+		// Destroy the deletion queue and allocator
+		context_->deletionQueue->Flush();
+		context_->deletionQueue.reset();
 		context_->allocator.reset();
 
 		// Destroy device
@@ -172,6 +194,15 @@ namespace Quadbit {
 		VK_CHECK(vkWaitForFences(context_->device, 1, &currentRenderingResources.fence, VK_TRUE, UINT64_MAX));
 		VK_CHECK(vkResetFences(context_->device, 1, &currentRenderingResources.fence));
 
+		// Anything that was destroyed during the frame that just finished can now be released
+		context_->deletionQueue->FrameCompleted(context_->resourceIndex);
+
+		// The frame is no longer in use by the GPU so its transient allocations can be reused
+		context_->transientAllocator->BeginFrame(context_->resourceIndex);
+
+		// Pipelines with edited shaders are swapped here, before any commands using them are recorded
+		context_->resourceManager->ReloadChangedShaders();
+
 		// Then we will acquire an image from the swapchain
 		uint32_t imageIndex;
 		VkResult result = vkAcquireNextImageKHR(context_->device, context_->swapchain.swapchain, UINT64_MAX,
@@ -208,6 +239,7 @@ namespace Quadbit {
 
 		// Finally we submit the command buffer to the graphics queue, we will also reset the fence to be ready for next frame
 		VK_CHECK(vkQueueSubmit(context_->graphicsQueue, 1, &submitInfo, currentRenderingResources.fence));
+		context_->deletionQueue->FrameSubmitted(context_->resourceIndex);
 
 		// We can now go ahead and submit the result to the present queue
 		VkPresentInfoKHR presentInfo = VkUtils::Init::PresentInfoKHR();
@@ -236,19 +268,18 @@ namespace Quadbit {
 		// Rebuild shaders if requested
 		if (context_->inputHandler->keyState_[0x10] && context_->inputHandler->controlKeysPressed_.enter) {
 			QB_LOG_INFO("Recompiling shaders and rebuilding pipelines!\n");
-			vkDeviceWaitIdle(context_->device);
 			context_->resourceManager->RebuildPipelines();
 		}
 	}
 
 	void QbVkRenderer::DestroyResource(QbVkBuffer buffer) {
-		context_->allocator->DestroyBuffer(buffer);
+		context_->deletionQueue->DestroyBuffer(buffer);
 	}
 
 	void QbVkRenderer::DestroyResource(QbVkTexture texture) {
-		if (texture.descriptor.imageView != VK_NULL_HANDLE) vkDestroyImageView(context_->device, texture.descriptor.imageView, nullptr);
-		if (texture.descriptor.sampler != VK_NULL_HANDLE) vkDestroySampler(context_->device, texture.descriptor.sampler, nullptr);
-		context_->allocator->DestroyImage(texture.image);
+		context_->deletionQueue->DestroyImageView(texture.descriptor.imageView);
+		context_->deletionQueue->DestroySampler(texture.descriptor.sampler);
+		context_->deletionQueue->DestroyImage(texture.image);
 	}
 
 #ifndef NDEBUG
@@ -356,6 +387,8 @@ namespace Quadbit {
 		deviceFeatures.fillModeNonSolid = VK_TRUE;
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
 		deviceFeatures.depthClamp = VK_TRUE;
+		// Optional, compressed textures are decoded on load when it's missing
+		deviceFeatures.textureCompressionBC = context_->gpu->features.textureCompressionBC;
 		//deviceFeatures.sampleRateShading = VK_TRUE;
 
 		// Now we will fill out the actual information for device creation
@@ -420,7 +453,7 @@ namespace Quadbit {
 		VkImageCreateInfo imageInfo = VkUtils::Init::ImageCreateInfo(context_->swapchain.extent.width, context_->swapchain.extent.height, colourFormat,
 			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, context_->multisamplingResources.msaaSamples);
 
-		context_->allocator->CreateImage(context_->multisamplingResources.msaaImage, imageInfo, QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY);
+		context_->allocator->CreateImage(context_->multisamplingResources.msaaImage, imageInfo, QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY, "MSAA colour image");
 		context_->multisamplingResources.msaaImageView = VkUtils::CreateImageView(*context_, context_->multisamplingResources.msaaImage.imgHandle, colourFormat, VK_IMAGE_ASPECT_COLOR_BIT);
 
 		// Transition image layout with a temporary command buffer
@@ -436,7 +469,7 @@ namespace Quadbit {
 		VkImageCreateInfo imageInfo = VkUtils::Init::ImageCreateInfo(context_->swapchain.extent.width, context_->swapchain.extent.height, depthFormat,
 			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, context_->multisamplingResources.msaaSamples);;
 
-		context_->allocator->CreateImage(context_->depthResources.depthImage, imageInfo, QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY);
+		context_->allocator->CreateImage(context_->depthResources.depthImage, imageInfo, QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY, "Depth image");
 		context_->depthResources.imageView = VkUtils::CreateImageView(*context_, context_->depthResources.depthImage.imgHandle, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 
 		// Transition depth image
@@ -738,6 +771,7 @@ namespace Quadbit {
 		imGuiPipeline_->ImGuiDrawState();
 		context_->entityManager->systemDispatch_->ImGuiDrawState();
 		context_->allocator->ImGuiDrawState();
+		context_->transientAllocator->ImGuiDrawState();
 
 		// Any ImGui draw commands before this call will be rendered to the screen
 		// this also means user-code as Game->Simulate() is done before rendering 
@@ -746,8 +780,6 @@ namespace Quadbit {
 	}
 
 	void QbVkRenderer::PrepareFrame(uint32_t resourceIndex, VkCommandBuffer commandBuffer, VkFramebuffer& framebuffer, VkImageView imageView) {
-		// Let the allocator cleanup stuff before preparing the frame
-		context_->allocator->EmptyGarbage();
 
 		eastl::array<VkClearValue, 2> clearValues;
 		clearValues[0].color = { {0.2f, 0.2f, 0.2f, 1.0f} };
@@ -802,6 +834,15 @@ namespace Quadbit {
 
 		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
+		// Every graphics pipeline takes its viewport and scissor from here, unless it sets its own
+		VkViewport viewport{};
+		viewport.width = static_cast<float>(context_->swapchain.extent.width);
+		viewport.height = static_cast<float>(context_->swapchain.extent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &renderPassInfo.renderArea);
+
 		//auto& skyPipeline = context_->resourceManager->pipelines_[skyPipeline_];
 		//skyPipeline->Bind(commandBuffer);
 		//vkCmdDraw(commandBuffer, 6, 1, 0, 0);
@@ -817,8 +858,17 @@ namespace Quadbit {
 	}
 	
 	void QbVkRenderer::Rebuild() {
+		const auto previousFormat = context_->swapchain.imageFormat;
 		RecreateSwapchain();
-		context_->resourceManager->RebuildPipelines();
+
+		// Pipelines set their viewport and scissor dynamically, so a resize alone leaves them valid.
+		// Only a new surface format makes the main render pass, and the pipelines created against it, incompatible
+		if (context_->swapchain.imageFormat != previousFormat) {
+			const auto previousRenderPass = context_->mainRenderPass;
+			CreateMainRenderPass();
+			context_->resourceManager->RebuildPipelines(previousRenderPass, context_->mainRenderPass);
+			vkDestroyRenderPass(context_->device, previousRenderPass, nullptr);
+		}
 
 		context_->entityManager->AddComponent<CameraUpdateAspectRatioTag>(context_->fallbackCamera);
 		if (context_->userCamera != NULL_ENTITY && context_->entityManager->IsValid(context_->userCamera)) {
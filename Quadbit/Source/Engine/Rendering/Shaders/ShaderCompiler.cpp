@@ -1,59 +1,431 @@
 #include "ShaderCompiler.h"
 
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+
+#include <EASTL/algorithm.h>
+#include <EASTL/chrono.h>
+#include <EASTL/sort.h>
+
+#include "Engine/Core/Hash.h"
 #include "Engine/Core/Logging.h"
-#include "Engine/Rendering/VulkanUtils.h"
 
 namespace Quadbit {
-    QbVkShaderCompiler::QbVkShaderCompiler(QbVkContext& context) {
+    constexpr int GLSL_VERSION = 460;
+    constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+    namespace {
+        // The write time is taken before reading, so an edit made while reading still shows up as a change later
+        bool ReadShaderFile(const char* path, eastl::vector<char>& data, std::filesystem::file_time_type& writeTime) {
+            std::error_code error;
+            writeTime = std::filesystem::last_write_time(path, error);
+            if (error) return false;
+
+            FILE* file = fopen(path, "rb");
+            if (file == nullptr) return false;
+
+            fseek(file, 0, SEEK_END);
+            const auto size = ftell(file);
+            rewind(file);
+            // ftell fails with -1, and an empty file is most likely an editor halfway through saving it
+            if (size <= 0) {
+                fclose(file);
+                return false;
+            }
+
+            data.resize(size);
+            const bool read = fread(data.data(), 1, size, file) == static_cast<size_t>(size);
+            fclose(file);
+            return read;
+        }
+
+#ifndef QB_COOKED_SHADERS_ONLY
+        EShLanguage GetLanguage(QbVkShaderType shaderType) {
+            switch (shaderType) {
+            case QbVkShaderType::QBVK_SHADER_TYPE_VERTEX: return EShLangVertex;
+            case QbVkShaderType::QBVK_SHADER_TYPE_FRAGMENT: return EShLangFragment;
+            default: return EShLangCompute;
+            }
+        }
+
+        // Resolves includes and records every file it hands to glslang along with its hash
+        class QbVkShaderIncluder : public glslang::TShader::Includer {
+        public:
+            QbVkShaderIncluder(eastl::vector<QbVkShaderCompiler::Dependency>& includes) : includes_(includes) {}
+
+            IncludeResult* includeLocal(const char* headerName, const char* includerName, size_t inclusionDepth) override {
+                if (auto* result = Include(std::filesystem::path(includerName).parent_path() / headerName)) return result;
+                return includeSystem(headerName, includerName, inclusionDepth);
+            }
+
+            IncludeResult* includeSystem(const char* headerName, const char* includerName, size_t inclusionDepth) override {
+                return Include(std::filesystem::path(SHADER_INCLUDE_ROOT) / headerName);
+            }
+
+            void releaseInclude(IncludeResult* result) override {
+                if (result == nullptr) return;
+                delete static_cast<eastl::vector<char>*>(result->userData);
+                delete result;
+            }
+
+        private:
+            eastl::vector<QbVkShaderCompiler::Dependency>& includes_;
+
+            IncludeResult* Include(const std::filesystem::path& path) {
+                // The resolved name is what nested includes are resolved against
+                const auto name = path.lexically_normal().generic_string();
+                auto* data = new eastl::vector<char>();
+                std::filesystem::file_time_type writeTime;
+                if (!ReadShaderFile(name.c_str(), *data, writeTime)) {
+                    delete data;
+                    return nullptr;
+                }
+
+                // A header included more than once is still only listed once
+                const auto hash = Hash::FNV1a(data->data(), data->size());
+                const auto included = eastl::find_if(includes_.begin(), includes_.end(),
+                    [&](const QbVkShaderCompiler::Dependency& include) { return include.path == name.c_str(); });
+                if (included == includes_.end()) includes_.push_back({ name.c_str(), hash, writeTime });
+
+                return new IncludeResult(name, data->data(), data->size(), data);
+            }
+        };
+#endif
+
+        // Limits every Vulkan device is expected to cover, the same as glslang's defaults
+        VkPhysicalDeviceLimits GetOfflineLimits() {
+            VkPhysicalDeviceLimits limits{};
+            limits.maxVertexInputAttributes = 64;
+            limits.maxClipDistances = 8;
+            limits.maxCullDistances = 8;
+            limits.maxCombinedClipAndCullDistances = 8;
+            limits.maxComputeWorkGroupCount[0] = limits.maxComputeWorkGroupCount[1] = limits.maxComputeWorkGroupCount[2] = 65535;
+            limits.maxComputeWorkGroupSize[0] = 1024;
+            limits.maxComputeWorkGroupSize[1] = 1024;
+            limits.maxComputeWorkGroupSize[2] = 64;
+            limits.maxGeometryInputComponents = 64;
+            limits.maxGeometryOutputComponents = 128;
+            limits.maxGeometryOutputVertices = 256;
+            limits.maxGeometryTotalOutputComponents = 1024;
+            limits.maxFragmentInputComponents = 128;
+            return limits;
+        }
+    }
+
+    QbVkShaderCompiler::QbVkShaderCompiler(QbVkContext& context) : QbVkShaderCompiler(context.gpu->deviceProps.limits) {
+        // Cooked shaders can't change under a running game, so there is nothing to watch
+#ifndef QB_COOKED_SHADERS_ONLY
+        watcher_ = std::thread(&QbVkShaderCompiler::WatcherLoop, this);
+#endif
+    }
+
+    QbVkShaderCompiler::QbVkShaderCompiler() : QbVkShaderCompiler(GetOfflineLimits()) {}
+
+    QbVkShaderCompiler::QbVkShaderCompiler(const VkPhysicalDeviceLimits& limits) {
+#ifndef QB_COOKED_SHADERS_ONLY
         glslang::InitializeProcess();
 
-        resourceLimits_ = GetResourceLimits(context.gpu->deviceProps.limits);
+        resourceLimits_ = GetResourceLimits(limits);
+
+        // The resource limits end with a struct of bools, the hash stops before its trailing padding
+        compilerHash_ = Hash::Combine(Hash::FNV_OFFSET_BASIS, SHADER_CACHE_VERSION);
+        compilerHash_ = Hash::Combine(compilerHash_, GLSL_VERSION);
+        compilerHash_ = Hash::Combine(compilerHash_, glslang::GetKhronosToolId());
+        compilerHash_ = Hash::Combine(compilerHash_, glslang::GetSpirvGeneratorVersion());
+        const char* glslVersion = glslang::GetGlslVersionString();
+        compilerHash_ = Hash::FNV1a(glslVersion, strlen(glslVersion), compilerHash_);
+        compilerHash_ = Hash::FNV1a(&resourceLimits_, offsetof(TBuiltInResource, limits) + sizeof(TLimits), compilerHash_);
+#else
+        compilerHash_ = 0;
+#endif
+
+        // glslang is initialised once above, each job creates its own shader and program so the workers share nothing
+        const auto hardwareThreads = std::thread::hardware_concurrency();
+        const auto workerCount = eastl::clamp(hardwareThreads > 1 ? hardwareThreads - 1 : 1u, 1u, MAX_SHADER_COMPILER_THREADS);
+        for (uint32_t i = 0; i < workerCount; i++) {
+            workers_.push_back(std::thread(&QbVkShaderCompiler::WorkerLoop, this));
+        }
+    }
+
+    QbVkShaderCompiler::~QbVkShaderCompiler() {
+        {
+            std::lock_guard<std::mutex> lock(jobMutex_);
+            stopping_ = true;
+        }
+        jobCondition_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(watchMutex_);
+            stopWatching_ = true;
+        }
+        watchCondition_.notify_all();
+        if (watcher_.joinable()) watcher_.join();
+    }
+
+    QbVkShaderJobHandle QbVkShaderCompiler::Submit(const char* path, QbVkShaderType shaderType, const QbVkShaderDefines& defines) {
+        auto job = eastl::make_shared<QbVkShaderJob>();
+        job->path = path;
+        job->shaderType = shaderType;
+        job->defines = defines;
+        {
+            std::lock_guard<std::mutex> lock(jobMutex_);
+            jobs_.push_back(job);
+        }
+        jobCondition_.notify_all();
+        return job;
+    }
+
+    QbVkCompiledShader QbVkShaderCompiler::Wait(const QbVkShaderJobHandle& job) {
+        while (true) {
+            QbVkShaderJobHandle queued;
+            {
+                std::unique_lock<std::mutex> lock(jobMutex_);
+                jobCondition_.wait(lock, [&]() { return job->done.load() || !jobs_.empty(); });
+                if (job->done) break;
+
+                queued = eastl::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            // Rather than sit idle, the waiting thread takes a share of the work
+            Run(*queued);
+        }
+        return eastl::move(job->shader);
+    }
+
+    QbVkCompiledShader QbVkShaderCompiler::CompileShader(const char* path, QbVkShaderType shaderType, const QbVkShaderDefines& defines) {
+        return Wait(Submit(path, shaderType, defines));
+    }
+
+    QbVkShaderCacheStats QbVkShaderCompiler::GetCacheStats() {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        return cacheStats_;
+    }
+
+    void QbVkShaderCompiler::ResetCacheStats() {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        cacheStats_ = {};
+    }
+
+    eastl::vector<eastl::string> QbVkShaderCompiler::TakeChangedShaders() {
+        std::lock_guard<std::mutex> lock(watchMutex_);
+        return eastl::move(changedShaders_);
+    }
+
+    void QbVkShaderCompiler::WorkerLoop() {
+        while (true) {
+            QbVkShaderJobHandle job;
+            {
+                std::unique_lock<std::mutex> lock(jobMutex_);
+                jobCondition_.wait(lock, [&]() { return stopping_ || !jobs_.empty(); });
+                if (stopping_) return;
+
+                job = eastl::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            Run(*job);
+        }
     }
 
-    std::vector<uint32_t> QbVkShaderCompiler::CompileShader(const char* path, QbVkShaderType shaderType) {
-        FILE* pFile = fopen(path, "rb");
-        QB_ASSERT(pFile != nullptr && "Couldn't open file!");
+    void QbVkShaderCompiler::WatcherLoop() {
+        eastl::vector<eastl::pair<eastl::string, std::filesystem::file_time_type>> files;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(watchMutex_);
+                watchCondition_.wait_for(lock, std::chrono::milliseconds(SHADER_WATCH_INTERVAL_MS), [&]() { return stopWatching_; });
+                if (stopWatching_) return;
+
+                files.clear();
+                for (const auto& [path, file] : watchedFiles_) files.push_back({ path, file.writeTime });
+            }
 
-        // Get file size
-        fseek(pFile, 0, SEEK_END);
-        uint32_t fileSize = ftell(pFile);
-        rewind(pFile);
+            // The file system is only touched outside of the lock, jobs registering files are never held up by it
+            for (auto& [path, writeTime] : files) {
+                std::error_code error;
+                const auto currentWriteTime = std::filesystem::last_write_time(path.c_str(), error);
+                if (error || currentWriteTime == writeTime) {
+                    path.clear();
+                    continue;
+                }
+                writeTime = currentWriteTime;
+            }
+
+            std::lock_guard<std::mutex> lock(watchMutex_);
+            for (const auto& [path, writeTime] : files) {
+                if (path.empty()) continue;
+                auto& file = watchedFiles_[path];
+                file.writeTime = writeTime;
+                for (const auto& shader : file.shaders) {
+                    if (eastl::find(changedShaders_.begin(), changedShaders_.end(), shader) == changedShaders_.end()) {
+                        changedShaders_.push_back(shader);
+                    }
+                }
+            }
+        }
+    }
+
+    void QbVkShaderCompiler::Watch(const eastl::string& path, const eastl::vector<Dependency>& dependencies) {
+        // The shader itself is watched even when it failed to compile, so fixing it triggers another reload
+        std::filesystem::file_time_type sourceWriteTime;
+        const bool hasSource = eastl::find_if(dependencies.begin(), dependencies.end(),
+            [&](const Dependency& dependency) { return dependency.path == path; }) != dependencies.end();
+        std::error_code error;
+        if (!hasSource) sourceWriteTime = std::filesystem::last_write_time(path.c_str(), error);
+
+        std::lock_guard<std::mutex> lock(watchMutex_);
+        const auto watch = [&](const eastl::string& filePath, std::filesystem::file_time_type writeTime) {
+            auto [it, inserted] = watchedFiles_.insert(filePath);
+            auto& file = it->second;
+            // Keeps the newest time seen, so a change the watcher already reported isn't reported again
+            if (inserted || writeTime > file.writeTime) file.writeTime = writeTime;
+            if (eastl::find(file.shaders.begin(), file.shaders.end(), path) == file.shaders.end()) file.shaders.push_back(path);
+        };
+
+        for (const auto& dependency : dependencies) watch(dependency.path, dependency.writeTime);
+        if (!hasSource && !error) watch(path, sourceWriteTime);
+    }
 
-        // Read data into a vector
+    void QbVkShaderCompiler::Run(QbVkShaderJob& job) {
+        const auto start = eastl::chrono::high_resolution_clock::now();
+
+        // Sorted, so the order the defines are given in doesn't make for another permutation
+        auto defines = job.defines;
+        eastl::sort(defines.begin(), defines.end(), [](const QbVkShaderDefine& lhs, const QbVkShaderDefine& rhs) { return lhs.name < rhs.name; });
+        eastl::string preamble = "#extension GL_GOOGLE_include_directive : enable\n";
+        for (const auto& define : defines) {
+            preamble.append_sprintf("#define %s %s\n", define.name.c_str(), define.value.c_str());
+        }
+
+        auto permutationKey = Hash::FNV1a(job.path.data(), job.path.size());
+        permutationKey = Hash::Combine(permutationKey, job.shaderType);
+        permutationKey = Hash::FNV1a(preamble.data(), preamble.size(), permutationKey);
+
+        bool hit = FindPermutation(permutationKey, job.shader);
+        if (!hit) {
+            // Only the default permutation is cooked, and outside of cooked only builds it just stands in for a missing source
+#ifdef QB_COOKED_SHADERS_ONLY
+            const bool cooked = job.defines.empty();
+#else
+            std::error_code error;
+            const bool cooked = job.defines.empty() && !std::filesystem::exists(job.path.c_str(), error);
+#endif
+            eastl::vector<Dependency> dependencies;
+            if (cooked) {
+                hit = LoadCookedShader(job.path, job.shader, dependencies);
+                if (!hit) QB_LOG_ERROR("Couldn't load cooked shader %s\n", job.path.c_str());
+            }
+            else {
+                hit = CompileFromSource(job, preamble, dependencies);
+            }
+
+            Watch(job.path, dependencies);
+            if (!job.shader.spirv.empty()) {
+                std::lock_guard<std::mutex> lock(permutationMutex_);
+                permutations_[permutationKey] = { job.shader, eastl::move(dependencies) };
+            }
+        }
+
+        const auto elapsed = eastl::chrono::high_resolution_clock::now() - start;
+        {
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            if (hit) cacheStats_.hits++;
+            else cacheStats_.misses++;
+            cacheStats_.milliseconds += static_cast<eastl::chrono::duration<float, eastl::milli>>(elapsed).count();
+        }
+
+        // Set under the lock so a waiter can't miss the notification between checking and sleeping
+        {
+            std::lock_guard<std::mutex> lock(jobMutex_);
+            job.done = true;
+        }
+        jobCondition_.notify_all();
+    }
+
+    bool QbVkShaderCompiler::LoadCookedShader(const eastl::string& path, QbVkCompiledShader& shader, eastl::vector<Dependency>& dependencies) {
+        Dependency cooked{ path + ".spv", 0, {} };
+        eastl::vector<char> data;
+        if (!ReadShaderFile(cooked.path.c_str(), data, cooked.writeTime) || data.empty() || data.size() % sizeof(uint32_t) != 0) return false;
+
+        shader.spirv.resize(data.size() / sizeof(uint32_t));
+        memcpy(shader.spirv.data(), data.data(), data.size());
+        if (shader.spirv[0] != SPIRV_MAGIC) {
+            shader.spirv.clear();
+            return false;
+        }
+
+        if (!ShaderReflection::Load((path + ".refl").c_str(), shader.reflection)) {
+#ifdef QB_COOKED_SHADERS_ONLY
+            shader.spirv.clear();
+            return false;
+#else
+            shader.reflection = GetReflection(shader.spirv);
+#endif
+        }
+
+        dependencies.push_back(eastl::move(cooked));
+        return true;
+    }
+
+    bool QbVkShaderCompiler::CompileFromSource(QbVkShaderJob& job, const eastl::string& preamble, eastl::vector<Dependency>& dependencies) {
+#ifdef QB_COOKED_SHADERS_ONLY
+        QB_LOG_ERROR("Shader %s was asked for with defines, but only the default permutation is cooked\n", job.path.c_str());
+        return false;
+#else
+        Dependency source{ job.path, 0, {} };
         eastl::vector<char> bytecode;
-        bytecode.resize(fileSize);
-        size_t result = fread(bytecode.data(), sizeof(char), fileSize, pFile);
-        QB_ASSERT(result == fileSize && "Error reading shader file");
-        fclose(pFile);
+        if (!ReadShaderFile(job.path.c_str(), bytecode, source.writeTime)) {
+            QB_LOG_ERROR("Couldn't read shader file %s\n", job.path.c_str());
+            return false;
+        }
 
         // Add null terminator
         bytecode.push_back('\00');
 
-        EShLanguage language; 
-        if (shaderType == QbVkShaderType::QBVK_SHADER_TYPE_VERTEX) {
-            language = EShLangVertex;
-        }
-        else if (shaderType == QbVkShaderType::QBVK_SHADER_TYPE_FRAGMENT) {
-            language = EShLangFragment;
-        }
-        else if (shaderType == QbVkShaderType::QBVK_SHADER_TYPE_COMPUTE) {
-            language = EShLangCompute;
+        const auto language = GetLanguage(job.shaderType);
+        auto key = Hash::FNV1a(bytecode.data(), bytecode.size(), compilerHash_);
+        key = Hash::Combine(key, language);
+        key = Hash::FNV1a(preamble.data(), preamble.size(), key);
+
+        const bool hit = LoadCachedShader(key, job.shader.spirv, dependencies);
+        if (!hit) {
+            dependencies.clear();
+            job.shader.spirv = Compile(job.path.c_str(), bytecode, language, preamble, dependencies);
+            // Failed compiles aren't cached, so the error shows up again until the source is fixed
+            if (job.shader.spirv.empty()) return false;
+            StoreCachedShader(key, job.shader.spirv, dependencies);
         }
 
-        // Load the shader string into the program
+        job.shader.reflection = GetReflection(job.shader.spirv);
+        dependencies.push_back(eastl::move(source));
+        return hit;
+#endif
+    }
+
+#ifndef QB_COOKED_SHADERS_ONLY
+    std::vector<uint32_t> QbVkShaderCompiler::Compile(const char* path, const eastl::vector<char>& source, EShLanguage language,
+        const eastl::string& preamble, eastl::vector<Dependency>& includes) {
+
+        // Load the shader string into the program, the name is what includes next to the shader are resolved against
         glslang::TShader shader(language);
-        char const* const shaderString = bytecode.data();
-        shader.setStrings(&shaderString, 1);
+        char const* const shaderString = source.data();
+        shader.setStringsWithLengthsAndNames(&shaderString, nullptr, &path, 1);
+        shader.setPreamble(preamble.c_str());
 
         // Prepare the environment
-        const int VERSION = 460;
-        shader.setEnvInput(glslang::EShSourceGlsl, language, glslang::EShClientVulkan, VERSION);
+        shader.setEnvInput(glslang::EShSourceGlsl, language, glslang::EShClientVulkan, GLSL_VERSION);
         shader.setEnvClient(glslang::EShClientVulkan, glslang::EShTargetVulkan_1_1);
         shader.setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_3);
 
         // Prepare for preprocessing
         auto messages = static_cast<EShMessages>(EShMsgSpvRules | EShMsgVulkanRules);
-        if (!shader.parse(&resourceLimits_, VERSION, ECoreProfile, false, true, messages)) {
+        QbVkShaderIncluder includer(includes);
+        if (!shader.parse(&resourceLimits_, GLSL_VERSION, ECoreProfile, false, true, messages, includer)) {
             QB_LOG_WARN("Failed to parse shader %s! %s\n%s", path, shader.getInfoLog(), shader.getInfoDebugLog());
             return {};
         }
@@ -72,6 +444,135 @@ namespace Quadbit {
         return spirvBytecode;
     }
 
+#endif
+
+    bool QbVkShaderCompiler::FindPermutation(uint64_t key, QbVkCompiledShader& shader) {
+        std::lock_guard<std::mutex> lock(permutationMutex_);
+        auto it = permutations_.find(key);
+        if (it == permutations_.end()) return false;
+
+        // An edit to the shader or any of its includes sends it back through the disk cache
+        for (const auto& dependency : it->second.dependencies) {
+            std::error_code error;
+            if (std::filesystem::last_write_time(dependency.path.c_str(), error) != dependency.writeTime || error) return false;
+        }
+        shader = it->second.shader;
+        return true;
+    }
+
+#ifndef QB_COOKED_SHADERS_ONLY
+    eastl::string QbVkShaderCompiler::GetCachePath(uint64_t key) {
+        eastl::string path;
+        path.sprintf("%s/%016llx.spv", SHADER_CACHE_DIRECTORY, static_cast<unsigned long long>(key));
+        return path;
+    }
+
+    // Entries are the include count, then the hash, path length and path of each include, then the SPIR-V
+    bool QbVkShaderCompiler::LoadCachedShader(uint64_t key, std::vector<uint32_t>& spirv, eastl::vector<Dependency>& includes) {
+        eastl::vector<char> entry;
+        std::filesystem::file_time_type writeTime;
+        if (!ReadShaderFile(GetCachePath(key).c_str(), entry, writeTime)) return false;
+
+        // Anything that doesn't parse is treated as a miss and overwritten
+        size_t offset = 0;
+        const auto read = [&](void* destination, size_t size) {
+            if (offset + size > entry.size()) return false;
+            memcpy(destination, entry.data() + offset, size);
+            offset += size;
+            return true;
+        };
+
+        uint32_t includeCount = 0;
+        if (!read(&includeCount, sizeof(uint32_t))) return false;
+        for (uint32_t i = 0; i < includeCount; i++) {
+            Dependency include{};
+            uint32_t pathLength = 0;
+            if (!read(&include.hash, sizeof(uint64_t)) || !read(&pathLength, sizeof(uint32_t)) || offset + pathLength > entry.size()) return false;
+            include.path.assign(entry.data() + offset, pathLength);
+            offset += pathLength;
+            includes.push_back(eastl::move(include));
+        }
+
+        const auto spirvSize = entry.size() - offset;
+        if (spirvSize == 0 || spirvSize % sizeof(uint32_t) != 0) return false;
+        spirv.resize(spirvSize / sizeof(uint32_t));
+        read(spirv.data(), spirvSize);
+
+        // The key only covers the shader's own source, so the entry is stale if any of its includes changed since
+        bool valid = spirv[0] == SPIRV_MAGIC;
+        for (auto& include : includes) {
+            eastl::vector<char> data;
+            if (!valid) break;
+            valid = ReadShaderFile(include.path.c_str(), data, include.writeTime) && Hash::FNV1a(data.data(), data.size()) == include.hash;
+        }
+
+        if (!valid) spirv.clear();
+        return valid;
+    }
+
+    void QbVkShaderCompiler::StoreCachedShader(uint64_t key, const std::vector<uint32_t>& spirv, const eastl::vector<Dependency>& includes) {
+        std::error_code error;
+        std::filesystem::create_directories(SHADER_CACHE_DIRECTORY, error);
+
+        // Written to a temporary file first, so an interrupted write never leaves a truncated entry behind.
+        // The temporary name is per thread, as two jobs with the same source may store at the same time
+        const auto path = GetCachePath(key);
+        eastl::string temporaryPath;
+        temporaryPath.sprintf("%s.%zx.tmp", path.c_str(), std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        FILE* file = fopen(temporaryPath.c_str(), "wb");
+        if (file == nullptr) {
+            QB_LOG_WARN("Failed to write shader cache entry %s\n", path.c_str());
+            return;
+        }
+
+        const auto includeCount = static_cast<uint32_t>(includes.size());
+        bool written = fwrite(&includeCount, sizeof(uint32_t), 1, file) == 1;
+        for (const auto& include : includes) {
+            const auto pathLength = static_cast<uint32_t>(include.path.size());
+            written = written && fwrite(&include.hash, sizeof(uint64_t), 1, file) == 1 && fwrite(&pathLength, sizeof(uint32_t), 1, file) == 1 &&
+                fwrite(include.path.data(), 1, pathLength, file) == pathLength;
+        }
+        written = written && fwrite(spirv.data(), sizeof(uint32_t), spirv.size(), file) == spirv.size();
+        fclose(file);
+
+        if (written) std::filesystem::rename(temporaryPath.c_str(), path.c_str(), error);
+        if (!written || error) {
+            QB_LOG_WARN("Failed to write shader cache entry %s\n", path.c_str());
+            std::filesystem::remove(temporaryPath.c_str(), error);
+        }
+    }
+
+    QbVkShaderReflection QbVkShaderCompiler::GetReflection(const std::vector<uint32_t>& spirv) {
+        auto key = Hash::FNV1a(spirv.data(), spirv.size() * sizeof(uint32_t));
+        key = Hash::Combine(key, SHADER_REFLECTION_VERSION);
+        {
+            std::lock_guard<std::mutex> lock(reflectionMutex_);
+            const auto it = reflections_.find(key);
+            if (it != reflections_.end()) return it->second;
+        }
+
+        eastl::string path;
+        path.sprintf("%s/%016llx.refl", SHADER_CACHE_DIRECTORY, static_cast<unsigned long long>(key));
+
+        QbVkShaderReflection reflection;
+        if (!ShaderReflection::Load(path.c_str(), reflection)) {
+            reflection = ShaderReflection::Reflect(spirv);
+
+            std::error_code error;
+            std::filesystem::create_directories(SHADER_CACHE_DIRECTORY, error);
+            if (!ShaderReflection::Store(path.c_str(), reflection)) {
+                QB_LOG_WARN("Failed to write shader reflection cache entry %s\n", path.c_str());
+            }
+
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            cacheStats_.reflected++;
+        }
+
+        std::lock_guard<std::mutex> lock(reflectionMutex_);
+        reflections_[key] = reflection;
+        return reflection;
+    }
+
     const TBuiltInResource QbVkShaderCompiler::GetResourceLimits(const VkPhysicalDeviceLimits& limits) {
         return TBuiltInResource {
             /* .MaxLights = */ 32,
@@ -179,4 +680,5 @@ namespace Quadbit {
             /* .generalConstantMatrixVectorIndexing = */ 1,
         } };
 	}
-}
\ No newline at end of file
+#endif
+}
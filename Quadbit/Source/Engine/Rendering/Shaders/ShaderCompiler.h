@@ -1,22 +1,161 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <thread>
 #include <vector>
 
+#include <EASTL/deque.h>
+#include <EASTL/hash_map.h>
+#include <EASTL/shared_ptr.h>
+#include <EASTL/string.h>
+#include <EASTL/vector.h>
+
+#ifndef QB_COOKED_SHADERS_ONLY
 #include <glslang/Public/ShaderLang.h>
 #include <SPIRV/GlslangToSpv.h>
+#endif
 
 #include "Engine/Rendering/VulkanTypes.h"
+#include "Engine/Rendering/Shaders/ShaderReflection.h"
+
+constexpr const char* SHADER_CACHE_DIRECTORY = "ShaderCache";
+// Bump when anything that changes the generated SPIR-V changes outside of the source, such as the compile options
+constexpr uint32_t SHADER_CACHE_VERSION = 2;
+// #include "..." is resolved next to the including file first, then from here, #include <...> only from here
+constexpr const char* SHADER_INCLUDE_ROOT = "Assets";
+constexpr uint32_t MAX_SHADER_COMPILER_THREADS = 8;
+// How often the files shaders were built from are checked for changes
+constexpr uint32_t SHADER_WATCH_INTERVAL_MS = 250;
 
 namespace Quadbit {
+	struct QbVkShaderCacheStats {
+		uint32_t hits = 0;
+		uint32_t misses = 0;
+		// Shaders that had to go through SPIRV-Cross, the rest had their reflection cached
+		uint32_t reflected = 0;
+		// Time spent compiling and in cache lookups, summed over all compiler threads
+		float milliseconds = 0.0f;
+	};
+
+	struct QbVkCompiledShader {
+		std::vector<uint32_t> spirv;
+		QbVkShaderReflection reflection;
+	};
+
+	// A shader submitted for compilation, the result is valid once done is set (the SPIR-V is empty if compilation failed)
+	struct QbVkShaderJob {
+		eastl::string path;
+		QbVkShaderType shaderType;
+		QbVkShaderDefines defines;
+		QbVkCompiledShader shader;
+		std::atomic<bool> done = false;
+	};
+	using QbVkShaderJobHandle = eastl::shared_ptr<QbVkShaderJob>;
+
+	// Compiles shaders on a pool of worker threads, each job gets its own glslang shader and program.
+	// Compiled SPIR-V is cached on disk, keyed by a hash of the source, the stage, the defines and the compiler version
+	// and settings. Entries list the files the shader included, and are only used while those are unchanged.
+	// Each permutation (file, stage, defines) is also kept in memory for as long as its files are untouched,
+	// so asking for the same variant again costs a few file timestamp checks.
+	// Reflection is cached the same way, in memory and on disk, keyed by a hash of the SPIR-V.
+	// In the engine a watcher thread polls every file a shader was built from, so edits can be hot reloaded.
+	// Shaders cooked by the ShaderCooker (<shader>.spv and <shader>.refl) are loaded in place of sources that
+	// aren't there. With QB_COOKED_SHADERS_ONLY defined, nothing else is loaded and glslang isn't needed
 	class QbVkShaderCompiler {
 	public:
 		QbVkShaderCompiler(QbVkContext& context);
+		// Compiles against limits any device supports, for offline tools
+		QbVkShaderCompiler();
+		~QbVkShaderCompiler();
+
+		// Submit every stage that is needed up front and wait on them afterwards, so they compile in parallel
+		QbVkShaderJobHandle Submit(const char* path, QbVkShaderType shaderType, const QbVkShaderDefines& defines = {});
+		// Blocks until the job is done, compiling queued jobs on the calling thread in the meantime
+		QbVkCompiledShader Wait(const QbVkShaderJobHandle& job);
+		QbVkCompiledShader CompileShader(const char* path, QbVkShaderType shaderType, const QbVkShaderDefines& defines = {});
+
+		QbVkShaderCacheStats GetCacheStats();
+		void ResetCacheStats();
+
+		// Paths of shaders whose source or includes changed since they were last compiled, each reported once
+		eastl::vector<eastl::string> TakeChangedShaders();
 
-		std::vector<uint32_t> CompileShader(const char* path, QbVkShaderType shaderType);
+		// A file the compiled shader was built from, either the shader itself or one of its includes
+		struct Dependency {
+			eastl::string path;
+			uint64_t hash;
+			std::filesystem::file_time_type writeTime;
+		};
 
 	private:
+		struct Permutation {
+			QbVkCompiledShader shader;
+			eastl::vector<Dependency> dependencies;
+		};
+
+		struct WatchedFile {
+			std::filesystem::file_time_type writeTime;
+			// Shaders built from the file
+			eastl::vector<eastl::string> shaders;
+		};
+
+#ifndef QB_COOKED_SHADERS_ONLY
 		TBuiltInResource resourceLimits_;
+#endif
+		// Hash of everything other than the source that affects the output
+		uint64_t compilerHash_;
+
+		std::mutex statsMutex_;
+		QbVkShaderCacheStats cacheStats_;
+
+		std::mutex permutationMutex_;
+		eastl::hash_map<uint64_t, Permutation> permutations_;
+
+#ifndef QB_COOKED_SHADERS_ONLY
+		std::mutex reflectionMutex_;
+		eastl::hash_map<uint64_t, QbVkShaderReflection> reflections_;
+#endif
 
+		eastl::vector<std::thread> workers_;
+		std::mutex jobMutex_;
+		// Signalled when a job is queued, and when one finishes
+		std::condition_variable jobCondition_;
+		eastl::deque<QbVkShaderJobHandle> jobs_;
+		bool stopping_ = false;
+
+		std::thread watcher_;
+		std::mutex watchMutex_;
+		// Signalled when stopping, so the watcher doesn't sleep out its interval
+		std::condition_variable watchCondition_;
+		eastl::hash_map<eastl::string, WatchedFile> watchedFiles_;
+		eastl::vector<eastl::string> changedShaders_;
+		bool stopWatching_ = false;
+
+		QbVkShaderCompiler(const VkPhysicalDeviceLimits& limits);
+
+		void WorkerLoop();
+		void WatcherLoop();
+		void Run(QbVkShaderJob& job);
+		void Watch(const eastl::string& path, const eastl::vector<Dependency>& dependencies);
+		bool FindPermutation(uint64_t key, QbVkCompiledShader& shader);
+		bool LoadCookedShader(const eastl::string& path, QbVkCompiledShader& shader, eastl::vector<Dependency>& dependencies);
+		// Returns whether the SPIR-V came from the disk cache
+		bool CompileFromSource(QbVkShaderJob& job, const eastl::string& preamble, eastl::vector<Dependency>& dependencies);
+
+#ifndef QB_COOKED_SHADERS_ONLY
 		const TBuiltInResource GetResourceLimits(const VkPhysicalDeviceLimits& limits);
+		std::vector<uint32_t> Compile(const char* path, const eastl::vector<char>& source, EShLanguage language,
+			const eastl::string& preamble, eastl::vector<Dependency>& includes);
+
+		eastl::string GetCachePath(uint64_t key);
+		bool LoadCachedShader(uint64_t key, std::vector<uint32_t>& spirv, eastl::vector<Dependency>& includes);
+		void StoreCachedShader(uint64_t key, const std::vector<uint32_t>& spirv, const eastl::vector<Dependency>& includes);
+		// Only runs SPIRV-Cross on SPIR-V it hasn't seen before, in this run or an earlier one
+		QbVkShaderReflection GetReflection(const std::vector<uint32_t>& spirv);
+#endif
 	};
 }
\ No newline at end of file
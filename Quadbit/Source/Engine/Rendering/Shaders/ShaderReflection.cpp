@@ -0,0 +1,238 @@
+#include "ShaderReflection.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <thread>
+
+#include <EASTL/sort.h>
+
+#ifndef QB_COOKED_SHADERS_ONLY
+#include <SPIRV-Cross/spirv_cross.hpp>
+#endif
+
+#include "Engine/Core/Logging.h"
+
+namespace Quadbit::ShaderReflection {
+	constexpr uint32_t REFLECTION_MAGIC = 0x46524251; // "QBRF"
+
+	namespace {
+		class Writer {
+		public:
+			eastl::vector<uint8_t> data;
+
+			void Write(const void* value, size_t size) {
+				const auto* bytes = static_cast<const uint8_t*>(value);
+				data.insert(data.end(), bytes, bytes + size);
+			}
+			void Write(uint32_t value) { Write(&value, sizeof(uint32_t)); }
+		};
+
+		class Reader {
+		public:
+			Reader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+			bool Read(void* value, size_t size) {
+				if (offset_ + size > size_) return false;
+				memcpy(value, data_ + offset_, size);
+				offset_ += size;
+				return true;
+			}
+			bool Read(uint32_t& value) { return Read(&value, sizeof(uint32_t)); }
+			bool AtEnd() const { return offset_ == size_; }
+
+		private:
+			const uint8_t* data_;
+			size_t size_;
+			size_t offset_ = 0;
+		};
+	}
+
+#ifndef QB_COOKED_SHADERS_ONLY
+	QbVkShaderReflection Reflect(const std::vector<uint32_t>& spirv) {
+		QbVkShaderReflection reflection;
+
+		spirv_cross::Compiler compiler(spirv.data(), spirv.size());
+		const auto resources = compiler.get_shader_resources();
+
+		const auto reflectResource = [&](const spirv_cross::Resource& resource, VkDescriptorType descriptorType, uint32_t size) {
+			uint32_t descriptorCount = 1;
+			const spirv_cross::SPIRType& type = compiler.get_type(resource.type_id);
+			if (!type.array.empty()) {
+				QB_ASSERT(type.array.size() == 1 &&
+					"There is currently no support for multidimensional arrays in shaders!");
+				descriptorCount = type.array[0];
+			}
+
+			reflection.resources.push_back({ resource.name.c_str(), descriptorType,
+				compiler.get_decoration(resource.id, spv::DecorationDescriptorSet),
+				compiler.get_decoration(resource.id, spv::DecorationBinding), descriptorCount, size });
+		};
+
+		for (const auto& sampler : resources.sampled_images) reflectResource(sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0);
+		for (const auto& uniformBuffer : resources.uniform_buffers) {
+			const auto size = compiler.get_declared_struct_size(compiler.get_type(uniformBuffer.base_type_id));
+			reflectResource(uniformBuffer, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, static_cast<uint32_t>(size));
+		}
+		for (const auto& storageBuffer : resources.storage_buffers) reflectResource(storageBuffer, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0);
+		for (const auto& storageImage : resources.storage_images) reflectResource(storageImage, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0);
+
+		// Inputs are assumed to be vectors of 32-bit floats
+		for (const auto& input : resources.stage_inputs) {
+			const auto location = compiler.get_decoration(input.id, spv::DecorationLocation);
+			const auto& type = compiler.get_type(input.type_id);
+			reflection.vertexInputs.push_back({ location, type.vecsize * static_cast<uint32_t>(sizeof(float)) });
+		}
+		eastl::sort(reflection.vertexInputs.begin(), reflection.vertexInputs.end(),
+			[](const VertexInput& a, const VertexInput& b) { return a.location < b.location; });
+
+		if (!resources.push_constant_buffers.empty()) {
+			reflection.pushConstantSize = static_cast<uint32_t>(compiler.get_declared_struct_size(
+				compiler.get_type(resources.push_constant_buffers.front().base_type_id)));
+		}
+
+		for (const auto& specConstant : compiler.get_specialization_constants()) {
+			const auto& type = compiler.get_type(compiler.get_constant(specConstant.id).constant_type);
+			uint32_t size = 0;
+			if (type.vecsize == 1 && type.columns == 1) {
+				switch (type.basetype) {
+				case spirv_cross::SPIRType::Boolean:
+					size = sizeof(VkBool32);
+					break;
+				case spirv_cross::SPIRType::SByte:
+				case spirv_cross::SPIRType::UByte:
+				case spirv_cross::SPIRType::Short:
+				case spirv_cross::SPIRType::UShort:
+				case spirv_cross::SPIRType::Half:
+				case spirv_cross::SPIRType::Int:
+				case spirv_cross::SPIRType::UInt:
+				case spirv_cross::SPIRType::Float:
+				case spirv_cross::SPIRType::Int64:
+				case spirv_cross::SPIRType::UInt64:
+				case spirv_cross::SPIRType::Double:
+					size = type.width / 8;
+					break;
+				default:
+					break;
+				}
+			}
+			reflection.specConstants.push_back({ specConstant.constant_id, size });
+		}
+
+		return reflection;
+	}
+#endif
+
+	eastl::vector<uint8_t> Serialize(const QbVkShaderReflection& reflection) {
+		Writer writer;
+		writer.Write(REFLECTION_MAGIC);
+		writer.Write(SHADER_REFLECTION_VERSION);
+
+		writer.Write(static_cast<uint32_t>(reflection.resources.size()));
+		for (const auto& resource : reflection.resources) {
+			writer.Write(static_cast<uint32_t>(resource.name.size()));
+			writer.Write(resource.name.data(), resource.name.size());
+			writer.Write(static_cast<uint32_t>(resource.descriptorType));
+			writer.Write(resource.set);
+			writer.Write(resource.binding);
+			writer.Write(resource.descriptorCount);
+			writer.Write(resource.size);
+		}
+
+		writer.Write(static_cast<uint32_t>(reflection.vertexInputs.size()));
+		for (const auto& input : reflection.vertexInputs) {
+			writer.Write(input.location);
+			writer.Write(input.size);
+		}
+
+		writer.Write(reflection.pushConstantSize);
+
+		writer.Write(static_cast<uint32_t>(reflection.specConstants.size()));
+		for (const auto& specConstant : reflection.specConstants) {
+			writer.Write(specConstant.constantId);
+			writer.Write(specConstant.size);
+		}
+
+		return eastl::move(writer.data);
+	}
+
+	bool Deserialize(const uint8_t* data, size_t size, QbVkShaderReflection& reflection) {
+		Reader reader(data, size);
+		reflection = {};
+
+		uint32_t magic, version;
+		if (!reader.Read(magic) || !reader.Read(version) || magic != REFLECTION_MAGIC || version != SHADER_REFLECTION_VERSION) return false;
+
+		uint32_t resourceCount;
+		if (!reader.Read(resourceCount)) return false;
+		for (uint32_t i = 0; i < resourceCount; i++) {
+			QbVkReflectedResource resource;
+			uint32_t nameLength, descriptorType;
+			if (!reader.Read(nameLength) || nameLength > size) return false;
+			resource.name.resize(nameLength);
+			if (!reader.Read(resource.name.data(), nameLength) || !reader.Read(descriptorType) || !reader.Read(resource.set) ||
+				!reader.Read(resource.binding) || !reader.Read(resource.descriptorCount) || !reader.Read(resource.size)) {
+				return false;
+			}
+			resource.descriptorType = static_cast<VkDescriptorType>(descriptorType);
+			reflection.resources.push_back(eastl::move(resource));
+		}
+
+		uint32_t inputCount;
+		if (!reader.Read(inputCount)) return false;
+		for (uint32_t i = 0; i < inputCount; i++) {
+			VertexInput input;
+			if (!reader.Read(input.location) || !reader.Read(input.size)) return false;
+			reflection.vertexInputs.push_back(input);
+		}
+
+		if (!reader.Read(reflection.pushConstantSize)) return false;
+
+		uint32_t specConstantCount;
+		if (!reader.Read(specConstantCount)) return false;
+		for (uint32_t i = 0; i < specConstantCount; i++) {
+			QbVkReflectedSpecConstant specConstant;
+			if (!reader.Read(specConstant.constantId) || !reader.Read(specConstant.size)) return false;
+			reflection.specConstants.push_back(specConstant);
+		}
+
+		return reader.AtEnd();
+	}
+
+	bool Load(const char* path, QbVkShaderReflection& reflection) {
+		FILE* file = fopen(path, "rb");
+		if (file == nullptr) return false;
+
+		fseek(file, 0, SEEK_END);
+		const auto size = ftell(file);
+		rewind(file);
+
+		eastl::vector<uint8_t> data(size > 0 ? size : 0);
+		const bool read = size > 0 && fread(data.data(), 1, size, file) == static_cast<size_t>(size);
+		fclose(file);
+
+		return read && Deserialize(data.data(), data.size(), reflection);
+	}
+
+	bool Store(const char* path, const QbVkShaderReflection& reflection) {
+		const auto data = Serialize(reflection);
+
+		// Written to a temporary file first, so an interrupted write never leaves a truncated file behind.
+		// The temporary name is per thread, as the compiler's workers may store the same reflection at the same time
+		eastl::string temporaryPath;
+		temporaryPath.sprintf("%s.%zx.tmp", path, std::hash<std::thread::id>{}(std::this_thread::get_id()));
+		FILE* file = fopen(temporaryPath.c_str(), "wb");
+		if (file == nullptr) return false;
+		const bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+		fclose(file);
+
+		std::error_code error;
+		if (written) std::filesystem::rename(temporaryPath.c_str(), path, error);
+		if (!written || error) {
+			std::filesystem::remove(temporaryPath.c_str(), error);
+			return false;
+		}
+		return true;
+	}
+}
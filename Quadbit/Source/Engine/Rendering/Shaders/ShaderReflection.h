@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <EASTL/string.h>
+#include <EASTL/vector.h>
+
+#include <vulkan/vulkan.h>
+
+// Bump when the layout of serialised reflection changes
+constexpr uint32_t SHADER_REFLECTION_VERSION = 2;
+
+namespace Quadbit {
+	struct QbVkReflectedResource {
+		eastl::string name;
+		VkDescriptorType descriptorType;
+		uint32_t set;
+		uint32_t binding;
+		uint32_t descriptorCount;
+		// Declared size of uniform buffers, zero for other resources
+		uint32_t size;
+	};
+
+	struct VertexInput {
+		uint32_t location;
+		uint32_t size;
+	};
+
+	struct QbVkReflectedSpecConstant {
+		uint32_t constantId;
+		// Size of the value the pipeline has to provide, bools are 32-bit. Zero for types that can't be specialised
+		uint32_t size;
+	};
+
+	// The interface of a shader as pipeline creation sees it
+	struct QbVkShaderReflection {
+		// Sampled images, then uniform buffers, storage buffers and storage images
+		eastl::vector<QbVkReflectedResource> resources;
+		// Sorted by location
+		eastl::vector<VertexInput> vertexInputs;
+		uint32_t pushConstantSize = 0;
+		eastl::vector<QbVkReflectedSpecConstant> specConstants;
+	};
+
+	namespace ShaderReflection {
+#ifndef QB_COOKED_SHADERS_ONLY
+		// Runs SPIRV-Cross over the shader
+		QbVkShaderReflection Reflect(const std::vector<uint32_t>& spirv);
+#endif
+
+		eastl::vector<uint8_t> Serialize(const QbVkShaderReflection& reflection);
+		bool Deserialize(const uint8_t* data, size_t size, QbVkShaderReflection& reflection);
+
+		bool Load(const char* path, QbVkShaderReflection& reflection);
+		bool Store(const char* path, const QbVkShaderReflection& reflection);
+	}
+}
@@ -0,0 +1,402 @@
+#include "BlockCompression.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <EASTL/algorithm.h>
+
+namespace Quadbit::BlockCompression {
+	namespace {
+		uint16_t PackRGB565(const float* colour) {
+			const auto r = static_cast<uint16_t>(eastl::clamp(colour[0], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+			const auto g = static_cast<uint16_t>(eastl::clamp(colour[1], 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+			const auto b = static_cast<uint16_t>(eastl::clamp(colour[2], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+			return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+		}
+
+		void UnpackRGB565(uint16_t packed, uint8_t* colour) {
+			const uint8_t r = (packed >> 11) & 31;
+			const uint8_t g = (packed >> 5) & 63;
+			const uint8_t b = packed & 31;
+			colour[0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+			colour[1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+			colour[2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+			colour[3] = 255;
+		}
+
+		// In four colour mode the endpoints are followed by two interpolated colours,
+		// otherwise by their midpoint and transparent black
+		void BuildColourPalette(uint16_t c0, uint16_t c1, bool fourColour, uint8_t palette[4][4]) {
+			UnpackRGB565(c0, palette[0]);
+			UnpackRGB565(c1, palette[1]);
+			for (int i = 0; i < 3; i++) {
+				if (fourColour) {
+					palette[2][i] = static_cast<uint8_t>((2 * palette[0][i] + palette[1][i]) / 3);
+					palette[3][i] = static_cast<uint8_t>((palette[0][i] + 2 * palette[1][i]) / 3);
+				}
+				else {
+					palette[2][i] = static_cast<uint8_t>((palette[0][i] + palette[1][i]) / 2);
+					palette[3][i] = 0;
+				}
+			}
+			palette[2][3] = 255;
+			palette[3][3] = fourColour ? 255 : 0;
+		}
+
+		// Eight values between the endpoints if the first is larger,
+		// otherwise six values followed by 0 and 255
+		void BuildAlphaPalette(uint8_t a0, uint8_t a1, uint8_t palette[8]) {
+			palette[0] = a0;
+			palette[1] = a1;
+			if (a0 > a1) {
+				for (int i = 1; i < 7; i++) {
+					palette[i + 1] = static_cast<uint8_t>(((7 - i) * a0 + i * a1) / 7);
+				}
+			}
+			else {
+				for (int i = 1; i < 5; i++) {
+					palette[i + 1] = static_cast<uint8_t>(((5 - i) * a0 + i * a1) / 5);
+				}
+				palette[6] = 0;
+				palette[7] = 255;
+			}
+		}
+
+		uint32_t ColourDistance(const uint8_t* a, const uint8_t* b) {
+			const int dr = a[0] - b[0];
+			const int dg = a[1] - b[1];
+			const int db = a[2] - b[2];
+			return static_cast<uint32_t>(dr * dr + dg * dg + db * db);
+		}
+
+		void EncodeColourBlock(const uint8_t* pixels, uint8_t* block, bool allowTransparency) {
+			bool transparent[16]{};
+			bool hasTransparency = false;
+			if (allowTransparency) {
+				for (int i = 0; i < 16; i++) {
+					transparent[i] = pixels[i * 4 + 3] < 128;
+					hasTransparency |= transparent[i];
+				}
+			}
+
+			// Fit the endpoints along the principal axis of the opaque colours
+			float mean[3]{};
+			int count = 0;
+			for (int i = 0; i < 16; i++) {
+				if (transparent[i]) continue;
+				for (int c = 0; c < 3; c++) mean[c] += pixels[i * 4 + c];
+				count++;
+			}
+
+			uint16_t c0 = 0;
+			uint16_t c1 = 0;
+			if (count > 0) {
+				for (int c = 0; c < 3; c++) mean[c] /= static_cast<float>(count);
+
+				float covariance[6]{};
+				for (int i = 0; i < 16; i++) {
+					if (transparent[i]) continue;
+					const float r = pixels[i * 4 + 0] - mean[0];
+					const float g = pixels[i * 4 + 1] - mean[1];
+					const float b = pixels[i * 4 + 2] - mean[2];
+					covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+					covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+				}
+
+				// A few rounds of power iteration are plenty for a 3x3 matrix
+				float axis[3]{ 1.0f, 1.0f, 1.0f };
+				for (int iteration = 0; iteration < 8; iteration++) {
+					const float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+					const float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+					const float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+					const float length = std::sqrt(x * x + y * y + z * z);
+					if (length < 1e-6f) break;
+					axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+				}
+
+				float minT = 0.0f, maxT = 0.0f;
+				for (int i = 0; i < 16; i++) {
+					if (transparent[i]) continue;
+					const float t = (pixels[i * 4 + 0] - mean[0]) * axis[0] + (pixels[i * 4 + 1] - mean[1]) * axis[1] + (pixels[i * 4 + 2] - mean[2]) * axis[2];
+					minT = eastl::min(minT, t);
+					maxT = eastl::max(maxT, t);
+				}
+
+				float high[3], low[3];
+				for (int c = 0; c < 3; c++) {
+					high[c] = mean[c] + axis[c] * maxT;
+					low[c] = mean[c] + axis[c] * minT;
+				}
+				c0 = PackRGB565(high);
+				c1 = PackRGB565(low);
+			}
+
+			// Four colour mode needs c0 > c1, three colour mode (with transparency) c0 <= c1
+			if (hasTransparency ? (c0 > c1) : (c0 < c1)) eastl::swap(c0, c1);
+			const bool fourColour = c0 > c1;
+
+			uint8_t palette[4][4];
+			BuildColourPalette(c0, c1, fourColour, palette);
+
+			uint32_t indices = 0;
+			for (int i = 0; i < 16; i++) {
+				uint32_t best = 0;
+				if (transparent[i]) {
+					best = 3;
+				}
+				else if (c0 != c1) {
+					uint32_t bestDistance = UINT32_MAX;
+					for (uint32_t j = 0; j < (fourColour ? 4u : 3u); j++) {
+						const auto distance = ColourDistance(&pixels[i * 4], palette[j]);
+						if (distance < bestDistance) {
+							bestDistance = distance;
+							best = j;
+						}
+					}
+				}
+				indices |= best << (i * 2);
+			}
+
+			block[0] = c0 & 0xFF; block[1] = c0 >> 8;
+			block[2] = c1 & 0xFF; block[3] = c1 >> 8;
+			memcpy(block + 4, &indices, sizeof(uint32_t));
+		}
+
+		// Without punch through alpha the black of three colour blocks is opaque
+		void DecodeColourBlock(const uint8_t* block, uint8_t* pixels, bool forceFourColour, bool punchThroughAlpha) {
+			const uint16_t c0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+			const uint16_t c1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+			uint8_t palette[4][4];
+			BuildColourPalette(c0, c1, forceFourColour || c0 > c1, palette);
+			if (!punchThroughAlpha) palette[3][3] = 255;
+
+			uint32_t indices;
+			memcpy(&indices, block + 4, sizeof(uint32_t));
+			for (int i = 0; i < 16; i++) {
+				memcpy(&pixels[i * 4], palette[(indices >> (i * 2)) & 3], 4);
+			}
+		}
+
+		// Walks the 4x4 blocks of an image, gathering or scattering the pixels of each
+		template<typename F>
+		void ForEachBlock(uint32_t width, uint32_t height, F&& func) {
+			for (uint32_t by = 0; by < (height + 3) / 4; by++) {
+				for (uint32_t bx = 0; bx < (width + 3) / 4; bx++) {
+					func(bx, by);
+				}
+			}
+		}
+	}
+
+	bool IsBlockCompressed(VkFormat format) {
+		return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK;
+	}
+
+	bool IsSupported(VkFormat format) {
+		switch (format) {
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	bool IsSRGB(VkFormat format) {
+		return format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK || format == VK_FORMAT_BC2_SRGB_BLOCK ||
+			format == VK_FORMAT_BC3_SRGB_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK || format == VK_FORMAT_R8G8B8A8_SRGB;
+	}
+
+	uint32_t GetBlockSize(VkFormat format) {
+		switch (format) {
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+		case VK_FORMAT_BC4_SNORM_BLOCK:
+			return 8;
+		default:
+			return IsBlockCompressed(format) ? 16 : 0;
+		}
+	}
+
+	VkDeviceSize GetLevelSize(VkFormat format, uint32_t width, uint32_t height) {
+		const auto blockSize = GetBlockSize(format);
+		if (blockSize == 0) return static_cast<VkDeviceSize>(width) * height * 4;
+		return static_cast<VkDeviceSize>((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+	}
+
+	void EncodeBC1(const uint8_t* pixels, uint8_t* block) {
+		EncodeColourBlock(pixels, block, true);
+	}
+
+	void EncodeBC3(const uint8_t* pixels, uint8_t* block) {
+		EncodeBC4(pixels, block, 3);
+		EncodeColourBlock(pixels, block + 8, false);
+	}
+
+	void EncodeBC4(const uint8_t* pixels, uint8_t* block, uint32_t channel) {
+		uint8_t minValue = 255, maxValue = 0;
+		for (int i = 0; i < 16; i++) {
+			minValue = eastl::min(minValue, pixels[i * 4 + channel]);
+			maxValue = eastl::max(maxValue, pixels[i * 4 + channel]);
+		}
+
+		// The larger endpoint goes first to get all eight interpolated values
+		uint8_t palette[8];
+		BuildAlphaPalette(maxValue, minValue, palette);
+
+		uint64_t indices = 0;
+		if (maxValue != minValue) {
+			for (int i = 0; i < 16; i++) {
+				uint64_t best = 0;
+				int bestDistance = 256;
+				for (uint64_t j = 0; j < 8; j++) {
+					const int distance = std::abs(static_cast<int>(pixels[i * 4 + channel]) - palette[j]);
+					if (distance < bestDistance) {
+						bestDistance = distance;
+						best = j;
+					}
+				}
+				indices |= best << (i * 3);
+			}
+		}
+
+		block[0] = maxValue;
+		block[1] = minValue;
+		for (int i = 0; i < 6; i++) {
+			block[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+		}
+	}
+
+	void EncodeBC5(const uint8_t* pixels, uint8_t* block) {
+		EncodeBC4(pixels, block, 0);
+		EncodeBC4(pixels, block + 8, 1);
+	}
+
+	void DecodeBC1(const uint8_t* block, uint8_t* pixels, bool punchThroughAlpha) {
+		DecodeColourBlock(block, pixels, false, punchThroughAlpha);
+	}
+
+	void DecodeBC3(const uint8_t* block, uint8_t* pixels) {
+		// BC3 colour blocks always use four colours
+		DecodeColourBlock(block + 8, pixels, true, false);
+		DecodeBC4(block, pixels, 3);
+	}
+
+	void DecodeBC4(const uint8_t* block, uint8_t* pixels, uint32_t channel) {
+		uint8_t palette[8];
+		BuildAlphaPalette(block[0], block[1], palette);
+
+		uint64_t indices = 0;
+		for (int i = 0; i < 6; i++) {
+			indices |= static_cast<uint64_t>(block[2 + i]) << (i * 8);
+		}
+		for (int i = 0; i < 16; i++) {
+			pixels[i * 4 + channel] = palette[(indices >> (i * 3)) & 7];
+		}
+	}
+
+	void DecodeBC5(const uint8_t* block, uint8_t* pixels) {
+		for (int i = 0; i < 16; i++) {
+			pixels[i * 4 + 2] = 0;
+			pixels[i * 4 + 3] = 255;
+		}
+		DecodeBC4(block, pixels, 0);
+		DecodeBC4(block + 8, pixels, 1);
+	}
+
+	eastl::vector<uint8_t> EncodeImage(VkFormat format, const uint8_t* rgba, uint32_t width, uint32_t height) {
+		eastl::vector<uint8_t> blocks(static_cast<size_t>(GetLevelSize(format, width, height)));
+		const auto blockSize = GetBlockSize(format);
+
+		uint8_t* block = blocks.data();
+		ForEachBlock(width, height, [&](uint32_t bx, uint32_t by) {
+			uint8_t pixels[64];
+			for (uint32_t y = 0; y < 4; y++) {
+				for (uint32_t x = 0; x < 4; x++) {
+					const auto px = eastl::min(bx * 4 + x, width - 1);
+					const auto py = eastl::min(by * 4 + y, height - 1);
+					memcpy(&pixels[(y * 4 + x) * 4], &rgba[(static_cast<size_t>(py) * width + px) * 4], 4);
+				}
+			}
+
+			switch (format) {
+			case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+			case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+				EncodeColourBlock(pixels, block, false);
+				break;
+			case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+			case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+				EncodeBC1(pixels, block);
+				break;
+			case VK_FORMAT_BC3_UNORM_BLOCK:
+			case VK_FORMAT_BC3_SRGB_BLOCK:
+				EncodeBC3(pixels, block);
+				break;
+			case VK_FORMAT_BC4_UNORM_BLOCK:
+				EncodeBC4(pixels, block, 0);
+				break;
+			case VK_FORMAT_BC5_UNORM_BLOCK:
+				EncodeBC5(pixels, block);
+				break;
+			default:
+				return;
+			}
+			block += blockSize;
+		});
+		return blocks;
+	}
+
+	eastl::vector<uint8_t> DecodeImage(VkFormat format, const uint8_t* blocks, uint32_t width, uint32_t height) {
+		eastl::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+		const auto blockSize = GetBlockSize(format);
+
+		const uint8_t* block = blocks;
+		ForEachBlock(width, height, [&](uint32_t bx, uint32_t by) {
+			uint8_t pixels[64];
+			switch (format) {
+			case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+			case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+				DecodeBC1(block, pixels, false);
+				break;
+			case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+			case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+				DecodeBC1(block, pixels);
+				break;
+			case VK_FORMAT_BC3_UNORM_BLOCK:
+			case VK_FORMAT_BC3_SRGB_BLOCK:
+				DecodeBC3(block, pixels);
+				break;
+			case VK_FORMAT_BC4_UNORM_BLOCK:
+				DecodeBC4(block, pixels, 0);
+				for (int i = 0; i < 16; i++) {
+					pixels[i * 4 + 1] = pixels[i * 4 + 2] = 0;
+					pixels[i * 4 + 3] = 255;
+				}
+				break;
+			case VK_FORMAT_BC5_UNORM_BLOCK:
+				DecodeBC5(block, pixels);
+				break;
+			default:
+				return;
+			}
+			block += blockSize;
+
+			for (uint32_t y = 0; y < 4 && by * 4 + y < height; y++) {
+				for (uint32_t x = 0; x < 4 && bx * 4 + x < width; x++) {
+					memcpy(&rgba[((static_cast<size_t>(by) * 4 + y) * width + bx * 4 + x) * 4], &pixels[(y * 4 + x) * 4], 4);
+				}
+			}
+		});
+		return rgba;
+	}
+}
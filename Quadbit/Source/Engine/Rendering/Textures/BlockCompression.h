@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+#include <EASTL/vector.h>
+#include <vulkan/vulkan.h>
+
+// CPU encoders and reference decoders for the BCn formats. Used by the texture cooker,
+// and by the loader to decode compressed textures on devices without BC support.
+// BC7 is only understood as far as block sizes go, it has to be decoded by the GPU
+namespace Quadbit::BlockCompression {
+	bool IsBlockCompressed(VkFormat format);
+	// Whether the CPU can encode and decode the format
+	bool IsSupported(VkFormat format);
+	bool IsSRGB(VkFormat format);
+
+	// Bytes per 4x4 block, 0 for formats that aren't block compressed
+	uint32_t GetBlockSize(VkFormat format);
+	VkDeviceSize GetLevelSize(VkFormat format, uint32_t width, uint32_t height);
+
+	// A block covers 4x4 pixels, the pixels are tightly packed RGBA8
+	void EncodeBC1(const uint8_t* pixels, uint8_t* block);
+	void EncodeBC3(const uint8_t* pixels, uint8_t* block);
+	void EncodeBC4(const uint8_t* pixels, uint8_t* block, uint32_t channel);
+	void EncodeBC5(const uint8_t* pixels, uint8_t* block);
+
+	// Index 3 of three colour blocks is transparent black with punch through alpha (BC1_RGBA), opaque black without (BC1_RGB)
+	void DecodeBC1(const uint8_t* block, uint8_t* pixels, bool punchThroughAlpha = true);
+	void DecodeBC3(const uint8_t* block, uint8_t* pixels);
+	void DecodeBC4(const uint8_t* block, uint8_t* pixels, uint32_t channel);
+	void DecodeBC5(const uint8_t* block, uint8_t* pixels);
+
+	// Whole images, partial blocks at the edges are padded by clamping
+	eastl::vector<uint8_t> EncodeImage(VkFormat format, const uint8_t* rgba, uint32_t width, uint32_t height);
+	eastl::vector<uint8_t> DecodeImage(VkFormat format, const uint8_t* blocks, uint32_t width, uint32_t height);
+}
@@ -0,0 +1,58 @@
+#include "Mipmaps.h"
+
+#include <cmath>
+
+#include <EASTL/algorithm.h>
+#include <EASTL/array.h>
+
+namespace Quadbit::Mipmaps {
+	namespace {
+		const eastl::array<float, 256>& GetLinearTable() {
+			static const auto table = [] {
+				eastl::array<float, 256> linear;
+				for (uint32_t i = 0; i < 256; i++) {
+					const float srgb = static_cast<float>(i) / 255.0f;
+					linear[i] = (srgb <= 0.04045f) ? srgb / 12.92f : std::pow((srgb + 0.055f) / 1.055f, 2.4f);
+				}
+				return linear;
+			}();
+			return table;
+		}
+
+		uint8_t SRGBFromLinear(float linear) {
+			const float srgb = (linear <= 0.0031308f) ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+			return static_cast<uint8_t>(eastl::clamp(srgb, 0.0f, 1.0f) * 255.0f + 0.5f);
+		}
+	}
+
+	uint32_t GetLevelCount(uint32_t width, uint32_t height) {
+		uint32_t levels = 1;
+		for (auto size = eastl::max(width, height); size > 1; size >>= 1) levels++;
+		return levels;
+	}
+
+	eastl::vector<uint8_t> Downsample(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb) {
+		const auto& linear = GetLinearTable();
+		const auto dstWidth = eastl::max(width / 2, 1u);
+		const auto dstHeight = eastl::max(height / 2, 1u);
+		eastl::vector<uint8_t> result(static_cast<size_t>(dstWidth) * dstHeight * 4);
+		for (uint32_t y = 0; y < dstHeight; y++) {
+			for (uint32_t x = 0; x < dstWidth; x++) {
+				const uint32_t x0 = eastl::min(x * 2, width - 1), x1 = eastl::min(x * 2 + 1, width - 1);
+				const uint32_t y0 = eastl::min(y * 2, height - 1), y1 = eastl::min(y * 2 + 1, height - 1);
+				for (uint32_t c = 0; c < 4; c++) {
+					const uint8_t a = rgba[(y0 * width + x0) * 4 + c], b = rgba[(y0 * width + x1) * 4 + c];
+					const uint8_t d = rgba[(y1 * width + x0) * 4 + c], e = rgba[(y1 * width + x1) * 4 + c];
+					if (srgb && c < 3) {
+						result[(y * dstWidth + x) * 4 + c] = SRGBFromLinear((linear[a] + linear[b] + linear[d] + linear[e]) * 0.25f);
+					}
+					else {
+						const uint32_t sum = a + b + d + e;
+						result[(y * dstWidth + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+					}
+				}
+			}
+		}
+		return result;
+	}
+}
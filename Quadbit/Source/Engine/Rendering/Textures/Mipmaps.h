@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+#include <EASTL/vector.h>
+
+namespace Quadbit::Mipmaps {
+	// Number of levels in a full mip chain down to 1x1
+	uint32_t GetLevelCount(uint32_t width, uint32_t height);
+
+	// Halves an RGBA8 image with a 2x2 box filter, odd edges are clamped.
+	// With srgb set the colour channels are averaged in linear space, alpha always is
+	eastl::vector<uint8_t> Downsample(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb = false);
+}
@@ -0,0 +1,353 @@
+#include "TextureContainer.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <EASTL/algorithm.h>
+
+#include "Engine/Core/Logging.h"
+#include "Engine/Rendering/Textures/BlockCompression.h"
+#include "Engine/Rendering/Textures/Mipmaps.h"
+
+namespace Quadbit::TextureContainer {
+	namespace {
+		constexpr uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+		constexpr uint32_t DDS_MAGIC = 0x20534444;
+		constexpr VkDeviceSize KTX2_LEVEL_ALIGNMENT = 16;
+
+		struct KTX2Header {
+			uint8_t identifier[12];
+			uint32_t vkFormat;
+			uint32_t typeSize;
+			uint32_t pixelWidth;
+			uint32_t pixelHeight;
+			uint32_t pixelDepth;
+			uint32_t layerCount;
+			uint32_t faceCount;
+			uint32_t levelCount;
+			uint32_t supercompressionScheme;
+			uint32_t dfdByteOffset;
+			uint32_t dfdByteLength;
+			uint32_t kvdByteOffset;
+			uint32_t kvdByteLength;
+			uint64_t sgdByteOffset;
+			uint64_t sgdByteLength;
+		};
+		static_assert(sizeof(KTX2Header) == 80);
+
+		struct KTX2LevelIndex {
+			uint64_t byteOffset;
+			uint64_t byteLength;
+			uint64_t uncompressedByteLength;
+		};
+
+		struct DDSPixelFormat {
+			uint32_t size;
+			uint32_t flags;
+			uint32_t fourCC;
+			uint32_t rgbBitCount;
+			uint32_t rBitMask;
+			uint32_t gBitMask;
+			uint32_t bBitMask;
+			uint32_t aBitMask;
+		};
+
+		struct DDSHeader {
+			uint32_t size;
+			uint32_t flags;
+			uint32_t height;
+			uint32_t width;
+			uint32_t pitchOrLinearSize;
+			uint32_t depth;
+			uint32_t mipMapCount;
+			uint32_t reserved1[11];
+			DDSPixelFormat pixelFormat;
+			uint32_t caps;
+			uint32_t caps2;
+			uint32_t caps3;
+			uint32_t caps4;
+			uint32_t reserved2;
+		};
+		static_assert(sizeof(DDSHeader) == 124);
+
+		struct DDSHeaderDX10 {
+			uint32_t dxgiFormat;
+			uint32_t resourceDimension;
+			uint32_t miscFlag;
+			uint32_t arraySize;
+			uint32_t miscFlags2;
+		};
+
+		constexpr uint32_t FourCC(char a, char b, char c, char d) {
+			return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) | (static_cast<uint32_t>(c) << 16) | (static_cast<uint32_t>(d) << 24);
+		}
+
+		bool IsLoadableFormat(VkFormat format) {
+			return BlockCompression::IsBlockCompressed(format) || format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+		}
+
+		VkFormat FormatFromDXGI(uint32_t dxgiFormat) {
+			switch (dxgiFormat) {
+			case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+			case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+			case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+			case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+			case 74: return VK_FORMAT_BC2_UNORM_BLOCK;
+			case 75: return VK_FORMAT_BC2_SRGB_BLOCK;
+			case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+			case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+			case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+			case 81: return VK_FORMAT_BC4_SNORM_BLOCK;
+			case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+			case 84: return VK_FORMAT_BC5_SNORM_BLOCK;
+			case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+			case 96: return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+			case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+			case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+			default: return VK_FORMAT_UNDEFINED;
+			}
+		}
+
+		VkFormat FormatFromFourCC(uint32_t fourCC) {
+			switch (fourCC) {
+			case FourCC('D', 'X', 'T', '1'): return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+			case FourCC('D', 'X', 'T', '3'): return VK_FORMAT_BC2_UNORM_BLOCK;
+			case FourCC('D', 'X', 'T', '5'): return VK_FORMAT_BC3_UNORM_BLOCK;
+			case FourCC('A', 'T', 'I', '1'):
+			case FourCC('B', 'C', '4', 'U'): return VK_FORMAT_BC4_UNORM_BLOCK;
+			case FourCC('A', 'T', 'I', '2'):
+			case FourCC('B', 'C', '5', 'U'): return VK_FORMAT_BC5_UNORM_BLOCK;
+			default: return VK_FORMAT_UNDEFINED;
+			}
+		}
+
+		// Level counts come straight from the file, anything past a full chain would shift the dimensions by 32 or more
+		bool IsValidLevelCount(const QbVkTextureContainer& container, uint32_t levelCount) {
+			if (levelCount <= Mipmaps::GetLevelCount(container.width, container.height)) return true;
+			QB_LOG_WARN("Texture has %u levels, more than a full mip chain for %ux%u\n", levelCount, container.width, container.height);
+			return false;
+		}
+
+		// Fills in the dimensions and sizes of a tightly packed chain starting at the given offset
+		bool BuildLevels(QbVkTextureContainer& container, uint32_t levelCount, VkDeviceSize offset, size_t size) {
+			if (!IsValidLevelCount(container, levelCount) || offset > size) return false;
+
+			for (uint32_t level = 0; level < levelCount; level++) {
+				QbVkTextureLevel textureLevel;
+				textureLevel.width = eastl::max(container.width >> level, 1u);
+				textureLevel.height = eastl::max(container.height >> level, 1u);
+				textureLevel.size = BlockCompression::GetLevelSize(container.format, textureLevel.width, textureLevel.height);
+				textureLevel.offset = offset;
+				if (textureLevel.size > size - offset) return false;
+
+				offset += textureLevel.size;
+				container.levels.push_back(textureLevel);
+			}
+			return true;
+		}
+
+		bool ParseKTX2(const uint8_t* data, size_t size, QbVkTextureContainer& container) {
+			KTX2Header header;
+			memcpy(&header, data, sizeof(KTX2Header));
+
+			if (header.supercompressionScheme != 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1) {
+				QB_LOG_WARN("Unsupported KTX2 texture, only single layer 2D textures without supercompression can be loaded\n");
+				return false;
+			}
+
+			container.format = static_cast<VkFormat>(header.vkFormat);
+			container.width = header.pixelWidth;
+			container.height = header.pixelHeight;
+
+			// A level count of 0 asks for the chain to be generated, we only store what the file has
+			const auto levelCount = eastl::max(header.levelCount, 1u);
+			if (!IsValidLevelCount(container, levelCount)) return false;
+			if (sizeof(KTX2Header) + levelCount * sizeof(KTX2LevelIndex) > size) return false;
+
+			for (uint32_t level = 0; level < levelCount; level++) {
+				KTX2LevelIndex index;
+				memcpy(&index, data + sizeof(KTX2Header) + level * sizeof(KTX2LevelIndex), sizeof(KTX2LevelIndex));
+
+				QbVkTextureLevel textureLevel;
+				textureLevel.width = eastl::max(container.width >> level, 1u);
+				textureLevel.height = eastl::max(container.height >> level, 1u);
+				textureLevel.offset = index.byteOffset;
+				textureLevel.size = index.byteLength;
+				if (index.byteOffset > size || index.byteLength > size - index.byteOffset ||
+					index.byteLength != BlockCompression::GetLevelSize(container.format, textureLevel.width, textureLevel.height)) {
+					return false;
+				}
+				container.levels.push_back(textureLevel);
+			}
+			return true;
+		}
+
+		bool ParseDDS(const uint8_t* data, size_t size, QbVkTextureContainer& container) {
+			VkDeviceSize offset = sizeof(uint32_t) + sizeof(DDSHeader);
+			if (size < offset) return false;
+
+			DDSHeader header;
+			memcpy(&header, data + sizeof(uint32_t), sizeof(DDSHeader));
+
+			if (header.pixelFormat.fourCC == FourCC('D', 'X', '1', '0')) {
+				if (size < offset + sizeof(DDSHeaderDX10)) return false;
+				DDSHeaderDX10 headerDX10;
+				memcpy(&headerDX10, data + offset, sizeof(DDSHeaderDX10));
+				offset += sizeof(DDSHeaderDX10);
+
+				// Only 2D textures (resource dimension 3) with a single layer
+				if (headerDX10.resourceDimension != 3 || headerDX10.arraySize > 1) {
+					QB_LOG_WARN("Unsupported DDS texture, only single layer 2D textures can be loaded\n");
+					return false;
+				}
+				container.format = FormatFromDXGI(headerDX10.dxgiFormat);
+			}
+			else {
+				container.format = FormatFromFourCC(header.pixelFormat.fourCC);
+			}
+
+			container.width = header.width;
+			container.height = header.height;
+			return BuildLevels(container, eastl::max(header.mipMapCount, 1u), offset, size);
+		}
+	}
+
+	bool IsContainer(const uint8_t* data, size_t size) {
+		if (size >= sizeof(KTX2Header) && memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0) return true;
+		uint32_t magic = 0;
+		if (size >= sizeof(uint32_t)) memcpy(&magic, data, sizeof(uint32_t));
+		return magic == DDS_MAGIC;
+	}
+
+	bool Parse(const uint8_t* data, size_t size, QbVkTextureContainer& container) {
+		container = QbVkTextureContainer{};
+
+		bool parsed = false;
+		if (size >= sizeof(KTX2Header) && memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0) {
+			parsed = ParseKTX2(data, size, container);
+		}
+		else if (IsContainer(data, size)) {
+			parsed = ParseDDS(data, size, container);
+		}
+
+		if (parsed && !IsLoadableFormat(container.format)) {
+			QB_LOG_WARN("Unsupported texture container format %i\n", container.format);
+			return false;
+		}
+		return parsed && container.width > 0 && container.height > 0;
+	}
+
+	bool WriteKTX2(const char* path, VkFormat format, uint32_t width, uint32_t height, const eastl::vector<eastl::vector<uint8_t>>& levels) {
+		if (!IsLoadableFormat(format) || levels.empty()) return false;
+
+		const auto blockSize = BlockCompression::GetBlockSize(format);
+		const bool srgb = BlockCompression::IsSRGB(format);
+
+		// Basic data format descriptor, one sample per channel (or per 64 bits of block)
+		struct Sample {
+			uint16_t bitOffset;
+			uint8_t bitLength;
+			uint8_t channelType;
+			uint8_t samplePosition[4];
+			uint32_t sampleLower;
+			uint32_t sampleUpper;
+		};
+		eastl::vector<Sample> samples;
+		uint8_t colourModel = 0;
+		switch (format) {
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+			// RGBSDA, the alpha channel is always linear
+			colourModel = 1;
+			samples = { { 0, 7, 0, {}, 0, 255 }, { 8, 7, 1, {}, 0, 255 }, { 16, 7, 2, {}, 0, 255 },
+				{ 24, 7, static_cast<uint8_t>(15 | (srgb ? 0x10 : 0)), {}, 0, 255 } };
+			break;
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+			colourModel = 128;
+			samples = { { 0, 63, 0, {}, 0, 0xFFFFFFFF } };
+			break;
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+			colourModel = 128;
+			samples = { { 0, 63, 1, {}, 0, 0xFFFFFFFF } };
+			break;
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+			colourModel = 130;
+			samples = { { 0, 63, static_cast<uint8_t>(15 | (srgb ? 0x10 : 0)), {}, 0, 0xFFFFFFFF }, { 64, 63, 0, {}, 0, 0xFFFFFFFF } };
+			break;
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+			colourModel = 131;
+			samples = { { 0, 63, 0, {}, 0, 0xFFFFFFFF } };
+			break;
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+			colourModel = 132;
+			samples = { { 0, 63, 0, {}, 0, 0xFFFFFFFF }, { 64, 63, 1, {}, 0, 0xFFFFFFFF } };
+			break;
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+			colourModel = 134;
+			samples = { { 0, 127, 0, {}, 0, 0xFFFFFFFF } };
+			break;
+		default:
+			QB_LOG_WARN("No data format descriptor for texture format %i\n", format);
+			return false;
+		}
+
+		const auto blockDescriptorSize = static_cast<uint16_t>(24 + samples.size() * sizeof(Sample));
+		eastl::vector<uint8_t> dfd(sizeof(uint32_t) + blockDescriptorSize, 0);
+		const uint32_t dfdTotalSize = static_cast<uint32_t>(dfd.size());
+		const uint16_t versionNumber = 2;
+		memcpy(&dfd[0], &dfdTotalSize, sizeof(uint32_t));
+		// Vendor and descriptor type are both 0 (Khronos basic)
+		memcpy(&dfd[8], &versionNumber, sizeof(uint16_t));
+		memcpy(&dfd[10], &blockDescriptorSize, sizeof(uint16_t));
+		dfd[12] = colourModel;
+		// BT.709 primaries, linear or sRGB transfer
+		dfd[13] = 1;
+		dfd[14] = srgb ? 2 : 1;
+		dfd[16] = blockSize > 0 ? 3 : 0;
+		dfd[17] = blockSize > 0 ? 3 : 0;
+		dfd[20] = static_cast<uint8_t>(blockSize > 0 ? blockSize : 4);
+		memcpy(&dfd[28], samples.data(), samples.size() * sizeof(Sample));
+
+		KTX2Header header{};
+		memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+		header.vkFormat = format;
+		header.typeSize = 1;
+		header.pixelWidth = width;
+		header.pixelHeight = height;
+		header.faceCount = 1;
+		header.levelCount = static_cast<uint32_t>(levels.size());
+		header.dfdByteOffset = static_cast<uint32_t>(sizeof(KTX2Header) + levels.size() * sizeof(KTX2LevelIndex));
+		header.dfdByteLength = dfdTotalSize;
+
+		// Level data is stored smallest level first, so a partially read file still has the whole tail of the chain
+		eastl::vector<KTX2LevelIndex> indices(levels.size());
+		VkDeviceSize offset = header.dfdByteOffset + header.dfdByteLength;
+		for (size_t i = levels.size(); i-- > 0;) {
+			offset = (offset + KTX2_LEVEL_ALIGNMENT - 1) / KTX2_LEVEL_ALIGNMENT * KTX2_LEVEL_ALIGNMENT;
+			indices[i] = { offset, levels[i].size(), levels[i].size() };
+			offset += levels[i].size();
+		}
+
+		FILE* file = fopen(path, "wb");
+		if (file == nullptr) {
+			QB_LOG_WARN("Failed to open %s for writing\n", path);
+			return false;
+		}
+		fwrite(&header, sizeof(KTX2Header), 1, file);
+		fwrite(indices.data(), sizeof(KTX2LevelIndex), indices.size(), file);
+		fwrite(dfd.data(), 1, dfd.size(), file);
+		for (size_t i = levels.size(); i-- > 0;) {
+			// Pad up to the level offset
+			static const uint8_t padding[KTX2_LEVEL_ALIGNMENT]{};
+			const auto position = static_cast<VkDeviceSize>(ftell(file));
+			fwrite(padding, 1, static_cast<size_t>(indices[i].byteOffset - position), file);
+			fwrite(levels[i].data(), 1, levels[i].size(), file);
+		}
+		fclose(file);
+		return true;
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+#include <EASTL/vector.h>
+#include <vulkan/vulkan.h>
+
+namespace Quadbit {
+	struct QbVkTextureLevel {
+		// Offset of the level data in the container
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		uint32_t width = 0;
+		uint32_t height = 0;
+	};
+
+	// A texture with all of its mip levels stored in a KTX2 or DDS file, largest level first
+	struct QbVkTextureContainer {
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		eastl::vector<QbVkTextureLevel> levels;
+	};
+}
+
+// Only single layer 2D textures without supercompression are supported, in BCn or RGBA8 formats
+namespace Quadbit::TextureContainer {
+	bool IsContainer(const uint8_t* data, size_t size);
+	// Validates the container and fills in where each level lives in the data
+	bool Parse(const uint8_t* data, size_t size, QbVkTextureContainer& container);
+
+	// Levels are ordered largest first and must be sized for the format
+	bool WriteKTX2(const char* path, VkFormat format, uint32_t width, uint32_t height, const eastl::vector<eastl::vector<uint8_t>>& levels);
+}
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <cstring>
 
 #include <EASTL/array.h>
-#include <EASTL/deque.h>
 #include <EASTL/hash_map.h>
 #include <EASTL/string.h>
 #include <EASTL/type_traits.h>
@@ -20,7 +22,7 @@
 
 #define VK_CHECK(x) { \
 VkResult ret = x; \
-if(ret != VK_SUCCESS) QB_LOG_WARN("VkResult: %s is %s in %s at line %d\n", #x, VulkanErrorToString(x), __FILE__, __LINE__); \
+if(ret != VK_SUCCESS) QB_LOG_WARN("VkResult: %s is %s in %s at line %d\n", #x, VulkanErrorToString(ret), __FILE__, __LINE__); \
 }
 
 #define VK_VALIDATE(x, msg) { \
@@ -80,48 +82,147 @@ namespace Quadbit {
 		}
 	};
 
-	template<typename T, size_t Size>
+	inline constexpr uint32_t QBVK_RESOURCE_PAGE_SIZE = 256;
+	// Index 65535 is reserved for the null handles
+	inline constexpr uint32_t QBVK_RESOURCE_MAX_COUNT = 65535;
+	// As is version 65535, so a recycled slot never matches a null handle
+	inline constexpr uint16_t QBVK_RESOURCE_NULL_VERSION = 65535;
+
+	// Generational slot map. Elements live in pages that are allocated on demand so the map can grow up to
+	// Size elements without ever moving existing ones. Live slots are tracked in a bitset, and handles are
+	// allocated and destroyed through a lock-free free list so they can be handed out from any thread
+	template<typename T, size_t Size = QBVK_RESOURCE_MAX_COUNT>
 	struct QbVkResource {
-		uint16_t resourceIndex = 0;
-		eastl::array<T, Size> elements{};
-		eastl::array<uint16_t, Size> versions{};
-		eastl::deque<uint16_t> freeList;
+		static_assert(Size <= QBVK_RESOURCE_MAX_COUNT, "Resource handles can address at most 65535 elements!");
+		static constexpr uint32_t PAGE_COUNT = (static_cast<uint32_t>(Size) + QBVK_RESOURCE_PAGE_SIZE - 1) / QBVK_RESOURCE_PAGE_SIZE;
+		static constexpr uint32_t INVALID_INDEX = 0xFFFF'FFFF;
+
+		struct Page {
+			eastl::array<T, QBVK_RESOURCE_PAGE_SIZE> elements{};
+			eastl::array<uint16_t, QBVK_RESOURCE_PAGE_SIZE> versions{};
+			eastl::array<std::atomic<uint32_t>, QBVK_RESOURCE_PAGE_SIZE> nextFree{};
+		};
+
+		QbVkResource() = default;
+		QbVkResource(const QbVkResource&) = delete;
+		QbVkResource& operator=(const QbVkResource&) = delete;
+
+		~QbVkResource() {
+			for (auto& page : pages_) delete page.load();
+		}
 
 		template<typename U>
 		T& operator[](QbVkResourceHandle<U> handle) {
 			static_assert(eastl::is_same<T, U>::value, "Resource has a different type than the resource handle passed!");
-			QB_ASSERT(handle.index < Size && "Resource array out of bounds!");
-			QB_ASSERT(handle.version == versions[handle.index] && "Handle passed does not match internal handle!");
-			return elements[handle.index];
+			QB_ASSERT(IsValid(handle) && "Handle passed does not match internal handle!");
+			return GetPage(handle.index)->elements[handle.index % QBVK_RESOURCE_PAGE_SIZE];
+		}
+
+		bool IsValid(QbVkResourceHandle<T> handle) const {
+			if (handle.index >= SlotCount()) return false;
+			if (!(alive_[handle.index / 64].load(std::memory_order_acquire) & (1ull << (handle.index % 64)))) return false;
+			return GetPage(handle.index)->versions[handle.index % QBVK_RESOURCE_PAGE_SIZE] == handle.version;
 		}
 
 		template<typename U>
 		void DestroyResource(QbVkResourceHandle<U> handle) {
 			static_assert(eastl::is_same<T, U>::value, "Resource has a different type than the resource handle passed!");
-			QB_ASSERT(handle.index < Size && "Resource array out of bounds!");
-			QB_ASSERT(handle.version == versions[handle.index] && "Handle passed does not match internal handle!");
-			versions[handle.index]++;
-			freeList.push_back(handle.index);
+			QB_ASSERT(IsValid(handle) && "Handle passed does not match internal handle!");
+
+			auto* page = GetPage(handle.index);
+			const auto slot = handle.index % QBVK_RESOURCE_PAGE_SIZE;
+			// Version 65535 is reserved for the null handles
+			if (++page->versions[slot] == QBVK_RESOURCE_NULL_VERSION) page->versions[slot] = 0;
+			alive_[handle.index / 64].fetch_and(~(1ull << (handle.index % 64)), std::memory_order_release);
+
+			// Push the slot onto the free list, the tag in the upper bits guards against ABA
+			auto head = freeHead_.load(std::memory_order_relaxed);
+			do {
+				page->nextFree[slot].store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+			} while (!freeHead_.compare_exchange_weak(head, PackFreeHead(handle.index, head), std::memory_order_acq_rel));
 		}
 
-		QbVkResourceHandle<T> GetHandle(uint16_t index) {
-			QB_ASSERT(index < (Size - 1) && "Resource array full, too many elements!");
-			QB_ASSERT(index < 65536 && versions[index] < 65536 && "Resource array is out of handles to give out!");
-			return QbVkResourceHandle<T> { index, versions[index] };
+		QbVkResourceHandle<T> GetHandle(uint16_t index) const {
+			QB_ASSERT(index < SlotCount() && "Resource index out of bounds!");
+			return QbVkResourceHandle<T> { index, GetPage(index)->versions[index % QBVK_RESOURCE_PAGE_SIZE] };
 		}
 
 		QbVkResourceHandle<T> GetNextHandle() {
-			uint16_t next = resourceIndex;
-			if (freeList.empty()) {
-				resourceIndex++;
+			uint32_t next = PopFreeIndex();
+			if (next == INVALID_INDEX) {
+				next = highWater_.fetch_add(1, std::memory_order_acq_rel);
+				if (next >= Size) {
+					highWater_.fetch_sub(1, std::memory_order_acq_rel);
+					QB_LOG_ERROR("Resource array full, too many elements!\n");
+					return QbVkResourceHandle<T> { QBVK_RESOURCE_MAX_COUNT, QBVK_RESOURCE_NULL_VERSION };
+				}
+				EnsurePage(next);
+			}
+
+			alive_[next / 64].fetch_or(1ull << (next % 64), std::memory_order_release);
+			return QbVkResourceHandle<T> { static_cast<uint16_t>(next), GetPage(next)->versions[next % QBVK_RESOURCE_PAGE_SIZE] };
+		}
+
+		// Direct access to the element of a slot regardless of whether it is alive, allocating its page if needed
+		T& At(uint32_t index) {
+			QB_ASSERT(index < Size && "Resource array out of bounds!");
+			return EnsurePage(index)->elements[index % QBVK_RESOURCE_PAGE_SIZE];
+		}
+
+		// Calls func(handle, element) for every live element, visiting 64 slots per bitset word
+		template<typename Func>
+		void ForEach(Func&& func) {
+			const auto count = SlotCount();
+			for (uint32_t word = 0; word * 64 < count; word++) {
+				auto bits = alive_[word].load(std::memory_order_acquire);
+				while (bits != 0) {
+					const auto index = word * 64 + static_cast<uint32_t>(std::countr_zero(bits));
+					bits &= bits - 1;
+					func(GetHandle(static_cast<uint16_t>(index)), GetPage(index)->elements[index % QBVK_RESOURCE_PAGE_SIZE]);
+				}
 			}
-			else {
-				next = freeList.front();
-				freeList.pop_front();
+		}
+
+	private:
+		eastl::array<std::atomic<Page*>, PAGE_COUNT> pages_{};
+		eastl::array<std::atomic<uint64_t>, (Size + 63) / 64> alive_{};
+		std::atomic<uint32_t> highWater_ = 0;
+		// Lower 32 bits hold the index of the first free slot, upper 32 bits a tag that changes on every push/pop
+		std::atomic<uint64_t> freeHead_ = INVALID_INDEX;
+
+		static uint64_t PackFreeHead(uint32_t index, uint64_t previous) {
+			return ((((previous >> 32) + 1) & 0xFFFF'FFFF) << 32) | index;
+		}
+
+		// The high water mark briefly overshoots Size while a full array rejects a handle
+		uint32_t SlotCount() const {
+			return eastl::min(highWater_.load(std::memory_order_acquire), static_cast<uint32_t>(Size));
+		}
+
+		Page* GetPage(uint32_t index) const {
+			return pages_[index / QBVK_RESOURCE_PAGE_SIZE].load(std::memory_order_acquire);
+		}
+
+		Page* EnsurePage(uint32_t index) {
+			auto& slot = pages_[index / QBVK_RESOURCE_PAGE_SIZE];
+			Page* page = slot.load(std::memory_order_acquire);
+			if (page != nullptr) return page;
+
+			// Several threads may race to create the same page, the losers delete theirs
+			Page* newPage = new Page();
+			if (slot.compare_exchange_strong(page, newPage, std::memory_order_acq_rel)) return newPage;
+			delete newPage;
+			return page;
+		}
+
+		uint32_t PopFreeIndex() {
+			auto head = freeHead_.load(std::memory_order_acquire);
+			while (static_cast<uint32_t>(head) != INVALID_INDEX) {
+				const auto index = static_cast<uint32_t>(head);
+				const auto next = GetPage(index)->nextFree[index % QBVK_RESOURCE_PAGE_SIZE].load(std::memory_order_relaxed);
+				if (freeHead_.compare_exchange_weak(head, PackFreeHead(next, head), std::memory_order_acq_rel)) return index;
 			}
-			QB_ASSERT(next < (Size - 1) && "Resource array full, too many elements!");
-			QB_ASSERT(next < 65536 && versions[next] < 65536 && "Resource array is out of handles to give out!");
-			return QbVkResourceHandle<T> {next, versions[next]};
+			return INVALID_INDEX;
 		}
 	};
 
@@ -182,14 +283,39 @@ namespace Quadbit {
 		QBVK_VERTEX_ATTRIBUTE_FLOAT4
 	};
 
+	// What the allocation is used for, tracked by the allocator statistics
+	enum class QbVkAllocationTag {
+		QBVK_ALLOCATION_TAG_UNKNOWN,
+		QBVK_ALLOCATION_TAG_BUFFER,
+		QBVK_ALLOCATION_TAG_TEXTURE,
+		QBVK_ALLOCATION_TAG_STAGING,
+		// Geometry that is freed and reallocated all the time, such as voxel chunk meshes
+		QBVK_ALLOCATION_TAG_STREAMED_MESH,
+		QBVK_ALLOCATION_TAG_COUNT
+	};
+
+	inline constexpr const char* AllocationTagToString(QbVkAllocationTag tag) {
+		switch (tag) {
+		case QbVkAllocationTag::QBVK_ALLOCATION_TAG_BUFFER: return "Buffer";
+		case QbVkAllocationTag::QBVK_ALLOCATION_TAG_TEXTURE: return "Texture";
+		case QbVkAllocationTag::QBVK_ALLOCATION_TAG_STAGING: return "Staging";
+		case QbVkAllocationTag::QBVK_ALLOCATION_TAG_STREAMED_MESH: return "Streamed mesh";
+		default: return "Unknown";
+		}
+	}
+
 	struct QbVkPool;
+	struct QbVkAllocationChunk;
 	struct QbVkAllocation {
 		QbVkPool* pool = nullptr;
+		// Set when sub-allocated from a thread cache chunk rather than directly from the pool
+		QbVkAllocationChunk* chunk = nullptr;
 		uint32_t id = 0;
 		VkDeviceMemory deviceMemory = VK_NULL_HANDLE;
 		VkDeviceSize offset = 0;
 		VkDeviceSize size = 0;
 		unsigned char* data = nullptr;
+		QbVkAllocationTag tag = QbVkAllocationTag::QBVK_ALLOCATION_TAG_UNKNOWN;
 	};
 
 	class QbVkRenderer;
@@ -207,6 +333,12 @@ namespace Quadbit {
 	struct QbVkTexture {
 		QbVkImage image{};
 		VkDescriptorImageInfo descriptor{};
+		// Set while an asynchronous load is in flight
+		bool loading = false;
+		// The descriptor borrows the view and sampler of the empty texture, while loading or if the load failed
+		bool placeholder = false;
+		// Bumped whenever a new image is uploaded, descriptors written with an older version reference a retired view
+		uint32_t version = 0;
 	};
 
 	struct QbVkDescriptorAllocator {
@@ -229,6 +361,14 @@ namespace Quadbit {
 	constexpr QbVkDescriptorSetsHandle QBVK_DESCRIPTOR_SETS_NULL_HANDLE = { 65535, 65535 };
 	constexpr QbVkPipelineHandle QBVK_PIPELINE_NULL_HANDLE = { 65535, 65535 };
 
+	// A range of vertices or indices sub-allocated from one of the shared geometry arenas,
+	// offset and count are in elements, not bytes
+	struct QbVkMeshAllocation {
+		QbVkBufferHandle buffer = QBVK_BUFFER_NULL_HANDLE;
+		uint32_t offset = 0;
+		uint32_t count = 0;
+	};
+
 	enum class QbVkAllocationType {
 		QBVK_ALLOCATION_TYPE_UNKNOWN,
 		QBVK_ALLOCATION_TYPE_FREE,
@@ -294,8 +434,11 @@ namespace Quadbit {
 	};
 
 	class QbVkAllocator;
+	class QbVkDeletionQueue;
 	class QbVkShaderCompiler;
+	class QbVkPipelineCache;
 	class QbVkResourceManager;
+	class QbVkTransientAllocator;
 	class EntityManager;
 	class InputHandler;
 	struct QbVkContext {
@@ -304,8 +447,11 @@ namespace Quadbit {
 
 		eastl::unique_ptr<GPU> gpu;
 		eastl::unique_ptr<QbVkAllocator> allocator;
+		eastl::unique_ptr<QbVkDeletionQueue> deletionQueue;
 		eastl::unique_ptr<QbVkShaderCompiler> shaderCompiler;
+		eastl::unique_ptr<QbVkPipelineCache> pipelineCache;
 		eastl::unique_ptr<QbVkResourceManager> resourceManager;
+		eastl::unique_ptr<QbVkTransientAllocator> transientAllocator;
 		VkDevice device = VK_NULL_HANDLE;
 		VkSurfaceKHR surface = VK_NULL_HANDLE;
 		VkQueue graphicsQueue = VK_NULL_HANDLE;
@@ -345,6 +491,9 @@ namespace Quadbit {
 	struct QbVkTransfer {
 		VkDeviceSize size = 0;
 		QbVkBufferHandle destinationBuffer = QBVK_BUFFER_NULL_HANDLE;
+		VkDeviceSize dstOffset = 0;
+		// Offset of the data in the host side transfer queue
+		VkDeviceSize srcOffset = 0;
 	};
 
 	template<typename T>
@@ -358,4 +507,52 @@ namespace Quadbit {
 		QBVK_SHADER_TYPE_VERTEX,
 		QBVK_SHADER_TYPE_COMPUTE
 	};
+
+	// A preprocessor define passed to the shader compiler, an empty value defines the name without a value
+	struct QbVkShaderDefine {
+		eastl::string name;
+		eastl::string value;
+	};
+	using QbVkShaderDefines = eastl::vector<QbVkShaderDefine>;
+
+	// Specialisation constant values for one shader stage, keyed by constant id. Values keep their own size,
+	// so 64-bit integers and doubles work too, except bools, which Vulkan wants as a 32-bit VkBool32
+	struct QbVkSpecialization {
+		eastl::vector<VkSpecializationMapEntry> entries;
+		eastl::vector<uint8_t> data;
+		// A struct with a member for each of the shader's constants, in constant id order and naturally aligned.
+		// Resolved against the shader's reflection when the pipeline is created, and copied then
+		const void* packed = nullptr;
+		uint32_t packedSize = 0;
+
+		template<typename T>
+		static QbVkSpecialization Packed(const T& constants) {
+			static_assert(eastl::is_trivially_copyable_v<T> && !eastl::is_pointer_v<T>, "Pass the struct of constants itself, not a pointer to it!");
+			QbVkSpecialization specialization;
+			specialization.packed = &constants;
+			specialization.packedSize = sizeof(T);
+			return specialization;
+		}
+
+		template<typename T>
+		QbVkSpecialization& Set(uint32_t constantId, const T& value) {
+			static_assert(eastl::is_trivially_copyable_v<T>, "Specialization constants have to be trivially copyable!");
+			for (const auto& entry : entries) {
+				if (entry.constantID == constantId) {
+					QB_ASSERT(entry.size == sizeof(T) && "Specialization constant set again with a different size!");
+					memcpy(data.data() + entry.offset, &value, sizeof(T));
+					return *this;
+				}
+			}
+			entries.push_back({ constantId, static_cast<uint32_t>(data.size()), sizeof(T) });
+			data.resize(data.size() + sizeof(T));
+			memcpy(data.data() + entries.back().offset, &value, sizeof(T));
+			return *this;
+		}
+		QbVkSpecialization& Set(uint32_t constantId, bool value) {
+			return Set<VkBool32>(constantId, value ? VK_TRUE : VK_FALSE);
+		}
+
+		bool IsEmpty() const { return packed == nullptr && entries.empty(); }
+	};
 }
\ No newline at end of file
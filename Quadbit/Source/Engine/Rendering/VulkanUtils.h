@@ -12,6 +12,7 @@
 #include "Engine/Rendering/Memory/Allocator.h"
 #include "Engine/Rendering/Memory/ResourceManager.h"
 #include "Engine/Rendering/VulkanTypes.h"
+#include "Engine/Rendering/Textures/Mipmaps.h"
 
 namespace Quadbit::VkUtils {
 	// Wrappers around various Vulkan structs
@@ -557,6 +558,11 @@ namespace Quadbit::VkUtils {
 		return ((val + alignment - 1) / alignment) * alignment;
 	}
 
+	// Number of levels in a full mip chain down to 1x1
+	inline uint32_t GetMipLevels(uint32_t width, uint32_t height) {
+		return Mipmaps::GetLevelCount(width, height);
+	}
+
 	// Returns whether or not the end of the first resource and the beginning of the second resource
 	// reside in separate pages. Algorithm from the Vulkan 1.1.106 specification.
 	inline bool IsOnSamePage(VkDeviceSize resourceAOffset, VkDeviceSize resourceASize, VkDeviceSize resourceBOffset, VkDeviceSize pageSize) {
@@ -746,6 +752,22 @@ namespace Quadbit::VkUtils {
 		return VK_FORMAT_UNDEFINED;
 	}
 
+	// The format features an image needs for the given usage
+	inline VkFormatFeatureFlags GetFormatFeatures(VkImageUsageFlags usage) {
+		VkFormatFeatureFlags features = 0;
+		if (usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) features |= VK_FORMAT_FEATURE_TRANSFER_SRC_BIT;
+		if (usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) features |= VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+		if (usage & VK_IMAGE_USAGE_SAMPLED_BIT) features |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+		if (usage & VK_IMAGE_USAGE_STORAGE_BIT) features |= VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT;
+		if (usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT) features |= VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT;
+		if (usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) features |= VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		return features;
+	}
+
+	inline bool IsFormatSupported(const QbVkContext& context, VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features) {
+		return ChooseSupportedFormat(context, { format }, tiling, features) != VK_FORMAT_UNDEFINED;
+	}
+
 	inline VkFormat FindDepthFormat(const QbVkContext& context) {
 		return ChooseSupportedFormat(context, { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
 			VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
@@ -825,12 +847,13 @@ namespace Quadbit::VkUtils {
 		vkDestroyFence(context.device, fence, nullptr);
 	}
 
-	inline void CopyBuffer(const QbVkContext& context, VkBuffer src, VkBuffer dst, VkDeviceSize size) {
+	inline void CopyBuffer(const QbVkContext& context, VkBuffer src, VkBuffer dst, VkDeviceSize size,
+		VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0) {
 		VkCommandBuffer commandBuffer = CreateSingleTimeCommandBuffer(context);
 		// Issue copy command
 		VkBufferCopy copyRegion{};
-		copyRegion.srcOffset = 0;
-		copyRegion.dstOffset = 0;
+		copyRegion.srcOffset = srcOffset;
+		copyRegion.dstOffset = dstOffset;
 		copyRegion.size = size;
 		vkCmdCopyBuffer(commandBuffer, src, dst, 1, &copyRegion);
 
@@ -854,11 +877,11 @@ namespace Quadbit::VkUtils {
 		FlushCommandBuffer(context, commandBuffer);
 	}
 
-	inline void TransferDataToGPUBuffer(const QbVkContext& context, const void* data, VkDeviceSize size, QbVkBuffer& destination) {
+	inline void TransferDataToGPUBuffer(const QbVkContext& context, const void* data, VkDeviceSize size, QbVkBuffer& destination, VkDeviceSize dstOffset = 0) {
 		// Utilize a staging buffer to transfer the data onto the GPU
 		QbVkBuffer stagingBuffer;
 		context.allocator->CreateStagingBuffer(stagingBuffer, size, data);
-		CopyBuffer(context, stagingBuffer.buf, destination.buf, size);
+		CopyBuffer(context, stagingBuffer.buf, destination.buf, size, 0, dstOffset);
 		context.allocator->DestroyBuffer(stagingBuffer);
 	}
 
@@ -0,0 +1,320 @@
+// Replays an allocation trace recorded with QbVkAllocator::BeginTrace against the first-fit and the buddy pools.
+// Memory comes from a QbVkHostMemoryBackend, so no GPU is needed. Every tag is placed in the pool type under test,
+// and the pool memory reserved, how scattered the free memory is and the time spent in the allocator are reported.
+// Without a recording at hand, --synthetic generates a made up voxel chunk streaming workload instead,
+// it is only a starting point and no substitute for a trace of the actual game.
+//
+// Usage: AllocatorBenchmark <trace | --synthetic> [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include <EASTL/array.h>
+#include <EASTL/hash_map.h>
+#include <EASTL/string.h>
+#include <EASTL/unique_ptr.h>
+#include <EASTL/vector.h>
+
+#include "Engine/Rendering/Memory/Allocator.h"
+#include "Engine/Rendering/Memory/MemoryBackend.h"
+
+// OPERATOR OVERLOADS FOR EASTL
+void* operator new[](size_t size, const char* name, int flags, unsigned debugFlags, const char* file, int line) {
+	return new uint8_t[size];
+}
+
+void* operator new[](size_t size, size_t alignment, size_t alignmentOffset, const char* pName, int flags, unsigned debugFlags, const char* file, int line) {
+	return new uint8_t[size];
+}
+
+// Free memory is sampled this often, sampling is not part of the timing
+constexpr uint32_t FRAGMENTATION_SAMPLE_INTERVAL = 64;
+// Fixed so every run of the synthetic workload is the same
+constexpr uint32_t SYNTHETIC_SEED = 1234;
+constexpr uint32_t SYNTHETIC_CHUNKS = 100;
+constexpr uint32_t SYNTHETIC_FRAMES = 300;
+
+namespace {
+	using namespace Quadbit;
+
+	struct TraceOp {
+		bool allocate = false;
+		// Index of the allocation, ids in the trace are reused once freed
+		uint32_t slot = 0;
+		QbVkAllocationTag tag = QbVkAllocationTag::QBVK_ALLOCATION_TAG_UNKNOWN;
+		QbVkAllocationType type = QbVkAllocationType::QBVK_ALLOCATION_TYPE_UNKNOWN;
+		QbVkMemoryUsage usage = QbVkMemoryUsage::QBVK_MEMORY_USAGE_UNKNOWN;
+		VkMemoryRequirements requirements{};
+	};
+
+	struct Trace {
+		eastl::vector<TraceOp> ops;
+		uint32_t slotCount = 0;
+	};
+
+	// Times the pool memory requests separately, the host backend fills every new pool which would drown out the pools themselves
+	class TimedHostMemoryBackend : public QbVkHostMemoryBackend {
+	public:
+		std::chrono::steady_clock::duration elapsed{};
+		uint32_t allocationCount = 0;
+
+		VkResult AllocateMemory(uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceMemory& memory) override {
+			const auto start = std::chrono::steady_clock::now();
+			const auto result = QbVkHostMemoryBackend::AllocateMemory(memoryTypeIndex, size, memory);
+			elapsed += std::chrono::steady_clock::now() - start;
+			allocationCount++;
+			return result;
+		}
+
+		void FreeMemory(VkDeviceMemory memory) override {
+			const auto start = std::chrono::steady_clock::now();
+			QbVkHostMemoryBackend::FreeMemory(memory);
+			elapsed += std::chrono::steady_clock::now() - start;
+		}
+	};
+
+	struct Result {
+		// Time spent in the allocator, excluding the backend
+		double allocatorMs = 0.0;
+		uint32_t poolsCreated = 0;
+		VkDeviceSize peakReserved = 0;
+		VkDeviceSize peakLive = 0;
+		float meanFragmentation = 0.0f;
+		float maxFragmentation = 0.0f;
+		uint32_t failed = 0;
+	};
+
+	bool LoadTrace(const char* path, Trace& trace) {
+		FILE* file = fopen(path, "r");
+		if (file == nullptr) {
+			printf("Failed to open %s\n", path);
+			return false;
+		}
+
+		eastl::hash_map<eastl::string, uint32_t> liveSlots;
+		uint32_t unmatched = 0;
+		char line[256];
+		while (fgets(line, sizeof(line), file) != nullptr) {
+			int tag, type, usage;
+			unsigned long long size, alignment;
+			char id[128];
+			TraceOp op;
+			if (sscanf(line, "a %d %d %d %llu %llu %127s", &tag, &type, &usage, &size, &alignment, id) == 6) {
+				op.allocate = true;
+				op.slot = trace.slotCount++;
+				op.tag = (tag >= 0 && tag < static_cast<int>(QbVkAllocationTag::QBVK_ALLOCATION_TAG_COUNT))
+					? static_cast<QbVkAllocationTag>(tag) : QbVkAllocationTag::QBVK_ALLOCATION_TAG_UNKNOWN;
+				op.type = static_cast<QbVkAllocationType>(type);
+				op.usage = static_cast<QbVkMemoryUsage>(usage);
+				op.requirements = { size, alignment, ~0u };
+				liveSlots[eastl::string(id)] = op.slot;
+			}
+			else if (sscanf(line, "f %127s", id) == 1) {
+				auto it = liveSlots.find(eastl::string(id));
+				if (it == liveSlots.end()) {
+					unmatched++;
+					continue;
+				}
+				op.slot = it->second;
+				liveSlots.erase(it);
+			}
+			else {
+				continue;
+			}
+			trace.ops.push_back(op);
+		}
+		fclose(file);
+
+		if (unmatched > 0) printf("Skipped %u frees of allocations that started before the trace\n", unmatched);
+		return !trace.ops.empty();
+	}
+
+	// Not a recording. 100 greedy meshed voxel chunks, a few of which are remeshed every frame and all of them every
+	// 150 frames, plus the occasional texture streamed in through a staging buffer. Frees are deferred by two frames
+	// like the deletion queue does
+	void GenerateSyntheticTrace(Trace& trace) {
+		std::mt19937 rng(SYNTHETIC_SEED);
+		auto allocate = [&](QbVkAllocationTag tag, QbVkAllocationType type, QbVkMemoryUsage usage, VkDeviceSize size, VkDeviceSize alignment) {
+			TraceOp op;
+			op.allocate = true;
+			op.slot = trace.slotCount++;
+			op.tag = tag;
+			op.type = type;
+			op.usage = usage;
+			op.requirements = { size, alignment, ~0u };
+			trace.ops.push_back(op);
+			return op.slot;
+		};
+		auto free = [&](uint32_t slot) {
+			TraceOp op;
+			op.slot = slot;
+			trace.ops.push_back(op);
+		};
+		// 24 byte vertices and 1.5 indices per vertex
+		auto mesh = [&](eastl::vector<uint32_t>& slots) {
+			const auto vertices = std::uniform_int_distribution<uint32_t>(1500, 14000)(rng);
+			slots.push_back(allocate(QbVkAllocationTag::QBVK_ALLOCATION_TAG_STREAMED_MESH, QbVkAllocationType::QBVK_ALLOCATION_TYPE_BUFFER,
+				QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY, vertices * 24ull, 256));
+			slots.push_back(allocate(QbVkAllocationTag::QBVK_ALLOCATION_TAG_STREAMED_MESH, QbVkAllocationType::QBVK_ALLOCATION_TYPE_BUFFER,
+				QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY, vertices * 6ull, 256));
+		};
+		// Square RGBA8 texture with a full mip chain
+		auto texture = [&](uint32_t extent) {
+			return allocate(QbVkAllocationTag::QBVK_ALLOCATION_TAG_TEXTURE, QbVkAllocationType::QBVK_ALLOCATION_TYPE_IMAGE_OPTIMAL,
+				QbVkMemoryUsage::QBVK_MEMORY_USAGE_GPU_ONLY, extent * extent * 4ull * 4 / 3, 4096);
+		};
+
+		eastl::vector<eastl::vector<uint32_t>> chunks(SYNTHETIC_CHUNKS);
+		eastl::vector<uint32_t> textures;
+		eastl::array<eastl::vector<uint32_t>, 2> pendingFrees;
+		for (auto& chunk : chunks) mesh(chunk);
+		for (auto i = 0; i < 4; i++) {
+			textures.push_back(texture(512u << std::uniform_int_distribution<uint32_t>(0, 2)(rng)));
+		}
+
+		for (uint32_t frame = 0; frame < SYNTHETIC_FRAMES; frame++) {
+			for (auto slot : pendingFrees[1]) free(slot);
+			pendingFrees[1] = eastl::move(pendingFrees[0]);
+			pendingFrees[0].clear();
+
+			const bool remeshAll = frame % 150 == 149;
+			const auto remesh = remeshAll ? SYNTHETIC_CHUNKS : std::uniform_int_distribution<uint32_t>(0, 6)(rng);
+			for (uint32_t i = 0; i < remesh; i++) {
+				auto& chunk = chunks[remeshAll ? i : std::uniform_int_distribution<uint32_t>(0, SYNTHETIC_CHUNKS - 1)(rng)];
+				pendingFrees[0].insert(pendingFrees[0].end(), chunk.begin(), chunk.end());
+				chunk.clear();
+				mesh(chunk);
+			}
+
+			if (frame % 40 == 0) {
+				const auto extent = 256u << std::uniform_int_distribution<uint32_t>(0, 3)(rng);
+				pendingFrees[0].push_back(allocate(QbVkAllocationTag::QBVK_ALLOCATION_TAG_STAGING, QbVkAllocationType::QBVK_ALLOCATION_TYPE_BUFFER,
+					QbVkMemoryUsage::QBVK_MEMORY_USAGE_CPU_ONLY, extent * extent * 4ull, 16));
+				textures.push_back(texture(extent));
+			}
+		}
+
+		for (const auto& pending : pendingFrees) {
+			for (auto slot : pending) free(slot);
+		}
+		for (const auto& chunk : chunks) {
+			for (auto slot : chunk) free(slot);
+		}
+		for (auto slot : textures) free(slot);
+	}
+
+	Result Replay(const Trace& trace, QbVkPoolType poolType) {
+		auto backend = eastl::make_unique<TimedHostMemoryBackend>();
+		auto* hostBackend = backend.get();
+		QbVkAllocator allocator(eastl::move(backend), 1, QbVkHostMemoryBackend::HostMemoryProperties());
+		for (auto i = 0; i < static_cast<int>(QbVkAllocationTag::QBVK_ALLOCATION_TAG_COUNT); i++) {
+			allocator.SetPoolType(static_cast<QbVkAllocationTag>(i), poolType);
+		}
+
+		Result result;
+		eastl::vector<QbVkAllocation> allocations(trace.slotCount);
+		// Requested sizes, the allocations themselves are rounded up by the pools
+		eastl::vector<VkDeviceSize> requestedSizes(trace.slotCount);
+		VkDeviceSize live = 0;
+		uint32_t samples = 0;
+		std::chrono::steady_clock::duration elapsed{};
+
+		for (auto i = 0; i < trace.ops.size(); i++) {
+			const auto& op = trace.ops[i];
+			auto& allocation = allocations[op.slot];
+			if (op.allocate) {
+				const auto start = std::chrono::steady_clock::now();
+				allocation = allocator.AllocateMemory(op.requirements, op.usage, op.type, op.tag);
+				elapsed += std::chrono::steady_clock::now() - start;
+				if (allocation.deviceMemory == VK_NULL_HANDLE) {
+					result.failed++;
+					continue;
+				}
+				requestedSizes[op.slot] = op.requirements.size;
+				live += op.requirements.size;
+			}
+			else {
+				// The allocation failed during the replay
+				if (allocation.deviceMemory == VK_NULL_HANDLE) continue;
+				live -= requestedSizes[op.slot];
+				const auto start = std::chrono::steady_clock::now();
+				allocator.FreeMemory(allocation);
+				elapsed += std::chrono::steady_clock::now() - start;
+			}
+
+			result.peakReserved = eastl::max(result.peakReserved, hostBackend->GetAllocatedSize());
+			result.peakLive = eastl::max(result.peakLive, live);
+
+			if (i % FRAGMENTATION_SAMPLE_INTERVAL == 0) {
+				// Weighted by free size, so nearly full pools don't dominate
+				VkDeviceSize freeSize = 0;
+				double weighted = 0.0;
+				for (const auto& stats : allocator.GetPoolStats()) {
+					freeSize += stats.freeSize;
+					weighted += static_cast<double>(stats.fragmentation) * stats.freeSize;
+				}
+				const auto fragmentation = freeSize > 0 ? static_cast<float>(weighted / freeSize) : 0.0f;
+				result.meanFragmentation += fragmentation;
+				result.maxFragmentation = eastl::max(result.maxFragmentation, fragmentation);
+				samples++;
+			}
+		}
+		if (samples > 0) result.meanFragmentation /= samples;
+		result.allocatorMs = std::chrono::duration<double, std::milli>(elapsed - hostBackend->elapsed).count();
+		result.poolsCreated = hostBackend->allocationCount;
+
+		// Allocations still alive at the end of the trace
+		for (auto& allocation : allocations) {
+			if (allocation.deviceMemory != VK_NULL_HANDLE) allocator.FreeMemory(allocation);
+		}
+		return result;
+	}
+
+	void PrintResult(const char* name, const Result& result, size_t opCount, uint32_t iterations) {
+		printf("%-10s %8.3f ms %8.1f ns/op %6u pools created %8.2f MB peak reserved %8.2f MB peak live %6.3f mean frag %6.3f max frag %u failed\n",
+			name, result.allocatorMs / iterations, result.allocatorMs * 1e6 / (static_cast<double>(opCount) * iterations), result.poolsCreated,
+			result.peakReserved / 1024.0 / 1024.0, result.peakLive / 1024.0 / 1024.0,
+			result.meanFragmentation, result.maxFragmentation, result.failed);
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		printf("Usage: AllocatorBenchmark <trace | --synthetic> [iterations]\n");
+		return 1;
+	}
+	const uint32_t iterations = argc > 2 ? static_cast<uint32_t>(eastl::max(atoi(argv[2]), 1)) : 1;
+
+	Trace trace;
+	const bool synthetic = strcmp(argv[1], "--synthetic") == 0;
+	if (synthetic) {
+		GenerateSyntheticTrace(trace);
+	}
+	else if (!LoadTrace(argv[1], trace)) {
+		printf("No allocations in %s\n", argv[1]);
+		return 1;
+	}
+	printf("Replaying %u operations from %s, %u iteration(s)\n", static_cast<uint32_t>(trace.ops.size()),
+		synthetic ? "the synthetic voxel workload" : argv[1], iterations);
+
+	for (const auto& [name, poolType] : { eastl::make_pair("First-fit", QbVkPoolType::QBVK_POOL_TYPE_FIRST_FIT),
+		eastl::make_pair("Buddy", QbVkPoolType::QBVK_POOL_TYPE_BUDDY) }) {
+
+		// Timing is summed over the iterations, the memory figures are the same for each of them
+		Result total;
+		for (uint32_t i = 0; i < iterations; i++) {
+			const auto result = Replay(trace, poolType);
+			total.allocatorMs += result.allocatorMs;
+			if (i == 0) {
+				const auto allocatorMs = total.allocatorMs;
+				total = result;
+				total.allocatorMs = allocatorMs;
+			}
+		}
+		PrintResult(name, total, trace.ops.size(), iterations);
+	}
+	return 0;
+}
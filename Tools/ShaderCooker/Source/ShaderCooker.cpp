@@ -0,0 +1,124 @@
+// Cooks GLSL shaders into SPIR-V along with the reflection pipeline creation needs.
+// The engine picks up <shader>.spv and <shader>.refl in place of <shader> when the source isn't shipped,
+// and builds with QUADBIT_COOKED_SHADERS_ONLY load nothing else.
+// The stage is taken from the file name, e.g. water_vert.glsl, or from a .vert/.frag/.comp extension.
+// Run from the directory the engine runs from, so includes resolve the same way.
+//
+// Usage: ShaderCooker [shader or directory]... (defaults to Assets)
+
+#include <cstdio>
+#include <filesystem>
+
+#include <EASTL/chrono.h>
+#include <EASTL/string.h>
+#include <EASTL/vector.h>
+
+#include "Engine/Rendering/Shaders/ShaderCompiler.h"
+#include "Engine/Rendering/Shaders/ShaderReflection.h"
+
+// OPERATOR OVERLOADS FOR EASTL
+void* operator new[](size_t size, const char* name, int flags, unsigned debugFlags, const char* file, int line) {
+	return new uint8_t[size];
+}
+
+void* operator new[](size_t size, size_t alignment, size_t alignmentOffset, const char* pName, int flags, unsigned debugFlags, const char* file, int line) {
+	return new uint8_t[size];
+}
+
+namespace {
+	using namespace Quadbit;
+
+	struct Shader {
+		std::filesystem::path path;
+		QbVkShaderType shaderType;
+		QbVkShaderJobHandle job;
+	};
+
+	// Files without a recognisable stage are includes, and are skipped
+	bool GetShaderType(const std::filesystem::path& path, QbVkShaderType& shaderType) {
+		auto extension = path.extension().string();
+		auto stem = path.stem().string();
+		if (extension == ".glsl") {
+			const auto separator = stem.rfind('_');
+			if (separator == std::string::npos) return false;
+			extension = "." + stem.substr(separator + 1);
+		}
+
+		if (extension == ".vert") shaderType = QbVkShaderType::QBVK_SHADER_TYPE_VERTEX;
+		else if (extension == ".frag") shaderType = QbVkShaderType::QBVK_SHADER_TYPE_FRAGMENT;
+		else if (extension == ".comp") shaderType = QbVkShaderType::QBVK_SHADER_TYPE_COMPUTE;
+		else return false;
+		return true;
+	}
+
+	bool WriteSpirv(const std::filesystem::path& path, const std::vector<uint32_t>& spirv) {
+		FILE* file = fopen(path.string().c_str(), "wb");
+		if (file == nullptr) return false;
+		const bool written = fwrite(spirv.data(), sizeof(uint32_t), spirv.size(), file) == spirv.size();
+		fclose(file);
+		return written;
+	}
+}
+
+int main(int argc, char** argv) {
+	eastl::vector<std::filesystem::path> inputs;
+	for (int i = 1; i < argc; i++) inputs.push_back(argv[i]);
+	if (inputs.empty()) inputs.push_back("Assets");
+
+	eastl::vector<Shader> shaders;
+	QbVkShaderType shaderType;
+	for (const auto& input : inputs) {
+		std::error_code error;
+		if (std::filesystem::is_directory(input, error)) {
+			for (const auto& entry : std::filesystem::recursive_directory_iterator(input, error)) {
+				if (entry.is_regular_file() && GetShaderType(entry.path(), shaderType)) shaders.push_back({ entry.path(), shaderType });
+			}
+		}
+		else if (std::filesystem::is_regular_file(input, error) && GetShaderType(input, shaderType)) {
+			shaders.push_back({ input, shaderType });
+		}
+		else {
+			printf("No such shader or directory %s\n", input.string().c_str());
+		}
+	}
+
+	if (shaders.empty()) {
+		printf("Usage: ShaderCooker [shader or directory]...\n");
+		return 1;
+	}
+
+	const auto start = eastl::chrono::high_resolution_clock::now();
+
+	// Everything is submitted up front so the compiler's workers can go through the shaders in parallel
+	QbVkShaderCompiler compiler;
+	for (auto& shader : shaders) {
+		shader.job = compiler.Submit(shader.path.generic_string().c_str(), shader.shaderType);
+	}
+
+	int failed = 0;
+	for (auto& shader : shaders) {
+		const auto compiled = compiler.Wait(shader.job);
+		const auto path = shader.path.string();
+		if (compiled.spirv.empty()) {
+			printf("Failed to compile %s\n", path.c_str());
+			failed++;
+			continue;
+		}
+
+		if (!WriteSpirv(path + ".spv", compiled.spirv) || !ShaderReflection::Store((path + ".refl").c_str(), compiled.reflection)) {
+			printf("Failed to write %s.spv/.refl\n", path.c_str());
+			failed++;
+			continue;
+		}
+		printf("%s: %zu bytes of SPIR-V, %zu resources\n", path.c_str(),
+			compiled.spirv.size() * sizeof(uint32_t), static_cast<size_t>(compiled.reflection.resources.size()));
+	}
+
+	// Warm runs are served from the shader cache, so comparing against a run with an empty cache shows what it saves
+	const auto elapsed = eastl::chrono::high_resolution_clock::now() - start;
+	const auto stats = compiler.GetCacheStats();
+	printf("Cooked %zu shaders in %.1f ms (%u cache hits, %u misses)\n", static_cast<size_t>(shaders.size() - failed),
+		static_cast<eastl::chrono::duration<float, eastl::milli>>(elapsed).count(), stats.hits, stats.misses);
+
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+// Cooks images into block compressed KTX2 textures with a full mip chain.
+// The engine picks up <image>.ktx2 in place of <image>.png/jpg when it exists.
+// Textures are always cooked as UNORM, like the engine loads plain images, as the shaders decode sRGB colour themselves.
+// The role of a texture, taken from its name, decides whether its mips are filtered in linear space.
+//
+// Usage: TextureCooker <image or directory>...
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+
+#include <EASTL/vector.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include "Engine/Rendering/Textures/BlockCompression.h"
+#include "Engine/Rendering/Textures/Mipmaps.h"
+#include "Engine/Rendering/Textures/TextureContainer.h"
+
+// OPERATOR OVERLOADS FOR EASTL
+void* operator new[](size_t size, const char* name, int flags, unsigned debugFlags, const char* file, int line) {
+	return new uint8_t[size];
+}
+
+void* operator new[](size_t size, size_t alignment, size_t alignmentOffset, const char* pName, int flags, unsigned debugFlags, const char* file, int line) {
+	return new uint8_t[size];
+}
+
+namespace {
+	using namespace Quadbit;
+
+	bool IsImage(const std::filesystem::path& path) {
+		auto extension = path.extension().string();
+		for (auto& c : extension) c = static_cast<char>(tolower(c));
+		return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".tga";
+	}
+
+	enum class TextureRole {
+		Colour,
+		Normal,
+		// Metallic-roughness, occlusion and other linear data
+		Data
+	};
+
+	TextureRole GetRole(const std::filesystem::path& path) {
+		auto name = path.filename().string();
+		for (auto& c : name) c = static_cast<char>(tolower(c));
+		if (name.find("normal") != std::string::npos) return TextureRole::Normal;
+		for (const char* data : { "metal", "rough", "occlusion", "_ao", "orm", "height", "mask" }) {
+			if (name.find(data) != std::string::npos) return TextureRole::Data;
+		}
+		return TextureRole::Colour;
+	}
+
+	// Normal maps keep two channels at full precision, anything with transparency keeps its alpha
+	VkFormat ChooseFormat(TextureRole role, const eastl::vector<uint8_t>& rgba) {
+		if (role == TextureRole::Normal) return VK_FORMAT_BC5_UNORM_BLOCK;
+
+		for (size_t i = 3; i < rgba.size(); i += 4) {
+			if (rgba[i] < 255) return VK_FORMAT_BC3_UNORM_BLOCK;
+		}
+		return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	}
+
+	// Well below the lowest the encoders reach on the bundled assets (22 dB for BC1, 34 dB for BC5),
+	// a file under this means the encoder is broken. Zero for formats the CPU can't decode, those aren't verified
+	double GetMinimumPSNR(VkFormat format) {
+		switch (format) {
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+			return 18.0;
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+			return 26.0;
+		default:
+			return 0.0;
+		}
+	}
+
+	// Only the channels the format stores are compared
+	double ComputePSNR(VkFormat format, const eastl::vector<uint8_t>& reference, const eastl::vector<uint8_t>& decoded) {
+		const uint32_t channels = (format == VK_FORMAT_BC5_UNORM_BLOCK) ? 2 :
+			(format == VK_FORMAT_BC3_UNORM_BLOCK || format == VK_FORMAT_BC3_SRGB_BLOCK) ? 4 : 3;
+
+		double error = 0.0;
+		for (size_t i = 0; i < reference.size(); i += 4) {
+			for (uint32_t c = 0; c < channels; c++) {
+				const double difference = static_cast<double>(reference[i + c]) - static_cast<double>(decoded[i + c]);
+				error += difference * difference;
+			}
+		}
+		error /= static_cast<double>(reference.size() / 4 * channels);
+		return error == 0.0 ? 99.0 : 10.0 * log10(255.0 * 255.0 / error);
+	}
+
+	bool Cook(const std::filesystem::path& path) {
+		int width, height, channels;
+		stbi_uc* pixels = stbi_load(path.string().c_str(), &width, &height, &channels, STBI_rgb_alpha);
+		if (pixels == nullptr) {
+			printf("Failed to load %s: %s\n", path.string().c_str(), stbi_failure_reason());
+			return false;
+		}
+		eastl::vector<uint8_t> rgba(pixels, pixels + static_cast<size_t>(width) * height * 4);
+		stbi_image_free(pixels);
+
+		const auto role = GetRole(path);
+		const auto format = ChooseFormat(role, rgba);
+		auto levelWidth = static_cast<uint32_t>(width);
+		auto levelHeight = static_cast<uint32_t>(height);
+
+		eastl::vector<eastl::vector<uint8_t>> levels;
+		auto level = rgba;
+		while (true) {
+			levels.push_back(BlockCompression::EncodeImage(format, level.data(), levelWidth, levelHeight));
+			if (levelWidth == 1 && levelHeight == 1) break;
+
+			level = Mipmaps::Downsample(level.data(), levelWidth, levelHeight, role == TextureRole::Colour);
+			levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+			levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+		}
+
+		// Check the top level against the reference decoder, this is what the engine falls back to without BC support.
+		// BC7 has no CPU decoder, so it can't be checked here
+		const auto minimumPSNR = GetMinimumPSNR(format);
+		double psnr = 0.0;
+		if (minimumPSNR > 0.0) {
+			const auto decoded = BlockCompression::DecodeImage(format, levels[0].data(), width, height);
+			psnr = ComputePSNR(format, rgba, decoded);
+			if (psnr < minimumPSNR) {
+				printf("Failed to cook %s: PSNR %.1f dB is below %.1f dB for format %i\n", path.string().c_str(), psnr, minimumPSNR, format);
+				return false;
+			}
+		}
+		else {
+			printf("Skipping verification of %s, format %i has no reference decoder\n", path.string().c_str(), format);
+		}
+
+		auto outputPath = path;
+		outputPath.replace_extension(".ktx2");
+		if (!TextureContainer::WriteKTX2(outputPath.string().c_str(), format, width, height, levels)) {
+			printf("Failed to write %s\n", outputPath.string().c_str());
+			return false;
+		}
+
+		printf("%s -> %s (%ix%i, %zu levels, format %i", path.string().c_str(), outputPath.filename().string().c_str(),
+			width, height, levels.size(), format);
+		if (minimumPSNR > 0.0) printf(", PSNR %.1f dB", psnr);
+		printf(")\n");
+		return true;
+	}
+}
+
+int main(int argc, char** argv) {
+	eastl::vector<std::filesystem::path> images;
+	for (int i = 1; i < argc; i++) {
+		std::error_code error;
+		const std::filesystem::path input(argv[i]);
+		if (std::filesystem::is_directory(input, error)) {
+			for (const auto& entry : std::filesystem::recursive_directory_iterator(input, error)) {
+				if (entry.is_regular_file() && IsImage(entry.path())) images.push_back(entry.path());
+			}
+		}
+		else if (std::filesystem::is_regular_file(input, error)) {
+			images.push_back(input);
+		}
+		else {
+			printf("No such file or directory %s\n", argv[i]);
+		}
+	}
+
+	if (images.empty()) {
+		printf("Usage: TextureCooker <image or directory>...\n");
+		return 1;
+	}
+
+	int failed = 0;
+	for (const auto& image : images) {
+		if (!Cook(image)) failed++;
+	}
+	return failed == 0 ? 0 : 1;
+}